@@ -1,5 +1,6 @@
 #include <iostream>
 
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -12,6 +13,19 @@
 #include <chrono>
 #include <random>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <elf.h>
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include "mpi.h"
 
 typedef struct State {
@@ -24,13 +38,303 @@ typedef struct Result {
     int32_t errorCode;
 } Result;
 
-typedef struct BranchData {
-    uint32_t hasBeenTaken;
-    uint32_t hasBeenSkipped;
-} BranchData;
+// Edge coverage, the way AFL does it. Every jump, call, return and branch (taken or not) hashes where it came from and
+// where it went into one byte of a fixed-size map and bumps that, so the map tells paths apart rather than just which
+// way each branch went. Collisions are possible but rare at this size.
+uint32_t const COVERAGE_MAP_SHIFT = 16;
+uint32_t const COVERAGE_MAP_SIZE  = 1u << COVERAGE_MAP_SHIFT;
+
+// Spot in the map for the instruction at pc. Instructions are 4 bytes apart, the multiply spreads them over the whole
+// map.
+__host__ __device__ inline uint32_t coverageLocation(uint32_t pc) {
+    return ((pc >> 2) * 0x9e3779b1u) >> (32 - COVERAGE_MAP_SHIFT);
+}
+
+// The CPU path decodes the program once into micro-ops (handler, register indices, sign-extended immediate, resolved
+// jump target) so that the instruction loop never touches the raw encoding again. The handler already knows the exact
+// operation, so funct3/funct7 never have to be looked at either.
+enum MicroOpHandler {
+    MOP_LUI, // Also auipc, the pc is folded into the immediate
+    MOP_JAL,
+    MOP_JALR,
+    MOP_BEQ,
+    MOP_BNE,
+    MOP_BLT,
+    MOP_BGE,
+    MOP_BLTU,
+    MOP_BGEU,
+    MOP_LB,
+    MOP_LH,
+    MOP_LW,
+    MOP_LBU,
+    MOP_LHU,
+    MOP_SB,
+    MOP_SH,
+    MOP_SW,
+    MOP_ADDI,
+    MOP_SLTI,
+    MOP_SLTIU,
+    MOP_XORI,
+    MOP_ORI,
+    MOP_ANDI,
+    MOP_SLLI,
+    MOP_SRLI,
+    MOP_SRAI,
+    MOP_ADD,
+    MOP_SUB,
+    MOP_SLL,
+    MOP_SLT,
+    MOP_SLTU,
+    MOP_XOR,
+    MOP_SRL,
+    MOP_SRA,
+    MOP_OR,
+    MOP_AND,
+    MOP_NOP,   // fence, ebreak, csr accesses, and anything that would only write x0
+    MOP_ECALL, // See classicalSystemCall()
+    // Superinstructions, see classicalFuseSuperinstructions
+    MOP_LI,
+    MOP_CALL,
+    MOP_LBU_BEQ,
+    MOP_LBU_BNE,
+    MOP_ADDI_SW,
+    MOP_LW_ADDI,
+    MOP_OUT_OF_PROGRAM, // Sentinel after the last instruction, also what illegal instructions decode to
+};
+
+typedef struct MicroOp {
+    uint8_t handler;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    // Sign-extended immediate, for jal the link value (pc + 4)
+    uint32_t imm;
+    // Branches and jal: index of the micro-op to continue at. jalr: the link value (pc + 4)
+    uint32_t target;
+} MicroOp;
+
+// Error code for when control leaves the program (or hits something we can't decode)
+int32_t const ERROR_OUT_OF_PROGRAM = -3;
+
+// Linux RV32 system call numbers (newlib's are the same) for ecall, see classicalSystemCall()
+uint32_t const SYSCALL_READ            = 63;
+uint32_t const SYSCALL_WRITE           = 64;
+uint32_t const SYSCALL_EXIT            = 93;
+uint32_t const SYSCALL_EXIT_GROUP      = 94;
+uint32_t const SYSCALL_CLOCK_GETTIME   = 113;
+uint32_t const SYSCALL_GETTIMEOFDAY    = 169;
+uint32_t const SYSCALL_BRK             = 214;
+uint32_t const SYSCALL_CLOCK_GETTIME64 = 403;
+
+// Fuses common instruction pairs into one micro-op, which does both and then skips the second one. The second micro-op
+// is left as it was, so jumping straight to it still works and index == pc / 4 still holds. Fields of the fused op:
+//   MOP_LI       lui/auipc rd + addi rd, rd           imm = the final constant
+//   MOP_CALL     lui/auipc rd + jalr rs2, imm(rd)     imm = value of rd, target = callee index, rs2 = link register
+//   MOP_LBU_BEQ  lbu rd, imm(rs1) + beq rd, rs2       target = branch target index (same for MOP_LBU_BNE)
+//   MOP_ADDI_SW  addi rd, rs1, imm + sw rs2, off(rd)  target = off
+//   MOP_LW_ADDI  lw rd, imm(rs1) + addi rs1, rs1, n   target = n
+void classicalFuseSuperinstructions(MicroOp* ops, uint32_t instCount) {
+    for (uint32_t i = 0; i + 1 < instCount; i++) {
+        MicroOp* first  = ops + i;
+        MicroOp* second = ops + i + 1;
+
+        switch (first->handler) {
+            case MOP_LUI: {
+                if (second->handler == MOP_ADDI && second->rd == first->rd && second->rs1 == first->rd) {
+                    first->handler = MOP_LI;
+                    first->imm += second->imm;
+                } else if (second->handler == MOP_JALR && second->rs1 == first->rd) {
+                    uint32_t dest = (first->imm + second->imm) & ~1u;
+                    if (dest % 4 == 0 && dest / 4 < instCount) {
+                        first->handler = MOP_CALL;
+                        first->rs2     = second->rd;
+                        first->target  = dest / 4;
+                    }
+                }
+                break;
+            }
+            case MOP_LBU: {
+                if ((second->handler == MOP_BEQ || second->handler == MOP_BNE) &&
+                    (second->rs1 == first->rd || second->rs2 == first->rd)) {
+                    first->handler = (second->handler == MOP_BEQ) ? MOP_LBU_BEQ : MOP_LBU_BNE;
+                    first->rs2     = (second->rs1 == first->rd) ? second->rs2 : second->rs1;
+                    first->target  = second->target;
+                }
+                break;
+            }
+            case MOP_ADDI: {
+                if (second->handler == MOP_SW && second->rs1 == first->rd) {
+                    first->handler = MOP_ADDI_SW;
+                    first->rs2     = second->rs2;
+                    first->target  = second->imm;
+                }
+                break;
+            }
+            case MOP_LW: {
+                if (second->handler == MOP_ADDI && second->rd == first->rs1 && second->rs1 == first->rs1) {
+                    first->handler = MOP_LW_ADDI;
+                    first->target  = second->imm;
+                }
+                break;
+            }
+        }
+    }
+}
+
+// ops needs room for (programSize / 4) + 1 micro-ops, the last one is the sentinel
+void classicalDecodeProgram(uint8_t* program, uint32_t programSize, MicroOp* ops) {
+    uint32_t const instCount = programSize / 4;
+
+    for (uint32_t i = 0; i < instCount; i++) {
+        uint32_t inst = *(uint32_t*) (program + (i * 4));
+        uint32_t pc   = i * 4;
+
+        MicroOp op;
+        op.handler = MOP_OUT_OF_PROGRAM;
+        op.rd      = (inst >> 7) & 0x1f;
+        op.rs1     = (inst >> 15) & 0x1f;
+        op.rs2     = (inst >> 20) & 0x1f;
+        op.imm     = (uint32_t) ((int32_t) inst >> 20); // I-type, already sign extended
+        op.target  = 0;
+
+        uint32_t funct3      = (inst >> 12) & 0x7;
+        int32_t writesOnlyRd = 1;
+
+        switch (inst & 0x7f) {
+            case 0x37: // lui
+            {
+                op.handler = MOP_LUI;
+                op.imm     = inst & 0xfffff000;
+                break;
+            }
+            case 0x17: // auipc
+            {
+                op.handler = MOP_LUI;
+                op.imm     = pc + (inst & 0xfffff000);
+                break;
+            }
+            case 0x6f: // jal
+            {
+                // Same bit shuffle as always, [20|10:1|11|19:12]
+                uint32_t imm = (uint32_t) ((int32_t) (inst & (1u << 31)) >> 11) | ((inst & 0x7fe00000) >> 20) |
+                               ((inst & 0x00100000) >> 9) | (inst & 0x000ff000);
+                uint32_t dest = pc + imm;
+                op.handler    = MOP_JAL;
+                op.imm        = pc + 4;
+                op.target     = (dest % 4 == 0 && dest / 4 < instCount) ? dest / 4 : instCount;
+                writesOnlyRd  = 0;
+                break;
+            }
+            case 0x67: // jalr
+            {
+                op.handler   = MOP_JALR;
+                op.target    = pc + 4;
+                writesOnlyRd = 0;
+                break;
+            }
+            case 0x63: // beq, bne, blt, bge, bltu, bgeu
+            {
+                // [12|10:5] up top and [4:1|11] where rd would be
+                uint32_t imm = (uint32_t) ((int32_t) (inst & (1u << 31)) >> 19) | ((inst & 0x7e000000) >> 20) |
+                               (op.rd & 0x1e) | ((op.rd & 0x1) << 11);
+                uint32_t dest = pc + imm;
+                uint8_t const branchHandlers[8] = {MOP_BEQ, MOP_BNE,  MOP_OUT_OF_PROGRAM, MOP_OUT_OF_PROGRAM,
+                                                   MOP_BLT, MOP_BGE, MOP_BLTU,           MOP_BGEU};
+                op.handler   = branchHandlers[funct3];
+                op.target    = (dest % 4 == 0 && dest / 4 < instCount) ? dest / 4 : instCount;
+                writesOnlyRd = 0;
+                break;
+            }
+            case 0x03: // lb, lh, lw, lbu, lhu
+            {
+                uint8_t const loadHandlers[8] = {MOP_LB,  MOP_LH,  MOP_LW,             MOP_OUT_OF_PROGRAM,
+                                                 MOP_LBU, MOP_LHU, MOP_OUT_OF_PROGRAM, MOP_OUT_OF_PROGRAM};
+                op.handler = loadHandlers[funct3];
+                break;
+            }
+            case 0x23: // sb, sh, sw
+            {
+                uint8_t const storeHandlers[8] = {MOP_SB, MOP_SH, MOP_SW, MOP_OUT_OF_PROGRAM, MOP_OUT_OF_PROGRAM,
+                                                  MOP_OUT_OF_PROGRAM, MOP_OUT_OF_PROGRAM, MOP_OUT_OF_PROGRAM};
+                op.handler   = storeHandlers[funct3];
+                op.imm       = (uint32_t) ((int32_t) (inst & 0xfe000000) >> 20) | op.rd;
+                writesOnlyRd = 0;
+                break;
+            }
+            case 0x13: // addi, slti, sltiu, xori, ori, andi, slli, srli, srai
+            {
+                uint8_t const immHandlers[8] = {MOP_ADDI, MOP_SLLI, MOP_SLTI, MOP_SLTIU,
+                                                MOP_XORI, MOP_SRLI, MOP_ORI,  MOP_ANDI};
+                op.handler = immHandlers[funct3];
+                if (funct3 == 0x1 || funct3 == 0x5) {
+                    op.imm &= 0x1f;
+                    if (funct3 == 0x5 && (inst & (1u << 30))) {
+                        op.handler = MOP_SRAI;
+                    }
+                }
+                break;
+            }
+            case 0x33: // add, sub, sll, slt, sltu, xor, srl, sra, or, and
+            {
+                uint8_t const arithHandlers[8] = {MOP_ADD, MOP_SLL, MOP_SLT, MOP_SLTU,
+                                                  MOP_XOR, MOP_SRL, MOP_OR,  MOP_AND};
+                op.handler = arithHandlers[funct3];
+                if (inst & (1u << 30)) {
+                    if (funct3 == 0x0) {
+                        op.handler = MOP_SUB;
+                    } else if (funct3 == 0x5) {
+                        op.handler = MOP_SRA;
+                    }
+                }
+                break;
+            }
+            case 0x0f: // fence, fence.i
+            case 0x73: // ecall, ebreak, csrrw, csrrs, csrrc, csrrwi, csrrsi, csrrci
+            {
+                // Only ecall does anything
+                op.handler   = inst == 0x73 ? MOP_ECALL : MOP_NOP;
+                writesOnlyRd = 0;
+                break;
+            }
+            default: {
+                writesOnlyRd = 0;
+                break;
+            }
+        }
+
+        // x0 is hardwired to 0, so an instruction whose only effect is writing it does nothing at all. That way the
+        // loop doesn't have to put x0 back after every instruction. Note this also drops loads into x0, which means
+        // they can't fault anymore, but compilers don't emit those anyway.
+        if (writesOnlyRd && op.rd == 0 && op.handler != MOP_OUT_OF_PROGRAM) {
+            op.handler = MOP_NOP;
+        }
+
+        ops[i] = op;
+    }
+
+    MicroOp sentinel;
+    sentinel.handler = MOP_OUT_OF_PROGRAM;
+    sentinel.rd      = 0;
+    sentinel.rs1     = 0;
+    sentinel.rs2     = 0;
+    sentinel.imm     = 0;
+    sentinel.target  = 0;
+    ops[instCount]   = sentinel;
+
+    classicalFuseSuperinstructions(ops, instCount);
+}
+
+// coverage is shared by every thread, so it only records that an edge was hit, with a plain store: they all store the
+// same value and nobody has to wait for an atomic. previousLocation is the thread's own.
+__device__ __inline__ void deviceCoverageEdge(uint8_t* coverage, uint32_t* previousLocation, uint32_t pc) {
+    uint32_t const location                = coverageLocation(pc);
+    coverage[location ^ *previousLocation] = 1;
+    *previousLocation                      = location >> 1;
+}
 
-int classicalExecuteInstruction(State* state, uint32_t inst, uint8_t* memory, uint8_t* program, uint32_t memorySize,
-                                uint32_t programSize, BranchData* branchResults) {
+__device__ __inline__ int executeInstruction(State* state, uint32_t inst, uint8_t* memory, uint8_t* program,
+                                             uint32_t memorySize, uint32_t programSize, uint8_t* coverage,
+                                             uint32_t* previousLocation) {
     // Normally this is the destination register, but in S and B type instructions
     // where there is not destination register these same bits communicate parts of an immediate
     // value. We always need to look at these bits as a unit no matter what
@@ -74,6 +378,7 @@ int classicalExecuteInstruction(State* state, uint32_t inst, uint8_t* memory, ui
                 imm |= 0xffe00000;
             }
             state->pc += imm;
+            deviceCoverageEdge(coverage, previousLocation, state->pc);
             break;
         }
         case 0x67: // jalr
@@ -88,6 +393,7 @@ int classicalExecuteInstruction(State* state, uint32_t inst, uint8_t* memory, ui
             }
             state->pc    = (state->x[rs1] + (int32_t) imm) & ~1;
             state->x[rd] = temp;
+            deviceCoverageEdge(coverage, previousLocation, state->pc);
             break;
         }
         case 0x63: // beq, bne, blt, bge, bltu, bgeu
@@ -149,19 +455,11 @@ int classicalExecuteInstruction(State* state, uint32_t inst, uint8_t* memory, ui
                     // TODO: handle if it isn't one of these? Set trap maybe?
             }
             if (takeBranch) {
-                uint32_t zero = 0;
-                __atomic_add_fetch(&(branchResults[state->pc >> 2].hasBeenTaken), 1, __ATOMIC_RELAXED);
-                //__atomic_compare_exchange_n(&(branchResults[state->pc >> 2].hasBeenTaken), &zero, (uint32_t)1, true,
-                //__ATOMIC_RELAXED, __ATOMIC_RELAXED);
                 state->pc += (int32_t) imm;
             } else {
-                uint32_t zero = 0;
-                __atomic_add_fetch(&(branchResults[state->pc >> 2].hasBeenSkipped), 1, __ATOMIC_RELAXED);
-                //__atomic_compare_exchange_n(&(branchResults[state->pc >> 2].hasBeenSkipped), &zero, (uint32_t)1, true,
-                //__ATOMIC_RELAXED, __ATOMIC_RELAXED);
                 state->pc += 4;
             }
-
+            deviceCoverageEdge(coverage, previousLocation, state->pc);
             break;
         }
         case 0x03: // lb, lh, lw, lbu, lhu
@@ -429,7 +727,29 @@ int classicalExecuteInstruction(State* state, uint32_t inst, uint8_t* memory, ui
         }
         case 0x73: // ecall, ebreak, csrrw, csrrs, csrrc, csrrwi, csrrsi, csrrci
         {
-            // TODO: do something other than nop?
+            // GPU instances have no input, output or heap, so this is the part of classicalSystemCall() that does
+            // without: exit, and reading and writing nothing
+            if (inst == 0x73) {
+                switch (state->x[17]) {
+                    case SYSCALL_EXIT:
+                    case SYSCALL_EXIT_GROUP: {
+                        state->pc = 0xfffffff0; // Done address
+                        return 0;
+                    }
+                    case SYSCALL_WRITE: {
+                        state->x[10] = state->x[12];
+                        break;
+                    }
+                    case SYSCALL_READ: {
+                        state->x[10] = 0;
+                        break;
+                    }
+                    default: {
+                        state->x[10] = (uint32_t) -ENOSYS;
+                        break;
+                    }
+                }
+            }
             state->pc += 4;
             break;
         }
@@ -443,522 +763,1265 @@ int classicalExecuteInstruction(State* state, uint32_t inst, uint8_t* memory, ui
     return 0;
 }
 
-__device__ __inline__ int executeInstruction(State* state, uint32_t inst, uint8_t* memory, uint8_t* program,
-                                             uint32_t memorySize, uint32_t programSize, BranchData* branchResults) {
-    // Normally this is the destination register, but in S and B type instructions
-    // where there is not destination register these same bits communicate parts of an immediate
-    // value. We always need to look at these bits as a unit no matter what
-    uint32_t rd = (inst >> 7) & 0x1f; // Bits 11 to 7
+__global__ void kernelExecuteProgram(uint8_t* program, uint8_t* globalMemory, uint32_t memorySize, int32_t argc,
+                                     uint32_t argv, uint32_t programSize, uint32_t entry, Result* globalResults,
+                                     uint32_t maxOps, uint8_t* coverage) {
+    uint32_t index = blockIdx.x * blockDim.x + threadIdx.x;
 
-    uint32_t opcode = inst & 0x7f;
+    uint8_t* memory = globalMemory + (memorySize * index);
 
-    // I literally just put these in the order they are in as I read them from page 106 of the
-    // RISCV user guide version 2.2 lol
-    // There are certainly better ways to do this!
-    switch (opcode) {
-        case 0x37: // lui
-        {
-            // We don't need to load it into low bits, then reshift it into high bits... can just read the bits in
-            // place! Lower bits are filled with zeros according to standard
-            state->x[rd] = inst & 0xfffff000;
-            state->pc += 4;
+    Result* myResults = globalResults + index;
+
+    State state;
+
+    for (int i = 0; i < 32; i++) {
+        state.x[i] = 0;
+    }
+
+    state.pc = entry;
+
+    uint32_t const DONE_ADDRESS_CUDA = 0xfffffff0;
+
+    state.x[1] = DONE_ADDRESS_CUDA;
+    state.x[2] = argv;
+
+    state.x[10] = argc;
+    state.x[11] = argv;
+
+    uint32_t previousLocation = 0;
+
+    int count = 0;
+    while (count < maxOps) {
+        uint32_t inst = *(uint32_t*) (program + state.pc);
+        // printf("executing instruction: %08x\n", inst);
+        // printf("pc = %u\n", state.pc);
+        if (executeInstruction(&state, inst, memory, program, memorySize, programSize, coverage, &previousLocation) ||
+            state.pc == DONE_ADDRESS_CUDA) {
             break;
         }
-        case 0x17: // auipc
-        {
-            // Mirrors the above, but result is imm + offset from pc
-            state->x[rd] = state->pc + (inst & 0xfffff000);
-            state->pc += 4;
-            break;
+        count++;
+    }
+
+    // if(index % 1000 == 0)
+    // {
+    // 	printf("my word was \"%s\" and i completed in %d cycles\n", (memory + *(uint32_t*)(memory + (argv + 4))),
+    // count);
+    // }
+
+    myResults->returnVal = state.x[10];
+    myResults->errorCode = state.x[0]; // If we have an error, just write to x[0] and self destruct out of the loop
+}
+
+// Bounds checks a load of (extra + 1) bytes and figures out whether it reads the program image or the instance memory.
+// Returns NULL and sets the error code if the access is out of bounds.
+inline uint8_t* classicalLoadAddress(uint32_t memOffset, uint32_t extra, uint8_t* memory, uint8_t* program,
+                                     uint32_t memorySize, uint32_t programSize, uint32_t* errorCode) {
+    if (memOffset >= memorySize || extra >= memorySize - memOffset) {
+        *errorCode = -2;
+        return NULL;
+    }
+    if (memOffset < programSize) {
+        if (memOffset + extra >= programSize) {
+            *errorCode = -1;
+            return NULL;
         }
-        case 0x6f: // jal
-        {
-            // This part seems like it would be much nicer in hardware...
-            // The bit order is very strange, [20|10:1|11|19:12]
-            // so 31 -> 20 == 11, 30 -> 10 == 20, 20 -> 11 == 9, 19 -> 19 == 0
-            // Since right shift doing sign extension is implementation dependent, and
-            // this wants sign extension, we do it manually...
-            // also, yes, this is correct -- it doesn't set lsb
-            uint32_t imm = ((inst & (1 << 31)) >> 11) | ((inst & 0x7fe00000) >> 20) | ((inst & 0x00100000) >> 9) |
-                           (inst & 0x000ff000);
-            state->x[rd] = state->pc + 4;
-            // Two cases: either our machine does sign extension and this is redundant, or it defaults to 0 extension
-            // and we need this No machine will default to 1 extension so we're all good
-            if (inst & (1 << 31)) {
-                imm |= 0xffe00000;
-            }
-            state->pc += imm;
-            break;
+        return program + memOffset;
+    }
+    return memory + memOffset;
+}
+
+// Host memory for everything a process' instances own (their memory, results, snapshot and coverage maps), all freed
+// together at the end. It comes in chunks of whole 2 MiB pages, transparent huge pages if the kernel hands them out,
+// so resetting and scanning all that doesn't keep missing the TLB. The pages come from the NUMA node the process was
+// on when it made the arena if they can (mpirun binds every rank to a core of its own by default, so it stays there).
+// Every allocation starts on a cache line of its own.
+size_t const ARENA_HUGE_PAGE_SIZE  = (size_t) 2 << 20;
+size_t const ARENA_CACHE_LINE_SIZE = 64;
+int const ARENA_MAX_NODES          = 1024; // Nodes mbind() gets told about, any machine we run on has fewer
+
+typedef struct Arena {
+    uint8_t* chunk; // The one allocations come out of, its first cache line has the one before and that one's size
+    size_t size;
+    size_t used;
+    int node; // -1 if the kernel wouldn't say
+} Arena;
+
+void arenaCreate(Arena* arena) {
+    unsigned cpu;
+    unsigned node;
+    arena->chunk = NULL;
+    arena->size  = 0;
+    arena->used  = 0;
+    arena->node  = getcpu(&cpu, &node) == 0 ? (int) node : -1;
+}
+
+// size bytes of zeroes. Returns NULL if there's no memory left.
+void* arenaAllocate(Arena* arena, size_t size) {
+    size_t const start = (arena->used + ARENA_CACHE_LINE_SIZE - 1) & ~(ARENA_CACHE_LINE_SIZE - 1);
+    if (arena->chunk && start <= arena->size && size <= arena->size - start) {
+        arena->used = start + size;
+        return arena->chunk + start;
+    }
+
+    // mmap only lines mappings up with small pages. Mapping a huge page more and trimming the ends lines the chunk up
+    // with a big one, which the kernel needs to back it with huge pages at all.
+    size_t const chunkSize =
+            (ARENA_CACHE_LINE_SIZE + size + ARENA_HUGE_PAGE_SIZE - 1) / ARENA_HUGE_PAGE_SIZE * ARENA_HUGE_PAGE_SIZE;
+    void* mapping = mmap(NULL, chunkSize + ARENA_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    uintptr_t const mapped  = (uintptr_t) mapping;
+    uintptr_t const aligned = (mapped + ARENA_HUGE_PAGE_SIZE - 1) & ~(ARENA_HUGE_PAGE_SIZE - 1);
+    if (aligned != mapped) {
+        munmap(mapping, aligned - mapped);
+    }
+    munmap((void*) (aligned + chunkSize), mapped + ARENA_HUGE_PAGE_SIZE - aligned);
+    uint8_t* chunk = (uint8_t*) aligned;
+
+    // Both only hints, and nothing's been touched yet so they apply to every page. mbind without libnuma: the kernel
+    // only looks at maxnode - 1 bits of the mask, and a preferred node isn't an error when it's full.
+    madvise(chunk, chunkSize, MADV_HUGEPAGE);
+    if (arena->node >= 0 && arena->node < ARENA_MAX_NODES) {
+        unsigned long nodes[ARENA_MAX_NODES / 64] = {};
+        nodes[arena->node / 64]                   = 1ul << (arena->node % 64);
+        syscall(SYS_mbind, chunk, chunkSize, MPOL_PREFERRED, nodes, ARENA_MAX_NODES + 1, 0);
+    }
+
+    *(uint8_t**) chunk                    = arena->chunk;
+    *(size_t*) (chunk + sizeof(uint8_t*)) = arena->size;
+    arena->chunk                          = chunk;
+    arena->size                           = chunkSize;
+    arena->used                           = ARENA_CACHE_LINE_SIZE + size;
+    return chunk + ARENA_CACHE_LINE_SIZE;
+}
+
+void arenaFree(Arena* arena) {
+    while (arena->chunk) {
+        uint8_t* previous         = *(uint8_t**) arena->chunk;
+        size_t const previousSize = *(size_t*) (arena->chunk + sizeof(uint8_t*));
+        munmap(arena->chunk, arena->size);
+        arena->chunk = previous;
+        arena->size  = previousSize;
+    }
+}
+
+// Snapshots for the CPU path. The registers and memory image every run starts from are captured once, and every store
+// marks the 64-byte chunk(s) it lands in. Resetting an instance for the next input then only copies back the chunks the
+// last run wrote to, instead of the whole image. Most subjects touch a few hundred bytes of stack and that's it.
+uint32_t const SNAPSHOT_CHUNK_SHIFT = 6;
+uint32_t const SNAPSHOT_CHUNK_SIZE  = 1u << SNAPSHOT_CHUNK_SHIFT;
+
+typedef struct Snapshot {
+    State state;         // What every run starts from
+    uint8_t* memory;     // Clean image of one instance's memory
+    uint32_t memorySize; // Per instance, a multiple of SNAPSHOT_CHUNK_SIZE
+    uint32_t instanceCount;
+    uint32_t dirtyWords; // Length of each instance's dirty bitmap, in 64-bit words
+    uint64_t* dirty;     // One bit per chunk, instanceCount bitmaps back to back
+} Snapshot;
+
+// Copies state and one instance's worth of memory, into arena. Returns nonzero if allocating fails.
+int snapshotCreate(Snapshot* snapshot, Arena* arena, State const* state, uint8_t const* memory, uint32_t memorySize,
+                   uint32_t instanceCount) {
+    snapshot->state         = *state;
+    snapshot->memorySize    = memorySize;
+    snapshot->instanceCount = instanceCount;
+    snapshot->dirtyWords    = ((memorySize >> SNAPSHOT_CHUNK_SHIFT) + 63) / 64;
+    snapshot->memory        = (uint8_t*) arenaAllocate(arena, memorySize);
+    snapshot->dirty         = (uint64_t*) arenaAllocate(arena, snapshot->dirtyWords * instanceCount * sizeof(uint64_t));
+    if (!snapshot->memory || !snapshot->dirty) {
+        printf("Failed to allocate the snapshot.\n");
+        return 1;
+    }
+    memcpy(snapshot->memory, memory, memorySize);
+    return 0;
+}
+
+// dirty is the bitmap of the instance being written to. Anything outside of the instance's memory is ignored, that's
+// not ours to restore.
+inline void snapshotMarkDirty(uint64_t* dirty, uint32_t address, uint32_t width, uint32_t memorySize) {
+    if (address >= memorySize || width > memorySize - address) {
+        return;
+    }
+    uint32_t const last = (address + width - 1) >> SNAPSHOT_CHUNK_SHIFT;
+    for (uint32_t chunk = address >> SNAPSHOT_CHUNK_SHIFT; chunk <= last; chunk++) {
+        dirty[chunk / 64] |= 1ull << (chunk % 64);
+    }
+}
+
+// Bounds checks a store of (extra + 1) bytes and marks the chunk(s) it lands in dirty. Returns NULL and sets the error
+// code, before anything is written, if the store would land outside of the instance's memory, the arena keeps the
+// snapshot and coverage maps right after it.
+inline uint8_t* classicalStoreAddress(uint32_t memOffset, uint32_t extra, uint8_t* memory, uint32_t memorySize,
+                                      uint64_t* dirtyChunks, uint32_t* errorCode) {
+    if (memOffset >= memorySize || extra >= memorySize - memOffset) {
+        *errorCode = -2;
+        return NULL;
+    }
+    snapshotMarkDirty(dirtyChunks, memOffset, extra + 1, memorySize);
+    return memory + memOffset;
+}
+
+// Puts back every chunk instance has dirtied since the last restore and clears its bitmap. instanceMemory is that
+// instance's memory. Returns the number of bytes copied.
+uint32_t snapshotRestore(Snapshot* snapshot, uint32_t instance, uint8_t* instanceMemory) {
+    uint64_t* dirty = snapshot->dirty + (instance * snapshot->dirtyWords);
+    uint32_t copied = 0;
+    for (uint32_t word = 0; word < snapshot->dirtyWords; word++) {
+        uint64_t bits = dirty[word];
+        while (bits) {
+            uint32_t const offset = ((word * 64) + __builtin_ctzll(bits)) << SNAPSHOT_CHUNK_SHIFT;
+            memcpy(instanceMemory + offset, snapshot->memory + offset, SNAPSHOT_CHUNK_SIZE);
+            copied += SNAPSHOT_CHUNK_SIZE;
+            bits &= bits - 1;
         }
-        case 0x67: // jalr
-        {
-            // This wants us to use a temporary in case the destination register and source register are the same
-            uint32_t rs1  = (inst >> 15) & 0x1f;
-            uint32_t temp = state->pc + 4;
-            // Oh yeah we have to sign this one again, but bits are nicer, [11:0], so 31 -> 11 == 20
-            uint32_t imm = (inst >> 20);
-            if (inst & (1 << 31)) {
-                imm |= 0xfffff000;
-            }
-            state->pc    = (state->x[rs1] + (int32_t) imm) & ~1;
-            state->x[rd] = temp;
-            break;
+        dirty[word] = 0;
+    }
+    return copied;
+}
+
+// Coverage for the CPU path. Every process has a trace map of its own that the run in progress counts its edges in, so
+// the hot loop doesn't share a cache line with anybody. After each run, coverageMerge() folds it into the process'
+// virgin map, where a bit is cleared for every (edge, hit count bucket) some run has seen. The processes swap what
+// changed in theirs every now and then, see syncExchange(), and the virgin maps are and-ed together at the end.
+typedef struct Coverage {
+    uint8_t* trace;     // Hit counts of the run in progress, zeroed again by coverageMerge()
+    uint8_t* virgin;    // All ones to start with
+    uint64_t* changed;  // A bit for every virgin byte that changed since the last sync
+    uint64_t newEdges;  // Runs that hit an edge no run before them did
+    uint64_t newCounts; // Runs that only hit a known edge a new number of times
+    uint64_t path;      // Hash of the last run's bucketed hit counts, runs down the same path have the same one
+} Coverage;
+
+// AFL's hit count buckets, one bit for each of 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and 128+ hits. A loop running 5 times
+// instead of 4 isn't news, running 8 times is.
+uint8_t coverageBuckets[256];
+
+// The maps go in arena. Returns nonzero if allocating fails.
+int coverageCreate(Coverage* coverage, Arena* arena) {
+    coverage->trace     = (uint8_t*) arenaAllocate(arena, COVERAGE_MAP_SIZE);
+    coverage->virgin    = (uint8_t*) arenaAllocate(arena, COVERAGE_MAP_SIZE);
+    coverage->changed   = (uint64_t*) arenaAllocate(arena, COVERAGE_MAP_SIZE / 64 * sizeof(uint64_t));
+    coverage->newEdges  = 0;
+    coverage->newCounts = 0;
+    coverage->path      = 0;
+    if (!coverage->trace || !coverage->virgin || !coverage->changed) {
+        printf("Failed to allocate the coverage maps.\n");
+        return 1;
+    }
+    memset(coverage->virgin, 0xff, COVERAGE_MAP_SIZE);
+
+    uint8_t const limits[8] = {1, 2, 3, 7, 15, 31, 127, 255};
+    coverageBuckets[0]      = 0;
+    for (uint32_t count = 1, bucket = 0; count < 256; count++) {
+        if (count > limits[bucket]) {
+            bucket++;
         }
-        case 0x63: // beq, bne, blt, bge, bltu, bgeu
-        {
-            uint32_t rs1 = (inst >> 15) & 0x1f;
-            uint32_t rs2 = (inst >> 20) & 0x1f;
-            // The immediate for jump offset is cursed again, high bits are [12|10:5] and then rd has [4:1|11]
-            // 31 -> 12 == 19, 30 -> 10 == 20, 4 -> 4 == 0, 0 -> 11 == -11
-            // we have to sign extend again as well
-            uint32_t imm = ((inst & (1 << 31)) >> 19) | ((inst & 0x7e000000) >> 20) | (rd & 0x1e) | ((rd & 0x1) << 11);
-            if (inst & (1 << 31)) {
-                imm |= 0xffffe000;
-            }
-            // funct3 (bits 14:12) determines which of the comparisons to do
-            int32_t takeBranch = 0;
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // beq
-                {
-                    if (state->x[rs1] == state->x[rs2]) {
-                        takeBranch = 1;
-                    }
-                    break;
-                }
-                case 0x1: // bne
-                {
-                    if (state->x[rs1] != state->x[rs2]) {
-                        takeBranch = 1;
-                    }
-                    break;
-                }
-                case 0x4: // blt (this is signed)
-                {
-                    if ((int32_t) state->x[rs1] < (int32_t) state->x[rs2]) {
-                        takeBranch = 1;
-                    }
-                    break;
-                }
-                case 0x5: // bge (this is signed)
-                {
-                    if ((int32_t) state->x[rs1] >= (int32_t) state->x[rs2]) {
-                        takeBranch = 1;
-                    }
-                    break;
-                }
-                case 0x6: // bltu (this is unsigned)
-                {
-                    if ((uint32_t) state->x[rs1] < (uint32_t) state->x[rs2]) {
-                        takeBranch = 1;
-                    }
-                    break;
+        coverageBuckets[count] = 1u << bucket;
+    }
+    return 0;
+}
+
+// Counts the edge from the last place the run jumped from to the micro-op at index. Hit counts wrap, like AFL's do.
+inline void coverageEdge(uint8_t* trace, uint32_t* previousLocation, uint32_t index) {
+    uint32_t const location = coverageLocation(index * 4);
+    trace[location ^ *previousLocation]++;
+    *previousLocation = location >> 1;
+}
+
+// Adds 8 bytes of bucketed hit counts at offset in the map to a path hash. Words of zeros are left out.
+inline uint64_t coveragePathMix(uint64_t path, uint32_t offset, uint8_t const* trace) {
+    uint64_t word;
+    memcpy(&word, trace + offset, 8);
+    return word ? ((path ^ offset) * 0x100000001b3ull ^ word) * 0x9e3779b97f4a7c15ull : path;
+}
+
+// Buckets the hit counts of the last run, folds them into the virgin map and clears the trace map for the next one.
+// Returns 2 if the run hit a new edge, 1 if it only hit one a new number of times, 0 if there was nothing new. A run
+// only touches a few hundred of the map's bytes, so 16 of them are looked at (and skipped) at once.
+int coverageMerge(Coverage* coverage) {
+    uint8_t* trace  = coverage->trace;
+    uint8_t* virgin = coverage->virgin;
+    uint64_t path   = 0;
+    int result      = 0;
+
+#if defined(__SSE2__)
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const ones = _mm_set1_epi8((char) 0xff);
+    for (uint32_t i = 0; i < COVERAGE_MAP_SIZE; i += 16) {
+        __m128i hits = _mm_load_si128((__m128i const*) (trace + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(hits, zero)) == 0xffff) {
+            continue;
+        }
+        for (uint32_t j = i; j < i + 16; j++) {
+            trace[j] = coverageBuckets[trace[j]];
+        }
+        hits = _mm_load_si128((__m128i const*) (trace + i));
+        path = coveragePathMix(coveragePathMix(path, i, trace), i + 8, trace);
+
+        __m128i const untouched = _mm_load_si128((__m128i const*) (virgin + i));
+        int const fresh         = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(hits, untouched), zero)) & 0xffff;
+        if (fresh) {
+            // Something new. A brand new edge is one whose virgin byte is still all ones.
+            int const hit    = ~_mm_movemask_epi8(_mm_cmpeq_epi8(hits, zero)) & 0xffff;
+            int const unseen = _mm_movemask_epi8(_mm_cmpeq_epi8(untouched, ones));
+            result           = (hit & unseen) ? 2 : (result > 1 ? result : 1);
+            _mm_store_si128((__m128i*) (virgin + i), _mm_andnot_si128(hits, untouched));
+            coverage->changed[i / 64] |= (uint64_t) fresh << (i % 64);
+        }
+        _mm_store_si128((__m128i*) (trace + i), zero);
+    }
+#else
+    // Same thing, 8 bytes at a time
+    for (uint32_t i = 0; i < COVERAGE_MAP_SIZE; i += 8) {
+        uint64_t hits;
+        memcpy(&hits, trace + i, 8);
+        if (!hits) {
+            continue;
+        }
+        for (uint32_t j = i; j < i + 8; j++) {
+            trace[j] = coverageBuckets[trace[j]];
+        }
+        memcpy(&hits, trace + i, 8);
+        path = coveragePathMix(path, i, trace);
+
+        uint64_t untouched;
+        memcpy(&untouched, virgin + i, 8);
+        if (hits & untouched) {
+            for (uint32_t j = 0; j < 8; j++) {
+                if (((hits >> (j * 8)) & 0xff) && ((untouched >> (j * 8)) & 0xff) == 0xff) {
+                    result = 2;
                 }
-                case 0x7: // bgeu (this is unsigned)
-                {
-                    if ((uint32_t) state->x[rs1] >= (uint32_t) state->x[rs2]) {
-                        takeBranch = 1;
-                    }
-                    break;
+                if ((hits & untouched) >> (j * 8) & 0xff) {
+                    coverage->changed[(i + j) / 64] |= 1ull << ((i + j) % 64);
                 }
-                    // TODO: handle if it isn't one of these? Set trap maybe?
-            }
-            if (takeBranch) {
-                atomicInc(&(branchResults[state->pc >> 2].hasBeenTaken), 9999999);
-                // atomicCAS(&(branchResults[state->pc >> 2].hasBeenTaken), (uint32_t)0, (uint32_t)1);
-                state->pc += (int32_t) imm;
-            } else {
-                atomicInc(&(branchResults[state->pc >> 2].hasBeenSkipped), 9999999);
-                // atomicCAS(&(branchResults[state->pc >> 2].hasBeenSkipped), (uint32_t)0, (uint32_t)1);
-                state->pc += 4;
             }
+            result    = result > 1 ? result : 1;
+            untouched = untouched & ~hits;
+            memcpy(virgin + i, &untouched, 8);
+        }
+        memset(trace + i, 0, 8);
+    }
+#endif
 
-            break;
+    coverage->path = path;
+    if (result == 2) {
+        coverage->newEdges++;
+    } else if (result == 1) {
+        coverage->newCounts++;
+    }
+    return result;
+}
+
+// Map entries some run has hit
+uint32_t coverageEdgeCount(Coverage const* coverage) {
+    uint32_t edges = 0;
+    for (uint32_t i = 0; i < COVERAGE_MAP_SIZE; i++) {
+        edges += coverage->virgin[i] != 0xff;
+    }
+    return edges;
+}
+
+// The CPU processes' inputs (what goes in argv[1]). An input that makes coverageMerge() find something is kept as a
+// seed, and everything else that gets run is a seed with a few mutations. The queue is gone through in order, and each
+// seed gets as many children in a row as the power schedule gives it, see corpusEnergy().
+uint32_t const CORPUS_MAX_INPUT  = 32;
+uint32_t const CORPUS_MAX_ENERGY = 1024;
+uint32_t const CORPUS_PATH_SLOTS = 1u << 16; // Has to be a power of two
+
+typedef struct Seed {
+    uint8_t data[CORPUS_MAX_INPUT];
+    uint32_t length;
+    uint32_t instructions; // What it took to run, cheap seeds get more children
+    uint64_t path;         // Coverage::path of its run
+    uint32_t chosen;       // Times the queue got to it
+} Seed;
+
+typedef struct Corpus {
+    Seed* seeds;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t current;           // Seed the last input came from
+    uint32_t energyLeft;        // Children it still gets
+    uint64_t totalInstructions; // Over every seed, for the average
+
+    // How many runs went down each path, open addressing on Coverage::path (0 is an empty slot). Paths nobody else
+    // takes are the rare ones.
+    uint64_t* pathKeys;
+    uint32_t* pathRuns;
+    uint32_t paths;
+} Corpus;
+
+// Returns nonzero if allocating fails
+int corpusCreate(Corpus* corpus) {
+    corpus->seeds             = NULL;
+    corpus->count             = 0;
+    corpus->capacity          = 0;
+    corpus->current           = 0;
+    corpus->energyLeft        = 0;
+    corpus->totalInstructions = 0;
+    corpus->pathKeys          = (uint64_t*) calloc(CORPUS_PATH_SLOTS, sizeof(uint64_t));
+    corpus->pathRuns          = (uint32_t*) calloc(CORPUS_PATH_SLOTS, sizeof(uint32_t));
+    corpus->paths             = 0;
+    if (!corpus->pathKeys || !corpus->pathRuns) {
+        printf("Failed to allocate the corpus.\n");
+        return 1;
+    }
+    return 0;
+}
+
+void corpusFree(Corpus* corpus) {
+    free(corpus->seeds);
+    free(corpus->pathKeys);
+    free(corpus->pathRuns);
+}
+
+// Slot of path in the path table, or of the empty slot where it would go. UINT32_MAX if it's not there and the table is
+// too full to take it, those all count as one rare path.
+uint32_t corpusPathSlot(Corpus const* corpus, uint64_t path) {
+    path |= path == 0; // 0 marks empty slots, and is also what a run without a single edge hashes to
+    for (uint32_t i = (uint32_t) path & (CORPUS_PATH_SLOTS - 1);; i = (i + 1) & (CORPUS_PATH_SLOTS - 1)) {
+        if (corpus->pathKeys[i] == path) {
+            return i;
         }
-        case 0x03: // lb, lh, lw, lbu, lhu
-        {
-            uint32_t rs1 = (inst >> 15) & 0x1f;
-            // Same format as jalr
-            uint32_t imm = (inst >> 20);
-            if (inst & (1 << 31)) {
-                imm |= 0xfffff000;
-                // printf("sign extended, %u, %d\n", imm, (int32_t)imm);
-            }
-            // funct3 again
-            uint32_t memOffset = (state->x[rs1] + (int32_t) imm);
+        if (corpus->pathKeys[i] == 0) {
+            return corpus->paths < CORPUS_PATH_SLOTS / 2 ? i : UINT32_MAX;
+        }
+    }
+}
 
-            uint32_t funct3 = (inst >> 12) & 0x7;
-            uint32_t extra  = 0;
-            switch (funct3) {
-                case 0x0: {
-                    extra = 0;
-                    break;
-                }
-                case 0x1: {
-                    extra = 1;
-                    break;
-                }
-                case 0x2: {
-                    extra = 3;
-                    break;
-                }
-                case 0x4: {
-                    extra = 0;
-                    break;
+// Counts a run down path
+void corpusRecordRun(Corpus* corpus, uint64_t path) {
+    uint32_t const slot = corpusPathSlot(corpus, path);
+    if (slot == UINT32_MAX) {
+        return;
+    }
+    if (corpus->pathKeys[slot] == 0) {
+        corpus->pathKeys[slot] = path | (path == 0);
+        corpus->paths++;
+    }
+    corpus->pathRuns[slot]++;
+}
+
+// Keeps an input that found something. Returns nonzero if allocating fails.
+int corpusAdd(Corpus* corpus, uint8_t const* data, uint32_t length, uint32_t instructions, uint64_t path) {
+    if (corpus->count == corpus->capacity) {
+        uint32_t const capacity = corpus->capacity ? corpus->capacity * 2 : 64;
+        Seed* seeds             = (Seed*) realloc(corpus->seeds, capacity * sizeof(Seed));
+        if (!seeds) {
+            printf("Failed to grow the corpus.\n");
+            return 1;
+        }
+        corpus->seeds    = seeds;
+        corpus->capacity = capacity;
+    }
+
+    Seed* seed = corpus->seeds + corpus->count++;
+    memset(seed->data, 0, CORPUS_MAX_INPUT);
+    memcpy(seed->data, data, length);
+    seed->length       = length;
+    seed->instructions = instructions;
+    seed->path         = path;
+    seed->chosen       = 0;
+    corpus->totalInstructions += instructions;
+    return 0;
+}
+
+// How many children a seed gets when the queue gets to it. It's AFLFast's FAST schedule with AFL's speed bonus on top:
+// double every time the seed comes around again, divided by how many runs its path has had (so seeds on paths everyone
+// takes get next to nothing, and ones on rare paths get plenty), and times two or half for seeds that run in half or
+// twice the average time.
+uint32_t corpusEnergy(Corpus const* corpus, Seed const* seed) {
+    uint64_t const average = corpus->totalInstructions / corpus->count;
+    uint32_t const slot    = corpusPathSlot(corpus, seed->path);
+    uint64_t const runs    = (slot == UINT32_MAX || corpus->pathRuns[slot] == 0) ? 1 : corpus->pathRuns[slot];
+
+    uint64_t energy = 32ull << (seed->chosen < 16 ? seed->chosen : 16);
+    if (seed->instructions * 2 <= average) {
+        energy *= 2;
+    } else if (seed->instructions >= average * 2) {
+        energy /= 2;
+    }
+    energy /= runs;
+    return energy < 1 ? 1 : (energy > CORPUS_MAX_ENERGY ? CORPUS_MAX_ENERGY : (uint32_t) energy);
+}
+
+// The seed the next input should come from, moving on down the queue once the current one is out of energy
+Seed* corpusNext(Corpus* corpus) {
+    if (corpus->energyLeft == 0) {
+        corpus->current    = (corpus->current + 1) % corpus->count;
+        Seed* seed         = corpus->seeds + corpus->current;
+        corpus->energyLeft = corpusEnergy(corpus, seed);
+        seed->chosen++;
+    }
+    corpus->energyLeft--;
+    return corpus->seeds + corpus->current;
+}
+
+// splitmix64, the same generator the fuzzer's LaneRandom starts its streams from. One call gives four numbers through
+// corpusTake(), where rand() takes a lock and a division for every one.
+inline uint64_t corpusRandom(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z          = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// A number below n (at most 65536) out of the low 16 bits of *bits, which are shifted out. A multiply, not a modulo.
+inline uint32_t corpusTake(uint64_t* bits, uint32_t n) {
+    uint32_t const field = (uint32_t) (((*bits & 0xffff) * n) >> 16);
+    *bits >>= 16;
+    return field;
+}
+
+// A character from what the subjects see on their command line, which is mostly letters. Takes two numbers from *bits.
+inline uint8_t corpusRandomCharacter(uint64_t* bits) {
+    uint32_t const letter = corpusTake(bits, 4);
+    uint32_t const value  = corpusTake(bits, letter ? 26 : 255);
+    return letter ? value + 'a' : value + 1;
+}
+
+// Writes a child of seed to out (room for maxLength bytes, which is at most CORPUS_MAX_INPUT) and returns its length.
+// Stacks a few of AFL's havoc mutations, with random numbers from corpusRandom(random). Inputs are strings, so no zero
+// bytes.
+uint32_t corpusMutate(Corpus const* corpus, Seed const* seed, uint8_t* out, uint32_t maxLength, uint64_t* random) {
+    uint32_t length = seed->length < maxLength ? seed->length : maxLength;
+    memcpy(out, seed->data, length);
+
+    uint64_t bits = corpusRandom(random);
+    for (int mutations = 1 << corpusTake(&bits, 3); mutations > 0; mutations--) {
+        // Every mutation takes at most four numbers from one call: where, what, and two for the value
+        bits                    = corpusRandom(random);
+        uint32_t const position = length ? corpusTake(&bits, length) : 0;
+        switch (length ? corpusTake(&bits, 6) : 4) {
+            case 0: { // Replace a character
+                out[position] = corpusRandomCharacter(&bits);
+                break;
+            }
+            case 1: { // Flip a bit
+                uint8_t const flipped = out[position] ^ (1u << corpusTake(&bits, 8));
+                out[position]         = flipped ? flipped : out[position];
+                break;
+            }
+            case 2: { // Add or subtract a little
+                uint8_t const changed = out[position] + corpusTake(&bits, 8) - 4;
+                out[position]         = changed ? changed : out[position];
+                break;
+            }
+            case 3: { // Cut it short
+                length = position;
+                break;
+            }
+            case 4: { // Make it longer
+                if (length < maxLength) {
+                    out[length++] = corpusRandomCharacter(&bits);
                 }
-                case 0x5: {
-                    extra = 1;
-                    break;
+                break;
+            }
+            default: { // Splice in a piece of another seed, at the same place
+                Seed const* other = corpus->seeds + (uint32_t) (((corpusRandom(random) >> 32) * corpus->count) >> 32);
+                for (uint32_t i = position; i < other->length && i < maxLength && i < position + 4; i++) {
+                    out[i] = other->data[i];
+                    length = i + 1 > length ? i + 1 : length;
                 }
+                break;
             }
+        }
+    }
+    return length;
+}
 
-            // printf("memOffset, extra, %u, %u\n", memOffset, extra);
-            // printf("reg value %u\n", state->x[rs1]);
+// CmpLog: the operands of the conditional branches a run went through, for the input-to-state stage. Only the extra run
+// every new seed gets logs them, and only the pairs that differed (equal ones don't say anything about the input).
+uint32_t const CMPLOG_MAX_ENTRIES    = 256;
+uint32_t const CMPLOG_MAX_CANDIDATES = 64;
+
+typedef struct CmpLog {
+    uint32_t count;
+    uint32_t left[CMPLOG_MAX_ENTRIES];
+    uint32_t right[CMPLOG_MAX_ENTRIES];
+} CmpLog;
+
+// Inputs the input-to-state stage came up with, run before going back to mutating seeds
+typedef struct InputToState {
+    uint8_t candidates[CMPLOG_MAX_CANDIDATES][CORPUS_MAX_INPUT];
+    uint32_t lengths[CMPLOG_MAX_CANDIDATES];
+    uint32_t count;
+    uint32_t next; // Next one to run
+} InputToState;
+
+inline void cmplogRecord(CmpLog* log, uint32_t left, uint32_t right) {
+    if (left != right && log->count < CMPLOG_MAX_ENTRIES) {
+        log->left[log->count]  = left;
+        log->right[log->count] = right;
+        log->count++;
+    }
+}
 
-            if (memOffset + extra >= memorySize) {
-                state->x[0] = -2;
-                return -2;
-            }
-            uint8_t* basePtr = memory;
-            if (memOffset < programSize) {
-                if (memOffset + extra >= programSize) {
-                    state->x[0] = -1;
-                    return -1;
+// Smallest of 1, 2 and 4 bytes a register value fits in, sign-extended ones (from lb, lh) included
+inline uint32_t cmplogWidth(uint32_t value) {
+    if (value < 0x100 || (int32_t) value == (int8_t) value) {
+        return 1;
+    }
+    return (value < 0x10000 || (int32_t) value == (int16_t) value) ? 2 : 4;
+}
+
+// Input-to-state (Redqueen, AFL++'s CmpLog stage). Strings are mostly checked by comparing bytes straight out of the
+// input against constants, so wherever input has one side of a logged comparison, a copy with the other side there is
+// a good bet to get one check further. Looked for as bytes or little-endian 16/32-bit words, whichever is the smallest
+// both sides fit in. The terminator counts too, that's how inputs that are too short get longer.
+//
+// Replaces whatever is still in the queue. A new seed got further than the one before it, and there are plenty of
+// candidates for every seed (every byte that happens to match), so the old ones would mostly be in the way.
+void cmplogInputToState(CmpLog const* log, uint8_t const* input, uint32_t length, uint32_t maxLength,
+                        InputToState* queue) {
+    queue->next  = 0;
+    queue->count = 0;
+
+    uint32_t const searched = length < maxLength ? length + 1 : maxLength;
+    for (uint32_t i = 0; i < log->count; i++) {
+        uint32_t const width = cmplogWidth(log->left[i]) > cmplogWidth(log->right[i]) ? cmplogWidth(log->left[i])
+                                                                                       : cmplogWidth(log->right[i]);
+        for (int side = 0; side < 2; side++) {
+            uint32_t const from = side ? log->right[i] : log->left[i];
+            uint32_t const to   = side ? log->left[i] : log->right[i];
+            for (uint32_t at = 0; at + width <= searched; at++) {
+                if (memcmp(input + at, &from, width) != 0) {
+                    continue;
+                }
+                if (queue->count == CMPLOG_MAX_CANDIDATES) {
+                    return;
+                }
+
+                uint8_t* candidate = queue->candidates[queue->count];
+                memset(candidate, 0, CORPUS_MAX_INPUT);
+                memcpy(candidate, input, length);
+                memcpy(candidate + at, &to, width);
+                uint32_t const candidateLength = strnlen((char*) candidate, maxLength);
+
+                int duplicate = candidateLength == length && memcmp(candidate, input, length) == 0;
+                for (uint32_t j = 0; j < queue->count && !duplicate; j++) {
+                    duplicate = queue->lengths[j] == candidateLength &&
+                                memcmp(queue->candidates[j], candidate, candidateLength) == 0;
+                }
+                if (!duplicate) {
+                    queue->lengths[queue->count++] = candidateLength;
                 }
-                basePtr = program;
             }
+        }
+    }
+}
 
-            switch (funct3) {
-                case 0x0: // lb
-                {
-                    uint8_t loaded = *(uint8_t*) (basePtr + memOffset);
-                    state->x[rd]   = (loaded & (1 << 7)) ? loaded | 0xffffff00 : loaded;
-                    break;
-                }
-                case 0x1: // lh
-                {
-                    uint16_t loaded = *(uint16_t*) (basePtr + memOffset);
-                    state->x[rd]    = (loaded & (1 << 15)) ? loaded | 0xffff0000 : loaded;
-                    break;
-                }
-                case 0x2: // lw
-                {
-                    state->x[rd] = *(uint32_t*) (basePtr + memOffset);
-                    break;
-                }
-                case 0x4: // lbu
-                {
-                    uint8_t loaded = *(uint8_t*) (basePtr + memOffset);
-                    state->x[rd]   = loaded & 0x000000ff;
-                    break;
-                }
-                case 0x5: // lhu
-                {
-                    uint16_t loaded = *(uint16_t*) (basePtr + memOffset);
-                    state->x[rd]    = loaded & 0x0000ffff;
-                    break;
-                }
-                    // TODO: handle if it isn't one of these? Set trap maybe?
+// What the CPU path gives a subject around it, for ecall. stdin is the fuzz input, stdout and stderr go to output, and
+// brk hands out the memory between the subject's data and its stack.
+uint32_t const GUEST_OUTPUT_LIMIT = 4096;
+
+typedef struct GuestIO {
+    uint8_t const* input;
+    uint32_t inputLength;
+    uint32_t inputPosition;
+    uint32_t heapStart; // Right after the subject's data, where the break starts out
+    uint32_t programBreak;
+    uint32_t outputLength; // What didn't fit in output is dropped (the subject is still told it was written)
+    uint8_t output[GUEST_OUTPUT_LIMIT];
+} GuestIO;
+
+// Gets io ready for a run with input as stdin: nothing written yet and an empty heap
+void guestReset(GuestIO* io, uint8_t const* input, uint32_t inputLength) {
+    io->input         = input;
+    io->inputLength   = inputLength;
+    io->inputPosition = 0;
+    io->programBreak  = io->heapStart;
+    io->outputLength  = 0;
+}
+
+// Where length bytes of guest memory at address are, for a system call to read (or write, which the program image
+// can't be). NULL if they aren't all in guest memory, or straddle the end of the program image.
+uint8_t* guestBuffer(uint32_t address, uint32_t length, int write, uint8_t* memory, uint8_t* program,
+                     uint32_t memorySize, uint32_t programSize) {
+    if (address >= memorySize || length > memorySize - address) {
+        return NULL;
+    }
+    if (address < programSize) {
+        return write || length > programSize - address ? NULL : program + address;
+    }
+    return memory + address;
+}
+
+// Does the ecall a run in state is at: the number in a7, arguments in a0-a2, and the result (or a negative errno) back
+// in a0. Anything written to memory is marked in dirtyChunks. The clock counts instructions, a nanosecond each, so a
+// run only depends on its input. Returns nonzero if the subject exited, with its status in a0.
+int classicalSystemCall(State* state, uint8_t* memory, uint8_t* program, uint32_t memorySize, uint32_t programSize,
+                        uint64_t* dirtyChunks, GuestIO* io, uint64_t instructions) {
+    uint32_t* x       = state->x;
+    uint32_t const a0 = x[10];
+    uint32_t const a1 = x[11];
+    uint32_t const a2 = x[12];
+
+    switch (x[17]) {
+        case SYSCALL_READ: {
+            uint32_t const left   = io->inputLength - io->inputPosition;
+            uint32_t const length = a2 < left ? a2 : left;
+            uint8_t* buffer       = guestBuffer(a1, length, 1, memory, program, memorySize, programSize);
+            if (a0 != 0) {
+                x[10] = (uint32_t) -EBADF;
+            } else if (!buffer) {
+                x[10] = (uint32_t) -EFAULT;
+            } else {
+                memcpy(buffer, io->input + io->inputPosition, length);
+                snapshotMarkDirty(dirtyChunks, a1, length, memorySize);
+                io->inputPosition += length;
+                x[10] = length;
             }
-            state->pc += 4;
-            break;
+            return 0;
         }
-        case 0x23: // sb, sh, sw
-        {
-            // In this one, we reuse rs1 as the memory location (well plus the immediate offset) and we use rs2 as the
-            // source This means the immediate is split up again
-            uint32_t rs1 = (inst >> 15) & 0x1f;
-            uint32_t rs2 = (inst >> 20) & 0x1f;
-            uint32_t imm = ((inst & 0xfe000000) >> 20) | rd;
-            if (inst & (1 << 31)) {
-                imm |= 0xfffff000;
+        case SYSCALL_WRITE: {
+            uint8_t const* buffer = guestBuffer(a1, a2, 0, memory, program, memorySize, programSize);
+            if (a0 != 1 && a0 != 2) {
+                x[10] = (uint32_t) -EBADF;
+            } else if (!buffer) {
+                x[10] = (uint32_t) -EFAULT;
+            } else {
+                uint32_t const room   = GUEST_OUTPUT_LIMIT - io->outputLength;
+                uint32_t const length = a2 < room ? a2 : room;
+                memcpy(io->output + io->outputLength, buffer, length);
+                io->outputLength += length;
+                x[10] = a2;
             }
+            return 0;
+        }
+        case SYSCALL_EXIT:
+        case SYSCALL_EXIT_GROUP: {
+            return 1;
+        }
+        case SYSCALL_CLOCK_GETTIME:
+        case SYSCALL_CLOCK_GETTIME64:
+        case SYSCALL_GETTIMEOFDAY: {
+            // Both structs are two 64-bit words on RV32, seconds and then nanoseconds (or microseconds)
+            uint32_t const out    = x[17] == SYSCALL_GETTIMEOFDAY ? a0 : a1;
+            uint64_t const time[] = {instructions / 1000000000,
+                                     instructions % 1000000000 / (x[17] == SYSCALL_GETTIMEOFDAY ? 1000 : 1)};
+            uint8_t* buffer       = guestBuffer(out, sizeof(time), 1, memory, program, memorySize, programSize);
+            if (out != 0 && !buffer) {
+                x[10] = (uint32_t) -EFAULT;
+                return 0;
+            }
+            if (out != 0) {
+                memcpy(buffer, time, sizeof(time));
+                snapshotMarkDirty(dirtyChunks, out, sizeof(time), memorySize);
+            }
+            x[10] = 0;
+            return 0;
+        }
+        case SYSCALL_BRK: {
+            // The heap can grow up to wherever the stack is right now, anything else just asks where the break is
+            if (a0 >= io->heapStart && a0 <= x[2]) {
+                io->programBreak = a0;
+            }
+            x[10] = io->programBreak;
+            return 0;
+        }
+        default: {
+            x[10] = (uint32_t) -ENOSYS;
+            return 0;
+        }
+    }
+}
 
-            // printf("Storing value: %u to: %u\n", state->x[rs2], (uint32_t)(state->x[rs1] + (int32_t)imm));
+// Runs one instance starting from initialState. Every store is recorded in dirtyChunks (that instance's bitmap in a
+// Snapshot) so the memory can be reset cheaply afterwards, and every edge is counted in trace (a Coverage's). ecalls
+// go through io, see classicalSystemCall(). Unless cmpLog is NULL, the operands of every conditional branch go in there
+// too.
+uint64_t classicalExecuteProgram(MicroOp* ops, uint8_t* program, uint8_t* memory, uint32_t memorySize,
+                                 State const* initialState, uint32_t programSize, Result* results, uint32_t maxOps,
+                                 uint8_t* trace, uint64_t* dirtyChunks, GuestIO* io, CmpLog* cmpLog) {
+    State state                           = *initialState;
+    uint32_t const DONE_ADDRESS_CLASSICAL = 0xfffffff0;
+    uint32_t const instCount              = programSize / 4;
+    uint32_t const entry                  = state.pc;
+    uint32_t previousLocation             = 0;
 
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // sb
-                {
-                    *(uint8_t*) (memory + (uint32_t) (state->x[rs1] + (int32_t) imm)) = state->x[rs2];
-                    break;
-                }
-                case 0x1: // sh
-                {
-                    *(uint16_t*) (memory + (uint32_t) (state->x[rs1] + (int32_t) imm)) = state->x[rs2];
-                    break;
-                }
-                case 0x2: // sw
-                {
-                    *(uint32_t*) (memory + (uint32_t) (state->x[rs1] + (int32_t) imm)) = state->x[rs2];
-                    break;
-                }
-                    // TODO: handle default?
+    uint32_t* x       = state.x;
+    MicroOp const* op = ops + ((entry % 4 == 0 && entry / 4 < instCount) ? entry / 4 : instCount);
+
+    uint32_t count = 0;
+    while (count < maxOps) {
+        count++;
+
+        int32_t takeBranch = 0;
+        uint8_t* loadPtr   = NULL;
+        uint8_t* storePtr  = NULL;
+
+        // One flat switch over dense handler indices (this becomes a single jump table). Straight-line ops break out to
+        // the op++ at the bottom, everything that moves control somewhere else continues or jumps out on its own.
+        switch (op->handler) {
+            case MOP_LUI: {
+                x[op->rd] = op->imm;
+                break;
             }
-            state->pc += 4;
-            break;
-        }
-        case 0x13: // addi, slti, sltiu, xori, ori, andi, slli, srli, srai
-        {
-            uint32_t rs1 = (inst >> 15) & 0x1f;
-            uint32_t imm = (inst >> 20);
-            if (inst & (1 << 31)) {
-                imm |= 0xfffff000;
+            case MOP_JAL: {
+                x[op->rd] = op->imm;
+                x[0]      = 0; // j is jal with rd == x0
+                op        = ops + op->target;
+                coverageEdge(trace, &previousLocation, op - ops);
+                continue;
             }
-            // funct3 again
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // addi
-                {
-                    state->x[rd] = state->x[rs1] + (int32_t) imm;
-                    break;
-                }
-                case 0x2: // slti
-                {
-                    // I'm pretty sure c standard says true statements always get set to 1 but just to make
-                    // it clear
-                    state->x[rd] = ((int32_t) state->x[rs1] < (int32_t) imm) ? 1 : 0;
-                    break;
-                }
-                case 0x3: // sltiu
-                {
-                    state->x[rd] = ((uint32_t) state->x[rs1] < (uint32_t) imm) ? 1 : 0;
-                    break;
-                }
-                case 0x4: // xori
-                {
-                    state->x[rd] = state->x[rs1] ^ imm;
-                    break;
-                }
-                case 0x6: // ori
-                {
-                    state->x[rd] = state->x[rs1] | imm;
-                    break;
-                }
-                case 0x7: // andi
-                {
-                    state->x[rd] = state->x[rs1] & imm;
-                    break;
-                }
-                case 0x1: // slli
-                {
-                    // TODO: these instructions only use the lowest 5 bits of imm, and
-                    // the standard says the high bits are all 0 (or 1 of them is 1 for srai)
-                    // I assume it should be illegal operation if that's not the case?
-                    state->x[rd] = state->x[rs1] << (imm & 0x1f);
-                    break;
+            case MOP_JALR: {
+                // rd and rs1 can be the same register, so compute the destination first
+                uint32_t dest = (x[op->rs1] + op->imm) & ~1u;
+                x[op->rd]     = op->target;
+                x[0]          = 0; // ret is jalr with rd == x0
+                if (dest == DONE_ADDRESS_CLASSICAL) {
+                    goto done;
+                }
+                op = ops + ((dest % 4 == 0 && dest / 4 < instCount) ? dest / 4 : instCount);
+                coverageEdge(trace, &previousLocation, op - ops);
+                continue;
+            }
+            case MOP_BEQ: {
+                takeBranch = x[op->rs1] == x[op->rs2];
+                goto branch;
+            }
+            case MOP_BNE: {
+                takeBranch = x[op->rs1] != x[op->rs2];
+                goto branch;
+            }
+            case MOP_BLT: {
+                takeBranch = (int32_t) x[op->rs1] < (int32_t) x[op->rs2];
+                goto branch;
+            }
+            case MOP_BGE: {
+                takeBranch = (int32_t) x[op->rs1] >= (int32_t) x[op->rs2];
+                goto branch;
+            }
+            case MOP_BLTU: {
+                takeBranch = x[op->rs1] < x[op->rs2];
+                goto branch;
+            }
+            case MOP_BGEU: {
+                takeBranch = x[op->rs1] >= x[op->rs2];
+                goto branch;
+            }
+            case MOP_LB: {
+                loadPtr = classicalLoadAddress(x[op->rs1] + op->imm, 0, memory, program, memorySize, programSize, x);
+                if (!loadPtr) {
+                    goto done;
                 }
-                case 0x5: // srli, srai are differentiated by a 1 in the 30th bit
-                {
-                    uint32_t shamt = imm & 0x1f;
-                    if (inst & (1 << 30)) {
-                        state->x[rd] = (int32_t) (state->x[rs1]) >> shamt;
-                        if ((state->x[rs1] & (1 << 31)) && shamt) {
-                            // Bit shifts by 32 are undefined by c standard so we actually can't use this which is
-                            // extremely cringe because it won't work on 0 shift... so we just special case it.
-                            state->x[rd] |= ~0 << (32 - shamt);
-                        }
-                    } else {
-                        // Don't do sign extension (don't need to do anything special here)
-                        state->x[rd] = (uint32_t) (state->x[rs1]) >> shamt;
-                    }
-                    break;
+                x[op->rd] = (uint32_t) (int32_t) *(int8_t*) loadPtr;
+                break;
+            }
+            case MOP_LH: {
+                loadPtr = classicalLoadAddress(x[op->rs1] + op->imm, 1, memory, program, memorySize, programSize, x);
+                if (!loadPtr) {
+                    goto done;
                 }
+                x[op->rd] = (uint32_t) (int32_t) *(int16_t*) loadPtr;
+                break;
             }
-            state->pc += 4;
-            break;
-        }
-        case 0x33: // add, sub, sll, slt, sltu, xor, srl, sra, or, and
-        {
-            uint32_t rs1 = (inst >> 15) & 0x1f;
-            uint32_t rs2 = (inst >> 20) & 0x1f;
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // add, sub are differentiated again by funct7 (only 1 bit of it tho), inst bit 30
-                {
-                    // Oh and arithmetic overflow is ignored (aka we don't care, and you know what, just use what our
-                    // implementation does) This isn't 122
-                    if ((inst & (1 << 30)) == 0) // add
-                    {
-                        state->x[rd] = state->x[rs1] + state->x[rs2];
-                    } else // sub
-                    {
-                        state->x[rd] = state->x[rs1] - state->x[rs2];
-                    }
-                    break;
+            case MOP_LW: {
+                loadPtr = classicalLoadAddress(x[op->rs1] + op->imm, 3, memory, program, memorySize, programSize, x);
+                if (!loadPtr) {
+                    goto done;
                 }
-                case 0x1: // sll
-                {
-                    // This only cares about the lower 5 bits
-                    state->x[rd] = state->x[rs1] << (state->x[rs2] & 0x1f);
-                    break;
+                x[op->rd] = *(uint32_t*) loadPtr;
+                break;
+            }
+            case MOP_LBU: {
+                loadPtr = classicalLoadAddress(x[op->rs1] + op->imm, 0, memory, program, memorySize, programSize, x);
+                if (!loadPtr) {
+                    goto done;
                 }
-                case 0x2: // slt
-                {
-                    state->x[rd] = ((int32_t) state->x[rs1] < (int32_t) state->x[rs2]) ? 1 : 0;
-                    break;
+                x[op->rd] = *(uint8_t*) loadPtr;
+                break;
+            }
+            case MOP_LHU: {
+                loadPtr = classicalLoadAddress(x[op->rs1] + op->imm, 1, memory, program, memorySize, programSize, x);
+                if (!loadPtr) {
+                    goto done;
                 }
-                case 0x3: // sltu
-                {
-                    state->x[rd] = ((uint32_t) state->x[rs1] < (uint32_t) state->x[rs2]) ? 1 : 0;
-                    break;
+                x[op->rd] = *(uint16_t*) loadPtr;
+                break;
+            }
+            case MOP_SB: {
+                storePtr = classicalStoreAddress(x[op->rs1] + op->imm, 0, memory, memorySize, dirtyChunks, x);
+                if (!storePtr) {
+                    goto done;
                 }
-                case 0x4: // xor
-                {
-                    state->x[rd] = state->x[rs1] ^ state->x[rs2];
-                    break;
+                *(uint8_t*) storePtr = x[op->rs2];
+                break;
+            }
+            case MOP_SH: {
+                storePtr = classicalStoreAddress(x[op->rs1] + op->imm, 1, memory, memorySize, dirtyChunks, x);
+                if (!storePtr) {
+                    goto done;
                 }
-                case 0x5: // srl, sra
-                {
-                    uint32_t shamt = state->x[rs2] & 0x1f;
-                    if (inst & (1 << 30)) {
-                        state->x[rd] = (int32_t) (state->x[rs1]) >> shamt;
-                        if (state->x[rs1] & (1 << 31) && shamt) {
-                            state->x[rd] |= ~0 << (32 - shamt);
-                        }
-                    } else {
-                        state->x[rd] = (uint32_t) (state->x[rs1]) >> shamt;
-                    }
-                    break;
+                *(uint16_t*) storePtr = x[op->rs2];
+                break;
+            }
+            case MOP_SW: {
+                storePtr = classicalStoreAddress(x[op->rs1] + op->imm, 3, memory, memorySize, dirtyChunks, x);
+                if (!storePtr) {
+                    goto done;
                 }
-                case 0x6: // or
-                {
-                    state->x[rd] = state->x[rs1] | state->x[rs2];
-                    break;
+                *(uint32_t*) storePtr = x[op->rs2];
+                break;
+            }
+            case MOP_ADDI: {
+                x[op->rd] = x[op->rs1] + op->imm;
+                break;
+            }
+            case MOP_SLTI: {
+                x[op->rd] = ((int32_t) x[op->rs1] < (int32_t) op->imm) ? 1 : 0;
+                break;
+            }
+            case MOP_SLTIU: {
+                x[op->rd] = (x[op->rs1] < op->imm) ? 1 : 0;
+                break;
+            }
+            case MOP_XORI: {
+                x[op->rd] = x[op->rs1] ^ op->imm;
+                break;
+            }
+            case MOP_ORI: {
+                x[op->rd] = x[op->rs1] | op->imm;
+                break;
+            }
+            case MOP_ANDI: {
+                x[op->rd] = x[op->rs1] & op->imm;
+                break;
+            }
+            case MOP_SLLI: {
+                // Shift amounts were already masked to 5 bits when decoding
+                x[op->rd] = x[op->rs1] << op->imm;
+                break;
+            }
+            case MOP_SRLI: {
+                x[op->rd] = x[op->rs1] >> op->imm;
+                break;
+            }
+            case MOP_SRAI: {
+                x[op->rd] = (uint32_t) ((int32_t) x[op->rs1] >> op->imm);
+                break;
+            }
+            case MOP_ADD: {
+                x[op->rd] = x[op->rs1] + x[op->rs2];
+                break;
+            }
+            case MOP_SUB: {
+                x[op->rd] = x[op->rs1] - x[op->rs2];
+                break;
+            }
+            case MOP_SLL: {
+                x[op->rd] = x[op->rs1] << (x[op->rs2] & 0x1f);
+                break;
+            }
+            case MOP_SLT: {
+                x[op->rd] = ((int32_t) x[op->rs1] < (int32_t) x[op->rs2]) ? 1 : 0;
+                break;
+            }
+            case MOP_SLTU: {
+                x[op->rd] = (x[op->rs1] < x[op->rs2]) ? 1 : 0;
+                break;
+            }
+            case MOP_XOR: {
+                x[op->rd] = x[op->rs1] ^ x[op->rs2];
+                break;
+            }
+            case MOP_SRL: {
+                x[op->rd] = x[op->rs1] >> (x[op->rs2] & 0x1f);
+                break;
+            }
+            case MOP_SRA: {
+                x[op->rd] = (uint32_t) ((int32_t) x[op->rs1] >> (x[op->rs2] & 0x1f));
+                break;
+            }
+            case MOP_OR: {
+                x[op->rd] = x[op->rs1] | x[op->rs2];
+                break;
+            }
+            case MOP_AND: {
+                x[op->rd] = x[op->rs1] & x[op->rs2];
+                break;
+            }
+            case MOP_NOP: {
+                break;
+            }
+            case MOP_ECALL: {
+                if (classicalSystemCall(&state, memory, program, memorySize, programSize, dirtyChunks, io, count)) {
+                    goto done;
                 }
-                case 0x7: // and
-                {
-                    state->x[rd] = state->x[rs1] & state->x[rs2];
-                    break;
+                break;
+            }
+            // Superinstructions, these count as the two instructions they replace
+            case MOP_LI: {
+                x[op->rd] = op->imm;
+                count++;
+                op += 2;
+                continue;
+            }
+            case MOP_CALL: {
+                x[op->rd]  = op->imm;
+                x[op->rs2] = ((op - ops) + 2) * 4; // Usually rs2 == rd == ra, so the link has to win
+                x[0]       = 0;
+                count++;
+                op = ops + op->target;
+                coverageEdge(trace, &previousLocation, op - ops);
+                continue;
+            }
+            case MOP_LBU_BEQ:
+            case MOP_LBU_BNE: {
+                loadPtr = classicalLoadAddress(x[op->rs1] + op->imm, 0, memory, program, memorySize, programSize, x);
+                if (!loadPtr) {
+                    goto done;
+                }
+                x[op->rd]  = *(uint8_t*) loadPtr;
+                takeBranch = (op->handler == MOP_LBU_BEQ) ? (x[op->rd] == x[op->rs2]) : (x[op->rd] != x[op->rs2]);
+                count++;
+                op++; // The branch bookkeeping below is for the second half
+                goto branch;
+            }
+            case MOP_ADDI_SW: {
+                x[op->rd] = x[op->rs1] + op->imm;
+
+                storePtr = classicalStoreAddress(x[op->rd] + op->target, 3, memory, memorySize, dirtyChunks, x);
+                if (!storePtr) {
+                    goto done;
                 }
+                *(uint32_t*) storePtr = x[op->rs2];
+                count++;
+                op += 2;
+                continue;
+            }
+            case MOP_LW_ADDI: {
+                loadPtr = classicalLoadAddress(x[op->rs1] + op->imm, 3, memory, program, memorySize, programSize, x);
+                if (!loadPtr) {
+                    goto done;
+                }
+                x[op->rd] = *(uint32_t*) loadPtr;
+                x[op->rs1] += op->target;
+                count++;
+                op += 2;
+                continue;
+            }
+            default: { // MOP_OUT_OF_PROGRAM
+                x[0] = ERROR_OUT_OF_PROGRAM;
+                goto done;
             }
-            state->pc += 4;
-            break;
-        }
-        case 0x0f: // fence, fence.i
-        {
-            // TODO: do something other than nop?
-            state->pc += 4;
-            break;
         }
-        case 0x73: // ecall, ebreak, csrrw, csrrs, csrrc, csrrwi, csrrsi, csrrci
-        {
-            // TODO: do something other than nop?
-            state->pc += 4;
-            break;
+        op++;
+        continue;
+
+    branch:
+        // The second half of a fused lbu + branch is still the plain branch, so this is right for those too
+        if (cmpLog) {
+            cmplogRecord(cmpLog, x[op->rs1], x[op->rs2]);
         }
+        op = takeBranch ? ops + op->target : op + 1;
+        coverageEdge(trace, &previousLocation, op - ops);
     }
 
-    // We could have written to 0, so just put it back to 0
-    if (rd == 0) {
-        state->x[rd] = 0;
-    }
+done:
+    results->returnVal = state.x[10];
+    results->errorCode = state.x[0]; // If we have an error, just write to x[0] and self destruct out of the loop
 
-    return 0;
+    return count;
 }
 
-__global__ void kernelExecuteProgram(uint8_t* program, uint8_t* globalMemory, uint32_t memorySize, int32_t argc,
-                                     uint32_t argv, uint32_t programSize, uint32_t entry, Result* globalResults,
-                                     uint32_t maxOps, BranchData* branchResults) {
-    uint32_t index = blockIdx.x * blockDim.x + threadIdx.x;
-
-    uint8_t* memory = globalMemory + (memorySize * index);
-
-    Result* myResults = globalResults + index;
-
-    State state;
-
-    for (int i = 0; i < 32; i++) {
-        state.x[i] = 0;
+// A subject, mapped read-only straight from its file and shared by every instance. Either a RISC-V ELF32 executable,
+// whose read-only PT_LOAD segments (.text, .rodata) are the program image and whose writable ones (.data, .bss) go in
+// every instance's memory, or a flat image out of subjects/makebinfile.sh, which is the program image as it is. Guest
+// address 0 is the lowest address the ELF loads anything at, so anything addressed relative to pc works out.
+typedef struct ProgramImage {
+    uint8_t* mapping; // The whole file
+    size_t mappingSize;
+    uint8_t* program; // Points into mapping, unless the segments had to be put together in owned
+    uint32_t programSize;
+    uint8_t* owned;
+
+    // ELF only
+    uint32_t base;              // ELF address of guest address 0
+    Elf32_Phdr const* segments; // NULL for flat images
+    uint32_t segmentCount;
+} ProgramImage;
+
+// Returns nonzero (having said why) if the ELF isn't one ajaxemu can run
+int programLoadElf(ProgramImage* image) {
+    Elf32_Ehdr const* header = (Elf32_Ehdr const*) image->mapping;
+    if (image->mappingSize < sizeof(Elf32_Ehdr) || header->e_ident[EI_CLASS] != ELFCLASS32 ||
+        header->e_ident[EI_DATA] != ELFDATA2LSB || header->e_machine != EM_RISCV ||
+        header->e_phentsize != sizeof(Elf32_Phdr) ||
+        header->e_phoff + (uint64_t) header->e_phnum * sizeof(Elf32_Phdr) > image->mappingSize) {
+        printf("Only little-endian 32-bit RISC-V ELF files can be run.\n");
+        return 1;
     }
-
-    state.pc = entry;
-
-    uint32_t const DONE_ADDRESS_CUDA = 0xfffffff0;
-
-    state.x[1] = DONE_ADDRESS_CUDA;
-    state.x[2] = argv;
-
-    state.x[10] = argc;
-    state.x[11] = argv;
-
-    int count = 0;
-    while (count < maxOps) {
-        uint32_t inst = *(uint32_t*) (program + state.pc);
-        // printf("executing instruction: %08x\n", inst);
-        // printf("pc = %u\n", state.pc);
-        if (executeInstruction(&state, inst, memory, program, memorySize, programSize, branchResults) ||
-            state.pc == DONE_ADDRESS_CUDA) {
-            break;
+    image->segments     = (Elf32_Phdr const*) (image->mapping + header->e_phoff);
+    image->segmentCount = header->e_phnum;
+
+    // The program image runs from the lowest address anything is loaded at to the end of the last read-only segment
+    uint64_t base = UINT32_MAX;
+    uint64_t end  = 0;
+    for (uint32_t i = 0; i < image->segmentCount; i++) {
+        Elf32_Phdr const* segment = image->segments + i;
+        if (segment->p_type != PT_LOAD) {
+            continue;
+        }
+        if (segment->p_offset + (uint64_t) segment->p_filesz > image->mappingSize ||
+            segment->p_filesz > segment->p_memsz) {
+            printf("A segment of the ELF file is cut short.\n");
+            return 1;
+        }
+        base = segment->p_vaddr < base ? segment->p_vaddr : base;
+        if (!(segment->p_flags & PF_W) && segment->p_vaddr + (uint64_t) segment->p_memsz > end) {
+            end = segment->p_vaddr + (uint64_t) segment->p_memsz;
         }
-        count++;
+    }
+    if (end == 0) {
+        printf("The ELF file doesn't load any code.\n");
+        return 1;
+    }
+    image->base        = (uint32_t) base;
+    image->programSize = (uint32_t) (end - base + 3) & ~3u;
+
+    // Linkers lay read-only segments out in the file the way they are in memory, in which case the image is just a
+    // piece of the file. If not, it's put together in memory of its own.
+    int contiguous = 1;
+    int64_t offset = -1;
+    for (uint32_t i = 0; i < image->segmentCount; i++) {
+        Elf32_Phdr const* segment = image->segments + i;
+        if (segment->p_type != PT_LOAD || (segment->p_flags & PF_W)) {
+            continue;
+        }
+        int64_t const here = (int64_t) segment->p_offset - (int64_t) (segment->p_vaddr - base);
+        contiguous &= here >= 0 && (offset < 0 || offset == here) && segment->p_filesz == segment->p_memsz;
+        offset = here;
+    }
+    if (contiguous && offset >= 0 && (size_t) offset + image->programSize <= image->mappingSize) {
+        image->program = image->mapping + offset;
+        return 0;
     }
 
-    // if(index % 1000 == 0)
-    // {
-    // 	printf("my word was \"%s\" and i completed in %d cycles\n", (memory + *(uint32_t*)(memory + (argv + 4))),
-    // count);
-    // }
-
-    myResults->returnVal = state.x[10];
-    myResults->errorCode = state.x[0]; // If we have an error, just write to x[0] and self destruct out of the loop
+    image->owned = (uint8_t*) calloc(image->programSize, 1);
+    if (!image->owned) {
+        printf("Failed to allocate the program image.\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < image->segmentCount; i++) {
+        Elf32_Phdr const* segment = image->segments + i;
+        if (segment->p_type == PT_LOAD && !(segment->p_flags & PF_W)) {
+            memcpy(image->owned + (segment->p_vaddr - base), image->mapping + segment->p_offset, segment->p_filesz);
+        }
+    }
+    image->program = image->owned;
+    return 0;
 }
 
-uint64_t classicalExecuteProgram(uint8_t* program, uint8_t* memory, uint32_t memorySize, int32_t argc, uint32_t argv,
-                                 uint32_t programSize, uint32_t entry, Result* results, uint32_t maxOps,
-                                 BranchData* branchResults) {
-    State state;
-    for (int i = 0; i < 32; i++) {
-        state.x[i] = 0;
+// Returns nonzero if the file can't be run
+int programOpen(ProgramImage* image, char const* path) {
+    memset(image, 0, sizeof(ProgramImage));
+    int const file = open(path, O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0) {
+        printf("Couldn't open program file \"%s\".\n", path);
+        if (file >= 0) {
+            close(file);
+        }
+        return 1;
     }
-    state.pc                              = entry;
-    uint32_t const DONE_ADDRESS_CLASSICAL = 0xfffffff0;
+    image->mappingSize = status.st_size;
+    void* mapping      = mmap(NULL, image->mappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) {
+        printf("Couldn't map program file \"%s\".\n", path);
+        return 1;
+    }
+    image->mapping = (uint8_t*) mapping;
 
-    state.x[1] = DONE_ADDRESS_CLASSICAL;
-    state.x[2] = argv;
+    if (image->mappingSize >= SELFMAG && memcmp(image->mapping, ELFMAG, SELFMAG) == 0) {
+        return programLoadElf(image);
+    }
+    image->program     = image->mapping;
+    image->programSize = (uint32_t) image->mappingSize;
+    return 0;
+}
 
-    state.x[10] = argc;
-    state.x[11] = argv;
+void programClose(ProgramImage* image) {
+    free(image->owned);
+    munmap(image->mapping, image->mappingSize);
+}
 
-    int count = 0;
-    while (count < maxOps) {
-        uint32_t inst = *(uint32_t*) (program + state.pc);
-        // printf("executing instruction: %08x\n", inst);
-        if (classicalExecuteInstruction(&state, inst, memory, program, memorySize, programSize, branchResults) ||
-            state.pc == DONE_ADDRESS_CLASSICAL) {
-            break;
+// Copies the writable segments (zeros for .bss) into an instance's memory. Returns nonzero if they don't fit below
+// limit.
+int programLoadData(ProgramImage const* image, uint8_t* memory, uint32_t limit) {
+    for (uint32_t i = 0; image->segments && i < image->segmentCount; i++) {
+        Elf32_Phdr const* segment = image->segments + i;
+        if (segment->p_type != PT_LOAD || !(segment->p_flags & PF_W)) {
+            continue;
         }
-        count++;
+        uint64_t const at = segment->p_vaddr - (uint64_t) image->base;
+        if (at < image->programSize || at + segment->p_memsz > limit) {
+            printf("MEMORY_SIZE insufficient to hold the program's data (%u bytes at %#x)\n", segment->p_memsz,
+                   segment->p_vaddr);
+            return 1;
+        }
+        memcpy(memory + at, image->mapping + segment->p_offset, segment->p_filesz);
+        memset(memory + at + segment->p_filesz, 0, segment->p_memsz - segment->p_filesz);
     }
-
-    results->returnVal = state.x[10];
-    results->errorCode = state.x[0]; // If we have an error, just write to x[0] and self destruct out of the loop
-
-    return count;
+    return 0;
 }
 
-int loadToMemory(int argc, char** argv, uint32_t INSTANCE_COUNT, uint32_t MEMORY_SIZE, uint8_t** pout, uint8_t** mout,
-                 Result** rout, BranchData** bout, uint32_t* psizeout, int32_t* acout, uint32_t* ssout,
-                 uint32_t* epout) {
-    if (argc < 4) {
-        printf("Format: <program file to execute> <entry address as a number in hex> <args to be passed to subject "
-               "program (at least 1)>");
-        return 1;
+// Memory every instance needs: whatever the writable segments take up, then stackSize bytes for the arguments and the
+// stack
+uint32_t programMemorySize(ProgramImage const* image, uint32_t stackSize) {
+    uint64_t end = 0;
+    for (uint32_t i = 0; image->segments && i < image->segmentCount; i++) {
+        Elf32_Phdr const* segment = image->segments + i;
+        if (segment->p_type == PT_LOAD && (segment->p_flags & PF_W) &&
+            segment->p_vaddr + (uint64_t) segment->p_memsz - image->base > end) {
+            end = segment->p_vaddr + (uint64_t) segment->p_memsz - image->base;
+        }
     }
+    return (uint32_t) ((end + SNAPSHOT_CHUNK_SIZE - 1) & ~(uint64_t) (SNAPSHOT_CHUNK_SIZE - 1)) + stackSize;
+}
 
-    // First step: program instructions
-    // Reading the program instructions into a buffer
-    FILE* programFile = fopen(argv[1], "rb");
-    if (!programFile) {
-        printf("Couldn't open program file \"%s\".\n", argv[1]);
+// Guest address of a symbol in the ELF's symbol table. Returns nonzero if there's no such symbol (or no table).
+int programSymbol(ProgramImage const* image, char const* name, uint32_t* address) {
+    if (!image->segments) {
         return 1;
     }
-    fseek(programFile, 0, SEEK_END);
-    uint32_t const programSize = ftell(programFile);
-    rewind(programFile);
-    uint8_t* program = (uint8_t*) malloc(programSize);
-    if (!program) {
-        printf("Failed to allocate enough memory for the instructions for the emulator.\n");
+    Elf32_Ehdr const* header = (Elf32_Ehdr const*) image->mapping;
+    if (header->e_shentsize != sizeof(Elf32_Shdr) ||
+        header->e_shoff + (uint64_t) header->e_shnum * sizeof(Elf32_Shdr) > image->mappingSize) {
         return 1;
     }
-    fread(program, sizeof(uint8_t), programSize, programFile); // We're offset by 4 so we can force 0 addr to be special
-    // At this point, host has the program instructions in memory
+    Elf32_Shdr const* sections = (Elf32_Shdr const*) (image->mapping + header->e_shoff);
+    for (uint32_t i = 0; i < header->e_shnum; i++) {
+        Elf32_Shdr const* table = sections + i;
+        if (table->sh_type != SHT_SYMTAB || table->sh_link >= header->e_shnum ||
+            table->sh_offset + (uint64_t) table->sh_size > image->mappingSize) {
+            continue;
+        }
+        Elf32_Shdr const* strings = sections + table->sh_link;
+        Elf32_Sym const* symbols  = (Elf32_Sym const*) (image->mapping + table->sh_offset);
+        for (uint32_t j = 0; j < table->sh_size / sizeof(Elf32_Sym); j++) {
+            uint64_t const at = strings->sh_offset + (uint64_t) symbols[j].st_name;
+            if (symbols[j].st_shndx == SHN_UNDEF || at >= strings->sh_offset + strings->sh_size ||
+                at >= image->mappingSize ||
+                strncmp((char const*) image->mapping + at, name, image->mappingSize - at) != 0) {
+                continue;
+            }
+            *address = symbols[j].st_value - image->base;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int loadToMemory(int argc, char** argv, uint32_t INSTANCE_COUNT, uint32_t MEMORY_SIZE, ProgramImage const* iout,
+                 Arena* arena, uint8_t** mout, Result** rout, int32_t* acout, uint32_t* ssout, uint32_t* epout) {
+    // First step: program instructions
+    // These are mapped already (see programOpen()), nothing gets copied
 
     // Second step: we need to initialize the state for the processor. This means setting register 0 to all 0s,
     // setting register 1 to the done address (right after last instruction in program), setting register 1 to the top
@@ -972,13 +2035,12 @@ int loadToMemory(int argc, char** argv, uint32_t INSTANCE_COUNT, uint32_t MEMORY
     // instance's stack Basically: every instance needs space for initial stuff + some actual stack memory to execute
     // with Nothing is on the stack to start, we pass argc and argv by setting registers 10 and 11 So above the stack we
     // have: actual strings, then pointers to them pointed to by argv, then the actual stack So now we allocate the
-    // memory images for the program
-    uint8_t* memory = (uint8_t*) malloc(MEMORY_SIZE * INSTANCE_COUNT);
+    // memory images for the program, zeroed already
+    uint8_t* memory = (uint8_t*) arenaAllocate(arena, (size_t) MEMORY_SIZE * INSTANCE_COUNT);
     if (!memory) {
         printf("Failed to allocate enough memory for the emulator.\n");
         return 1;
     }
-    memset(memory, 0, MEMORY_SIZE * INSTANCE_COUNT);
     // For now, we're literally just going to pass through arguments from our actual call of this program.
     // So argv[3..] correspond to argv[1..] in the subject program and argv[1] in our program is argv[0] in subject
     int32_t argcSubj          = argc - 2;
@@ -1015,6 +2077,11 @@ int loadToMemory(int argc, char** argv, uint32_t INSTANCE_COUNT, uint32_t MEMORY
             (argvArrayEnd +
              (argcSubj * 4)); // Remember, starting stack pointer value is not usable immediately, dec first, so this ok
 
+    // The program's .data and .bss go right after the program image, at the bottom of the stack's way
+    if (programLoadData(iout, memory, stackStart)) {
+        return 1;
+    }
+
     char randBuf[32];
     uint32_t maxIn = (argvSubjOffsets[1] - argvSubjOffsets[0]);
     if (maxIn > 31) {
@@ -1025,7 +2092,7 @@ int loadToMemory(int argc, char** argv, uint32_t INSTANCE_COUNT, uint32_t MEMORY
 
     for (uint32_t i = 1; i < INSTANCE_COUNT; i++) {
         // Make sure memory size is big enough or problems will happen
-        memcpy(memory + ((MEMORY_SIZE * i) + stackStart), memory + stackStart, MEMORY_SIZE - stackStart);
+        memcpy(memory + (MEMORY_SIZE * i), memory, MEMORY_SIZE);
 
         for (int j = 0; j < maxIn; j++) {
             randBuf[j] = (rand() % 26) + 97;
@@ -1036,23 +2103,25 @@ int loadToMemory(int argc, char** argv, uint32_t INSTANCE_COUNT, uint32_t MEMORY
     free(argvSubjOffsets);
     // Should now have both program and memory images on the device
 
-    uint32_t entryPoint = (uint32_t) strtol(argv[2], NULL, 16);
-
-    uint32_t programInstCount = programSize / 4;
+    // ELF files can say where to start by name, numbers are addresses (the ELF's own for ELF files)
+    uint32_t entryPoint = 0;
+    if (programSymbol(iout, argv[2], &entryPoint)) {
+        char* end  = NULL;
+        entryPoint = (uint32_t) strtoul(argv[2], &end, 16) - iout->base;
+        if (end == argv[2] || *end != '\0') {
+            printf("No symbol \"%s\" in the program, and it's not an address either.\n", argv[2]);
+            return 1;
+        }
+    }
 
-    Result* localResults        = (Result*) malloc(INSTANCE_COUNT * sizeof(Result));
-    BranchData* localBranchData = (BranchData*) malloc(programInstCount * sizeof(BranchData));
-    if (!localResults || !localBranchData) {
+    Result* localResults = (Result*) arenaAllocate(arena, INSTANCE_COUNT * sizeof(Result));
+    if (!localResults) {
         printf("FAILED TO malloc results\n");
         return 1;
     }
-    memset(localBranchData, 0, sizeof(BranchData) * programInstCount);
 
-    *pout     = program;
     *mout     = memory;
     *rout     = localResults;
-    *bout     = localBranchData;
-    *psizeout = programSize;
     *acout    = argcSubj;
     *ssout    = stackStart;
     *epout    = entryPoint;
@@ -1060,6 +2129,388 @@ int loadToMemory(int argc, char** argv, uint32_t INSTANCE_COUNT, uint32_t MEMORY
     return 0;
 }
 
+// Sharing coverage between the CPU processes, every SYNC_SECONDS or so (rank 0 says when, see the scheduler). Only
+// what changed since the last sync goes anywhere: the virgin map entries that did (as gaps between their indices and
+// their new bytes, mostly 2 bytes an entry) and the seeds that were added. The processes swap those with recursive
+// doubling, so after log2 of how many there are rounds of one message each way they've all got everybody's.
+double const SYNC_SECONDS = 1;
+
+typedef struct Sync {
+    MPI_Comm workers; // Every process but rank 0
+    int rank;
+    int size;
+    uint32_t synced; // Seeds in the corpus that every process has (or is getting this sync)
+
+    uint8_t* out;
+    uint32_t outCapacity;
+    uint8_t* in;
+    uint32_t inCapacity;
+
+    uint64_t syncs;
+    uint64_t bytesSent;
+} Sync;
+
+// Returns nonzero if allocating fails
+int syncCreate(Sync* sync, MPI_Comm workers) {
+    sync->workers     = workers;
+    sync->synced      = 0;
+    sync->outCapacity = 1024;
+    sync->out         = (uint8_t*) malloc(sync->outCapacity);
+    sync->inCapacity  = 1024;
+    sync->in          = (uint8_t*) malloc(sync->inCapacity);
+    sync->syncs       = 0;
+    sync->bytesSent   = 0;
+    MPI_Comm_rank(workers, &sync->rank);
+    MPI_Comm_size(workers, &sync->size);
+    if (!sync->out || !sync->in) {
+        printf("Failed to allocate the sync buffers.\n");
+        return 1;
+    }
+    return 0;
+}
+
+void syncFree(Sync* sync) {
+    free(sync->out);
+    free(sync->in);
+    MPI_Comm_free(&sync->workers);
+}
+
+// Makes sure buffer has room for size bytes. Returns nonzero if allocating fails.
+int syncReserve(uint8_t** buffer, uint32_t* capacity, uint32_t size) {
+    if (size <= *capacity) {
+        return 0;
+    }
+    uint32_t grown = *capacity * 2 > size ? *capacity * 2 : size;
+    uint8_t* moved = (uint8_t*) realloc(*buffer, grown);
+    if (!moved) {
+        printf("Failed to grow a sync buffer.\n");
+        return 1;
+    }
+    *buffer   = moved;
+    *capacity = grown;
+    return 0;
+}
+
+// LEB128, 7 bits a byte
+inline uint32_t syncPutVarint(uint8_t* out, uint64_t value) {
+    uint32_t size = 0;
+    for (; value >= 0x80; value >>= 7) {
+        out[size++] = (uint8_t) value | 0x80;
+    }
+    out[size++] = (uint8_t) value;
+    return size;
+}
+
+inline uint64_t syncGetVarint(uint8_t const** in) {
+    uint64_t value = 0;
+    for (uint32_t shift = 0;; shift += 7) {
+        uint8_t const byte = *(*in)++;
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+// Writes what this process has that the others might not to sync->out and returns its size: the changed map entries,
+// then the seeds from sync->synced on (except skipFirst to skipLast, which the receiver sent us). Returns 0 if
+// allocating fails, a message is never empty.
+uint32_t syncEncode(Sync* sync, Coverage const* coverage, Corpus const* corpus, uint32_t skipFirst,
+                    uint32_t skipLast) {
+    uint32_t entries = 0;
+    for (uint32_t word = 0; word < COVERAGE_MAP_SIZE / 64; word++) {
+        entries += __builtin_popcountll(coverage->changed[word]);
+    }
+    // A gap fits in 3 bytes, 10 is the most any number takes
+    uint32_t const seeds = corpus->count - sync->synced - (skipLast - skipFirst);
+    if (syncReserve(&sync->out, &sync->outCapacity, 20 + entries * 4 + seeds * (11 + 8 + CORPUS_MAX_INPUT))) {
+        return 0;
+    }
+
+    uint8_t* out  = sync->out;
+    uint32_t size = syncPutVarint(out, entries);
+    uint32_t last = 0;
+    for (uint32_t word = 0; word < COVERAGE_MAP_SIZE / 64; word++) {
+        for (uint64_t bits = coverage->changed[word]; bits; bits &= bits - 1) {
+            uint32_t const index = word * 64 + __builtin_ctzll(bits);
+            size += syncPutVarint(out + size, index - last);
+            out[size++] = coverage->virgin[index];
+            last        = index;
+        }
+    }
+
+    size += syncPutVarint(out + size, seeds);
+    for (uint32_t i = sync->synced; i < corpus->count; i++) {
+        if (i >= skipFirst && i < skipLast) {
+            continue;
+        }
+        Seed const* seed = corpus->seeds + i;
+        out[size++]      = (uint8_t) seed->length;
+        size += syncPutVarint(out + size, seed->instructions);
+        memcpy(out + size, &seed->path, 8);
+        memcpy(out + size + 8, seed->data, seed->length);
+        size += 8 + seed->length;
+    }
+    return size;
+}
+
+// Folds a message from another process into ours. Its entries count as changed here too, so they get passed on in the
+// rounds after this one. Returns nonzero if allocating fails.
+int syncApply(uint8_t const* in, Coverage* coverage, Corpus* corpus) {
+    uint32_t index = 0;
+    for (uint64_t entries = syncGetVarint(&in); entries > 0; entries--) {
+        index += (uint32_t) syncGetVarint(&in);
+        coverage->virgin[index] &= *in++;
+        coverage->changed[index / 64] |= 1ull << (index % 64);
+    }
+
+    for (uint64_t seeds = syncGetVarint(&in); seeds > 0; seeds--) {
+        uint32_t const length       = *in++;
+        uint32_t const instructions = (uint32_t) syncGetVarint(&in);
+        uint64_t path;
+        memcpy(&path, in, 8);
+        if (corpusAdd(corpus, in + 8, length, instructions, path)) {
+            return 1;
+        }
+        in += 8 + length;
+    }
+    return 0;
+}
+
+// Sends size bytes of sync->out to partner and gets what it sends back in sync->in. Returns nonzero if allocating
+// fails.
+int syncSwap(Sync* sync, int partner, uint32_t size) {
+    uint32_t incoming = 0;
+    MPI_Sendrecv(&size, 1, MPI_UINT32_T, partner, 0, &incoming, 1, MPI_UINT32_T, partner, 0, sync->workers,
+                 MPI_STATUS_IGNORE);
+    if (syncReserve(&sync->in, &sync->inCapacity, incoming)) {
+        return 1;
+    }
+    MPI_Sendrecv(sync->out, size, MPI_BYTE, partner, 1, sync->in, incoming, MPI_BYTE, partner, 1, sync->workers,
+                 MPI_STATUS_IGNORE);
+    sync->bytesSent += size;
+    return 0;
+}
+
+// Swaps what changed with every other CPU process, all of them have to call it. The processes past the biggest power of
+// two hand theirs to a partner below it first, and get everything back from it at the end. Returns nonzero if
+// allocating fails.
+int syncExchange(Sync* sync, Coverage* coverage, Corpus* corpus) {
+    int half = 1;
+    while (half * 2 <= sync->size) {
+        half *= 2;
+    }
+    int const extra = sync->rank >= half ? sync->rank - half : sync->rank + half;
+
+    if (sync->rank >= half) {
+        uint32_t const size = syncEncode(sync, coverage, corpus, 0, 0);
+        if (!size || syncSwap(sync, extra, size) || syncSwap(sync, extra, 0) || syncApply(sync->in, coverage, corpus)) {
+            return 1;
+        }
+    } else {
+        // Seeds from the extra process are kept out of what goes back to it
+        uint32_t extraFirst = corpus->count;
+        uint32_t extraLast  = corpus->count;
+        if (extra < sync->size) {
+            if (syncSwap(sync, extra, 0) || syncApply(sync->in, coverage, corpus)) {
+                return 1;
+            }
+            extraLast = corpus->count;
+        }
+
+        for (int mask = 1; mask < half; mask *= 2) {
+            uint32_t const size = syncEncode(sync, coverage, corpus, 0, 0);
+            if (!size || syncSwap(sync, sync->rank ^ mask, size) || syncApply(sync->in, coverage, corpus)) {
+                return 1;
+            }
+        }
+
+        if (extra < sync->size) {
+            uint32_t const size = syncEncode(sync, coverage, corpus, extraFirst, extraLast);
+            if (!size || syncSwap(sync, extra, size)) {
+                return 1;
+            }
+        }
+    }
+
+    memset(coverage->changed, 0, (COVERAGE_MAP_SIZE / 64) * sizeof(uint64_t));
+    sync->synced = corpus->count;
+    sync->syncs++;
+    return 0;
+}
+
+// Rank 0 decides how long the CPU processes run. It hands out batches of runs on demand, and every process keeps
+// SCHEDULE_AHEAD orders queued so it never waits for the next one. Batches are sized from how fast that process got
+// through its last one, so fast and slow processes are all busy right up to the end, and nobody's last batch holds up
+// everyone else for long. Every SYNC_SECONDS one order for each process says to sync first, and since they all wait
+// for each other there, the next sync only starts once everybody got the last one. Messages are structs sent as bytes,
+// every process is the same binary on the same kind of machine.
+int const SCHEDULE_TAG_ORDER           = 1;
+int const SCHEDULE_TAG_RESULT          = 2;
+uint32_t const SCHEDULE_AHEAD          = 2;
+uint32_t const SCHEDULE_FIRST_RUNS     = 256;
+double const SCHEDULE_BATCH_SECONDS    = 0.05;
+double const SCHEDULE_DEFAULT_SECONDS  = 10; // Unless AJAXEMU_SECONDS says otherwise
+
+typedef struct WorkOrder {
+    uint64_t batch; // Unique over the run, seeds corpusRandom() for it
+    uint32_t runs;  // 0 means stop
+    uint32_t sync;  // Nonzero to call syncExchange() first (before stopping, too)
+} WorkOrder;
+
+typedef struct BatchResult {
+    uint64_t batch;
+    uint64_t instructions;
+    double seconds;
+    uint32_t runs;
+    uint32_t newEdges;  // Runs that found a new edge
+    uint32_t newCounts; // Runs that only found a new hit count
+} BatchResult;
+
+typedef struct Scheduler {
+    int nproc;
+    uint64_t nextBatch;
+    uint32_t* runs;        // Size of every rank's next batch
+    uint32_t* outstanding; // Orders sent to every rank that haven't come back yet
+    int* stopped;          // Whether every rank was told to stop
+    uint32_t* synced;      // The last sync every rank was told about
+    uint32_t sync;         // The sync going on, 0 before the first
+    double syncTime;       // When it started
+
+    // Send buffers, SCHEDULE_AHEAD + 1 per rank (one more for the stop) used round-robin, with their requests
+    WorkOrder* orders;
+    MPI_Request* sends;
+    uint32_t* sent;
+
+    BatchResult result;
+    MPI_Request receive;
+
+    // What came back so far
+    uint64_t batches;
+    uint64_t runsDone;
+    uint64_t instructions;
+    uint64_t newEdges;
+    uint64_t newCounts;
+} Scheduler;
+
+void scheduleSend(Scheduler* scheduler, int rank, uint32_t runs) {
+    uint32_t const slot = rank * (SCHEDULE_AHEAD + 1) + scheduler->sent[rank]++ % (SCHEDULE_AHEAD + 1);
+    MPI_Wait(scheduler->sends + slot, MPI_STATUS_IGNORE);
+    scheduler->orders[slot].batch = runs ? scheduler->nextBatch++ : 0;
+    scheduler->orders[slot].runs  = runs;
+    scheduler->orders[slot].sync  = scheduler->synced[rank] != scheduler->sync;
+    scheduler->synced[rank]       = scheduler->sync;
+    MPI_Isend(scheduler->orders + slot, sizeof(WorkOrder), MPI_BYTE, rank, SCHEDULE_TAG_ORDER, MPI_COMM_WORLD,
+              scheduler->sends + slot);
+    if (runs) {
+        scheduler->outstanding[rank]++;
+    } else {
+        scheduler->stopped[rank] = 1;
+    }
+}
+
+// Gives every CPU process its first orders. Returns nonzero if allocating fails.
+int scheduleCreate(Scheduler* scheduler, int nproc) {
+    scheduler->nproc        = nproc;
+    scheduler->nextBatch    = 0;
+    scheduler->runs         = (uint32_t*) calloc(nproc, sizeof(uint32_t));
+    scheduler->outstanding  = (uint32_t*) calloc(nproc, sizeof(uint32_t));
+    scheduler->stopped      = (int*) calloc(nproc, sizeof(int));
+    scheduler->synced       = (uint32_t*) calloc(nproc, sizeof(uint32_t));
+    scheduler->sync         = 0;
+    scheduler->syncTime     = 0;
+    scheduler->orders       = (WorkOrder*) calloc(nproc * (SCHEDULE_AHEAD + 1), sizeof(WorkOrder));
+    scheduler->sends        = (MPI_Request*) malloc(nproc * (SCHEDULE_AHEAD + 1) * sizeof(MPI_Request));
+    scheduler->sent         = (uint32_t*) calloc(nproc, sizeof(uint32_t));
+    scheduler->batches      = 0;
+    scheduler->runsDone     = 0;
+    scheduler->instructions = 0;
+    scheduler->newEdges     = 0;
+    scheduler->newCounts    = 0;
+    if (!scheduler->runs || !scheduler->outstanding || !scheduler->stopped || !scheduler->synced ||
+        !scheduler->orders || !scheduler->sends || !scheduler->sent) {
+        printf("Failed to allocate the scheduler.\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < nproc * (SCHEDULE_AHEAD + 1); i++) {
+        scheduler->sends[i] = MPI_REQUEST_NULL;
+    }
+
+    for (int rank = 1; rank < nproc; rank++) {
+        scheduler->runs[rank] = SCHEDULE_FIRST_RUNS;
+        for (uint32_t i = 0; i < SCHEDULE_AHEAD; i++) {
+            scheduleSend(scheduler, rank, SCHEDULE_FIRST_RUNS);
+        }
+    }
+    MPI_Irecv(&scheduler->result, sizeof(BatchResult), MPI_BYTE, MPI_ANY_SOURCE, SCHEDULE_TAG_RESULT, MPI_COMM_WORLD,
+              &scheduler->receive);
+    return 0;
+}
+
+void scheduleFree(Scheduler* scheduler) {
+    MPI_Waitall(scheduler->nproc * (SCHEDULE_AHEAD + 1), scheduler->sends, MPI_STATUSES_IGNORE);
+    MPI_Cancel(&scheduler->receive);
+    MPI_Wait(&scheduler->receive, MPI_STATUS_IGNORE);
+    free(scheduler->runs);
+    free(scheduler->outstanding);
+    free(scheduler->stopped);
+    free(scheduler->synced);
+    free(scheduler->orders);
+    free(scheduler->sends);
+    free(scheduler->sent);
+}
+
+// Handles whatever result came in, if one did, and gives that process its next order. Once stopping, processes get
+// told to stop instead (after the orders they have, which they still finish), with one last sync. elapsed is the
+// seconds since the start. Returns nonzero while some process is still busy.
+int schedulePoll(Scheduler* scheduler, double elapsed, int stopping) {
+    // Only once every process was told about the last one
+    int everyone = 1;
+    for (int rank = 1; rank < scheduler->nproc; rank++) {
+        everyone &= scheduler->synced[rank] == scheduler->sync;
+    }
+    int const last = stopping && !scheduler->stopped[1];
+    if (everyone && (last || (!stopping && elapsed - scheduler->syncTime >= SYNC_SECONDS))) {
+        scheduler->sync++;
+        scheduler->syncTime = elapsed;
+    }
+
+    int flag = 0;
+    MPI_Status status;
+    MPI_Test(&scheduler->receive, &flag, &status);
+    if (flag) {
+        int const rank            = status.MPI_SOURCE;
+        BatchResult const* result = &scheduler->result;
+        scheduler->outstanding[rank]--;
+        scheduler->batches++;
+        scheduler->runsDone += result->runs;
+        scheduler->instructions += result->instructions;
+        scheduler->newEdges += result->newEdges;
+        scheduler->newCounts += result->newCounts;
+
+        // Aim for SCHEDULE_BATCH_SECONDS, but don't change by more than 4x at once since one batch can be a fluke
+        double scale = result->seconds > 0 ? SCHEDULE_BATCH_SECONDS / result->seconds : 4;
+        scale        = scale < 0.25 ? 0.25 : (scale > 4 ? 4 : scale);
+        double runs  = result->runs * scale;
+        scheduler->runs[rank] = runs < 1 ? 1 : (runs > 1e6 ? 1000000 : (uint32_t) runs);
+
+        if (!stopping) {
+            scheduleSend(scheduler, rank, scheduler->runs[rank]);
+        }
+        MPI_Irecv(&scheduler->result, sizeof(BatchResult), MPI_BYTE, MPI_ANY_SOURCE, SCHEDULE_TAG_RESULT,
+                  MPI_COMM_WORLD, &scheduler->receive);
+    }
+
+    int busy = 0;
+    for (int rank = 1; rank < scheduler->nproc; rank++) {
+        if (stopping && !scheduler->stopped[rank]) {
+            scheduleSend(scheduler, rank, 0);
+        }
+        busy |= scheduler->outstanding[rank] != 0;
+    }
+    return busy;
+}
+
 int main(int argc, char** argv) {
     int pid;
     int nproc;
@@ -1069,10 +2520,11 @@ int main(int argc, char** argv) {
     MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_ARE_FATAL);
     MPI_Barrier(MPI_COMM_WORLD);
 
+    ProgramImage image{};
+    Arena arena{};
     uint8_t* program;
     uint8_t* memory;
     Result* localResults;
-    BranchData* localBranchData;
     uint32_t programSize;
     int32_t argcSubj;
     uint32_t stackStart;
@@ -1081,24 +2533,43 @@ int main(int argc, char** argv) {
     uint8_t* deviceProgramImage;
     uint8_t* deviceMemoryImage;
     Result* deviceResultImage;
-    BranchData* deviceBranchDataImage;
+    uint8_t* deviceCoverage;
 
-    uint8_t* spareMemory{};
+    Snapshot snapshot{};
+    MicroOp* microOps{};
+    Coverage coverage{};
+    Corpus corpus{};
+    CmpLog cmpLog{};
+    InputToState inputToState{};
+    Sync sync{};
 
     dim3 blockDim(512);
     dim3 gridDim(32);
 
+    if (argc < 4) {
+        printf("Format: <program file to execute (ELF or flat)> <entry: a symbol (ELF only) or address in hex> "
+               "<args to be passed to subject program (at least 1)>");
+        return 1;
+    }
+    if (programOpen(&image, argv[1])) {
+        return 1;
+    }
+    arenaCreate(&arena);
+
     uint32_t const MAX_OPS = 10000;
-    uint32_t const MEMORY_SIZE =
-            4 * 1024; // This needs to be 4 byte aligned or bad things happen because cuda memory access rules
+    // This needs to be 4 byte aligned or bad things happen because cuda memory access rules. Subjects with .data or
+    // .bss get more, so the stack still has its 4 KB.
+    uint32_t const MEMORY_SIZE = programMemorySize(&image, 4 * 1024);
     uint32_t INSTANCE_COUNT = 1;
     if (pid == 0) {
         INSTANCE_COUNT = blockDim.x * gridDim.x;
 
-        if (loadToMemory(argc, argv, INSTANCE_COUNT, MEMORY_SIZE, &program, &memory, &localResults, &localBranchData,
-                         &programSize, &argcSubj, &stackStart, &entryPoint)) {
+        if (loadToMemory(argc, argv, INSTANCE_COUNT, MEMORY_SIZE, &image, &arena, &memory, &localResults, &argcSubj,
+                         &stackStart, &entryPoint)) {
             return 1;
         }
+        program     = image.program;
+        programSize = image.programSize;
         cudaError_t programMallocErrorCode = cudaMalloc(&deviceProgramImage, programSize);
         if (programMallocErrorCode != cudaSuccess) {
             printf("FAILED TO CUDA MALLOC: %s\n", cudaGetErrorString(programMallocErrorCode));
@@ -1116,41 +2587,65 @@ int main(int argc, char** argv) {
             printf("FAILED TO CUDA MALLOC: %s\n", cudaGetErrorString(mallocResultImageError));
             return 1;
         }
-        uint32_t programInstCount = programSize / 4;
-        cudaError_t mallocBranchDataImageError =
-                cudaMalloc(&deviceBranchDataImage, sizeof(BranchData) * (programInstCount));
-        if (mallocBranchDataImageError != cudaSuccess) {
-            printf("FAILED TO CUDA MALLOC: %s\n", cudaGetErrorString(mallocBranchDataImageError));
+        cudaError_t mallocCoverageError = cudaMalloc(&deviceCoverage, COVERAGE_MAP_SIZE);
+        if (mallocCoverageError != cudaSuccess) {
+            printf("FAILED TO CUDA MALLOC: %s\n", cudaGetErrorString(mallocCoverageError));
             return 1;
         }
         cudaMemcpy(deviceProgramImage, program, programSize, cudaMemcpyHostToDevice);
-        cudaMemcpy(deviceBranchDataImage, localBranchData, sizeof(BranchData) * (programInstCount),
-                   cudaMemcpyHostToDevice);
+        cudaMemset(deviceCoverage, 0, COVERAGE_MAP_SIZE);
         cudaMemcpy(deviceMemoryImage, memory, MEMORY_SIZE * INSTANCE_COUNT, cudaMemcpyHostToDevice);
     } else {
-        if (loadToMemory(argc, argv, INSTANCE_COUNT, MEMORY_SIZE, &program, &memory, &localResults, &localBranchData,
-                         &programSize, &argcSubj, &stackStart, &entryPoint)) {
+        if (loadToMemory(argc, argv, INSTANCE_COUNT, MEMORY_SIZE, &image, &arena, &memory, &localResults, &argcSubj,
+                         &stackStart, &entryPoint)) {
+            return 1;
+        }
+        program     = image.program;
+        programSize = image.programSize;
+
+        // Every run starts from here, see the loop below
+        State initialState;
+        for (int i = 0; i < 32; i++) {
+            initialState.x[i] = 0;
+        }
+        initialState.pc    = entryPoint;
+        initialState.x[1]  = 0xfffffff0; // Done address
+        initialState.x[2]  = stackStart;
+        initialState.x[10] = argcSubj;
+        initialState.x[11] = stackStart; // argv
+        if (snapshotCreate(&snapshot, &arena, &initialState, memory, MEMORY_SIZE, INSTANCE_COUNT)) {
             return 1;
         }
 
-        spareMemory = (uint8_t*) malloc(MEMORY_SIZE * INSTANCE_COUNT);
-        memcpy((spareMemory + stackStart), memory + stackStart, MEMORY_SIZE - stackStart);
+        // Decode once, the CPU loop below only ever looks at these
+        microOps = (MicroOp*) malloc(((programSize / 4) + 1) * sizeof(MicroOp));
+        if (!microOps) {
+            printf("Failed to allocate micro-ops for the emulator.\n");
+            return 1;
+        }
+        classicalDecodeProgram(program, programSize, microOps);
+    }
+
+    if (coverageCreate(&coverage, &arena) || corpusCreate(&corpus)) {
+        return 1;
+    }
+
+    // The CPU processes sync among themselves
+    MPI_Comm workers;
+    MPI_Comm_split(MPI_COMM_WORLD, pid == 0 ? MPI_UNDEFINED : 1, pid, &workers);
+    if (pid != 0 && syncCreate(&sync, workers)) {
+        return 1;
     }
 
-    int goodToGo = 1;
     MPI_Barrier(MPI_COMM_WORLD);
     auto startTime = std::chrono::high_resolution_clock::now();
 
-    MPI_Request doneReq;
-
     uint32_t argv1Len = 0;
 
     uint32_t maxIn = 0;
 
     if (pid != 0) {
-        MPI_Irecv(&goodToGo, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &doneReq);
-
-        argv1Len = strlen((char*) (spareMemory + *(uint32_t*) (spareMemory + stackStart + 4)));
+        argv1Len = strlen((char*) (snapshot.memory + *(uint32_t*) (snapshot.memory + stackStart + 4)));
         maxIn    = argv1Len;
         if (maxIn > 31) {
             maxIn = 31;
@@ -1160,46 +2655,144 @@ int main(int argc, char** argv) {
     uint64_t instancesRun    = 0;
     uint64_t instructionsRun = 0;
 
-    while (goodToGo) {
-        if (pid == 0) {
-            // cudaMemcpy(deviceMemoryImage, memory, MEMORY_SIZE * INSTANCE_COUNT, cudaMemcpyHostToDevice);
+    if (pid == 0) {
+        // The CPU processes keep going until the GPU is done and they've had their time, whichever comes last
+        char const* secondsVariable = getenv("AJAXEMU_SECONDS");
+        double const seconds        = secondsVariable ? atof(secondsVariable) : SCHEDULE_DEFAULT_SECONDS;
+
+        Scheduler scheduler{};
+        if (nproc > 1 && scheduleCreate(&scheduler, nproc)) {
+            return 1;
+        }
 
-            kernelExecuteProgram<<<gridDim, blockDim>>>(deviceProgramImage, deviceMemoryImage, MEMORY_SIZE, argcSubj,
-                                                        stackStart, programSize, entryPoint, deviceResultImage, MAX_OPS,
-                                                        deviceBranchDataImage);
+        // cudaMemcpy(deviceMemoryImage, memory, MEMORY_SIZE * INSTANCE_COUNT, cudaMemcpyHostToDevice);
 
-            cudaError_t errorCode = cudaPeekAtLastError();
-            if (errorCode != cudaSuccess) {
-                printf("FAILED TO LAUNCH KERNEL: %s\n", cudaGetErrorString(errorCode));
-            }
-            cudaDeviceSynchronize();
+        kernelExecuteProgram<<<gridDim, blockDim>>>(deviceProgramImage, deviceMemoryImage, MEMORY_SIZE, argcSubj,
+                                                    stackStart, programSize, entryPoint, deviceResultImage, MAX_OPS,
+                                                    deviceCoverage);
+
+        cudaError_t errorCode = cudaPeekAtLastError();
+        if (errorCode != cudaSuccess) {
+            printf("FAILED TO LAUNCH KERNEL: %s\n", cudaGetErrorString(errorCode));
+        }
 
-            goodToGo = 0;
-            for (int i = 1; i < nproc; i++) {
-                MPI_Send(&goodToGo, 1, MPI_INT, i, 0, MPI_COMM_WORLD);
+        // Launches don't block, so the CPU processes get served while the kernel runs
+        int kernelDone = 0;
+        int busy       = nproc > 1;
+        while (!kernelDone || busy) {
+            if (!kernelDone && cudaStreamQuery(0) != cudaErrorNotReady) {
+                kernelDone = 1;
+                instancesRun += INSTANCE_COUNT;
             }
-        } else {
-            char randBuf[32];
-            randBuf[maxIn] = '\0';
-            for (int i = 0; i < maxIn; i++) {
-                randBuf[i] = (rand() % 26) + 97;
+            if (nproc > 1) {
+                auto const now       = std::chrono::high_resolution_clock::now();
+                double const elapsed = std::chrono::duration<double>(now - startTime).count();
+                busy = schedulePoll(&scheduler, elapsed, kernelDone && elapsed >= seconds);
             }
+        }
 
-            for (int i = 0; i < INSTANCE_COUNT; i++) {
-                memcpy(memory + ((MEMORY_SIZE * i) + stackStart), spareMemory + stackStart, MEMORY_SIZE - stackStart);
-                // This is jsut beautiful -- we don't need to recalculate where argv[1] is because we have the stack
-                // LMAO
-                char* argv1 = (char*) (memory + (MEMORY_SIZE * i) + *(uint32_t*) (spareMemory + stackStart + 4));
-                strncpy(argv1, randBuf, maxIn);
+        if (nproc > 1) {
+            printf("The CPU processes did %lu batches of work, %lu runs and %lu instructions, %lu runs found new edges "
+                   "and %lu more new hit counts\n",
+                   scheduler.batches, scheduler.runsDone, scheduler.instructions, scheduler.newEdges,
+                   scheduler.newCounts);
+            scheduleFree(&scheduler);
+        }
+    } else {
+        // This is jsut beautiful -- we don't need to recalculate where argv[1] is because we have the stack LMAO
+        uint32_t const argv1Offset = *(uint32_t*) (snapshot.memory + stackStart + 4);
+
+        // One result on its way back at a time, the next batch is queued already so there's no waiting for it
+        BatchResult result{};
+        MPI_Request resultRequest = MPI_REQUEST_NULL;
+        WorkOrder order;
+
+        // The input is the subject's stdin too, and its heap goes from past the end of its data up to the stack
+        GuestIO guest{};
+        uint32_t const dataEnd = programMemorySize(&image, 0);
+        guest.heapStart        = (programSize + 63) / 64 * 64 > dataEnd ? (programSize + 63) / 64 * 64 : dataEnd;
+
+        while (1) {
+            MPI_Recv(&order, sizeof(WorkOrder), MPI_BYTE, 0, SCHEDULE_TAG_ORDER, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (order.sync && syncExchange(&sync, &coverage, &corpus)) {
+                return 1;
             }
+            if (order.runs == 0) {
+                break;
+            }
+
+            // Seeded per batch, every process would otherwise mutate the exact same way
+            uint64_t random = order.batch;
+            auto const batchStart            = std::chrono::high_resolution_clock::now();
+            uint64_t const batchInstructions = instructionsRun;
+            uint64_t const batchNewEdges     = coverage.newEdges;
+            uint64_t const batchNewCounts    = coverage.newCounts;
+
+            for (uint32_t run = 0; run < order.runs; run++) {
+                // The very first run is the subject's own argv[1], which seeds the corpus whatever it does
+                uint8_t input[CORPUS_MAX_INPUT + 1] = {};
+                uint32_t inputLength                = argv1Len < maxIn ? argv1Len : maxIn;
+                if (corpus.count == 0) {
+                    memcpy(input, snapshot.memory + argv1Offset, inputLength);
+                } else if (inputToState.next < inputToState.count) {
+                    memcpy(input, inputToState.candidates[inputToState.next], CORPUS_MAX_INPUT);
+                    inputLength = inputToState.lengths[inputToState.next++];
+                } else {
+                    inputLength = corpusMutate(&corpus, corpusNext(&corpus), input, maxIn, &random);
+                }
+
+                for (uint32_t i = 0; i < INSTANCE_COUNT; i++) {
+                    // Only what the last run wrote to (and the last input) gets copied back
+                    snapshotRestore(&snapshot, i, memory + (MEMORY_SIZE * i));
+                    strncpy((char*) (memory + (MEMORY_SIZE * i) + argv1Offset), (char*) input, maxIn);
+                    snapshotMarkDirty(snapshot.dirty + (i * snapshot.dirtyWords), argv1Offset, maxIn, MEMORY_SIZE);
+                }
+
+                guestReset(&guest, input, inputLength);
+                uint64_t const instructions = classicalExecuteProgram(
+                        microOps, program, memory, MEMORY_SIZE, &snapshot.state, programSize, localResults, MAX_OPS,
+                        coverage.trace, snapshot.dirty, &guest, NULL);
+                // Whatever the subject printed for its own argv[1], once
+                if (corpus.count == 0 && pid == 1) {
+                    fwrite(guest.output, 1, guest.outputLength, stdout);
+                }
+                instructionsRun += instructions;
+                instancesRun += INSTANCE_COUNT;
+
+                // Anything new gets a place in the queue, and every run counts towards its path's frequency
+                int const found = coverageMerge(&coverage);
+                corpusRecordRun(&corpus, coverage.path);
+                if (found || corpus.count == 0) {
+                    if (corpusAdd(&corpus, input, inputLength, (uint32_t) (instructions / INSTANCE_COUNT),
+                                  coverage.path)) {
+                        return 1;
+                    }
 
-            instructionsRun += classicalExecuteProgram(program, memory, MEMORY_SIZE, argcSubj, stackStart, programSize,
-                                                       entryPoint, localResults, MAX_OPS, localBranchData);
+                    // Once more logging comparisons, to see what the new seed gets compared against. Its edges were
+                    // counted already, the map is cleared again afterwards.
+                    snapshotRestore(&snapshot, 0, memory);
+                    strncpy((char*) (memory + argv1Offset), (char*) input, maxIn);
+                    snapshotMarkDirty(snapshot.dirty, argv1Offset, maxIn, MEMORY_SIZE);
+                    cmpLog.count = 0;
+                    guestReset(&guest, input, inputLength);
+                    classicalExecuteProgram(microOps, program, memory, MEMORY_SIZE, &snapshot.state, programSize,
+                                            localResults, MAX_OPS, coverage.trace, snapshot.dirty, &guest, &cmpLog);
+                    memset(coverage.trace, 0, COVERAGE_MAP_SIZE);
+                    cmplogInputToState(&cmpLog, input, inputLength, maxIn, &inputToState);
+                }
+            }
 
-            int flag = 0;
-            MPI_Test(&doneReq, &flag, MPI_STATUS_IGNORE);
+            auto const batchEnd = std::chrono::high_resolution_clock::now();
+            MPI_Wait(&resultRequest, MPI_STATUS_IGNORE);
+            result.batch        = order.batch;
+            result.instructions = instructionsRun - batchInstructions;
+            result.seconds      = std::chrono::duration<double>(batchEnd - batchStart).count();
+            result.runs         = order.runs;
+            result.newEdges     = (uint32_t) (coverage.newEdges - batchNewEdges);
+            result.newCounts    = (uint32_t) (coverage.newCounts - batchNewCounts);
+            MPI_Isend(&result, sizeof(BatchResult), MPI_BYTE, 0, SCHEDULE_TAG_RESULT, MPI_COMM_WORLD, &resultRequest);
         }
-        instancesRun += INSTANCE_COUNT;
+        MPI_Wait(&resultRequest, MPI_STATUS_IGNORE);
     }
 
     uint64_t totalInstancesRun    = 0;
@@ -1210,24 +2803,27 @@ int main(int argc, char** argv) {
     auto midExecTime = std::chrono::high_resolution_clock::now();
     MPI_Barrier(MPI_COMM_WORLD);
 
+    // The GPU's map only says which edges were hit at all, it's folded in as if one run hit each of them once
     if (pid == 0) {
-        cudaMemcpy(localBranchData, deviceBranchDataImage, sizeof(BranchData) * (programSize / 4),
-                   cudaMemcpyDeviceToHost);
+        cudaMemcpy(coverage.trace, deviceCoverage, COVERAGE_MAP_SIZE, cudaMemcpyDeviceToHost);
+        coverageMerge(&coverage);
     }
 
-    // for(uint32_t i = 0; i < (programSize / 4); i++)
-    // {
-    // 	if((((uint32_t*)program)[i] & 0x7f) == 0x63)
-    // 	{
-    // 		printf("pid %d, Branch at address %x was", pid, i * 4);
-    // 		if(localBranchData[i].hasBeenTaken) printf(" taken");
-    // 		if(localBranchData[i].hasBeenSkipped) printf(" skipped");
-    // 		printf("\n");
-    // 	}
-    // }
-
-    // MPI_Allreduce(MPI_IN_PLACE, localBranchData, 2 * (programSize / 4), MPI_UINT32_T, MPI_BOR, MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE, localBranchData, 2 * (programSize / 4), MPI_UINT32_T, MPI_SUM, MPI_COMM_WORLD);
+    // An edge (or hit count) is covered if any process saw it. The CPU processes have each other's already, except for
+    // whatever turned up after the last sync, only rank 0 prints it.
+    uint64_t totalNewEdges  = 0;
+    uint64_t totalNewCounts = 0;
+    MPI_Reduce(pid == 0 ? MPI_IN_PLACE : coverage.virgin, coverage.virgin, COVERAGE_MAP_SIZE, MPI_UINT8_T, MPI_BAND, 0,
+               MPI_COMM_WORLD);
+    MPI_Allreduce(&coverage.newEdges, &totalNewEdges, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&coverage.newCounts, &totalNewCounts, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    uint64_t corpusSize      = corpus.count;
+    uint64_t totalCorpusSize = 0;
+    MPI_Allreduce(&corpusSize, &totalCorpusSize, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+    uint64_t totalSyncs     = 0;
+    uint64_t totalSyncBytes = 0;
+    MPI_Allreduce(&sync.syncs, &totalSyncs, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(&sync.bytesSent, &totalSyncBytes, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
     auto finishTime = std::chrono::high_resolution_clock::now();
     // printf("pid %d, Exec took %lu us, full time taken including communication was %lu us, ran %lu instances\n", pid,
     // std::chrono::duration_cast<std::chrono::microseconds>(midExecTime - startTime).count(),
@@ -1258,15 +2854,11 @@ int main(int argc, char** argv) {
                    std::chrono::duration_cast<std::chrono::microseconds>(midExecTime - startTime).count());
         }
         printf("Total of %lu instances run across %d processes, 1 of which used the gpu\n", totalInstancesRun, nproc);
-        for (uint32_t i = 0; i < (programSize / 4); i++) {
-            if ((((uint32_t*) program)[i] & 0x7f) == 0x63) {
-                printf("Branch at address %x was taken %u times, was skipped %u times\n", i * 4,
-                       localBranchData[i].hasBeenTaken, localBranchData[i].hasBeenSkipped);
-                //	if(localBranchData[i].hasBeenTaken) printf(" taken");
-                // if(localBranchData[i].hasBeenSkipped) printf(" skipped");
-                // printf("\n");
-            }
-        }
+        // Counted per process, so the same new edge found by two of them counts twice
+        printf("Covered %u of the %u edge map entries, %lu runs found new edges and %lu more new hit counts\n",
+               coverageEdgeCount(&coverage), COVERAGE_MAP_SIZE, totalNewEdges, totalNewCounts);
+        printf("The CPU processes shared a corpus of %lu inputs over %lu syncs, which sent %lu bytes\n",
+               totalCorpusSize, totalSyncs, totalSyncBytes);
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
@@ -1275,15 +2867,15 @@ int main(int argc, char** argv) {
         cudaFree(deviceProgramImage);
         cudaFree(deviceMemoryImage);
         cudaFree(deviceResultImage);
-        cudaFree(deviceBranchDataImage);
-    } else if (spareMemory != nullptr) {
-        free(spareMemory);
+        cudaFree(deviceCoverage);
+    } else if (microOps != nullptr) {
+        free(microOps);
+        syncFree(&sync);
     }
 
-    free(memory);
-    free(program);
-    free(localResults);
-    free(localBranchData);
+    programClose(&image);
+    corpusFree(&corpus);
+    arenaFree(&arena);
 
     MPI_Finalize();
 
@@ -0,0 +1,85 @@
+#include <climits>
+#include <cstdlib>
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "backends/Arena.hpp"
+#include "spdlog/spdlog.h"
+
+namespace {
+    // Nodes mbind() gets told about, any machine we run on has fewer
+    constexpr std::size_t MAX_NODES = 1024;
+
+    // Asks for range's pages to come from node when they're first touched, without libnuma. Only a preference, when the
+    // node runs out they come from another one instead of failing.
+    void preferNode(void* range, const std::size_t size, const int node) {
+        constexpr auto BITS = sizeof(unsigned long) * CHAR_BIT;
+        unsigned long mask[MAX_NODES / BITS]{};
+        if (node < 0 || static_cast<std::size_t>(node) >= MAX_NODES) {
+            return;
+        }
+        mask[node / BITS] = 1ul << (node % BITS);
+        // The kernel only looks at maxnode - 1 of the bits
+        if (syscall(SYS_mbind, range, size, MPOL_PREFERRED, mask, MAX_NODES + 1, 0) != 0) {
+            spdlog::debug("Couldn't put an arena on node {}, its pages go wherever they're touched first.", node);
+        }
+    }
+} // namespace
+
+Arena::Arena() {
+    unsigned cpu;
+    unsigned node;
+    numaNode = getcpu(&cpu, &node) == 0 ? static_cast<int>(node) : -1;
+}
+
+Arena::~Arena() {
+    for (const auto& chunk : chunks) {
+        munmap(chunk.base, chunk.size);
+    }
+}
+
+void* Arena::allocate(const std::size_t size, const std::size_t alignment) {
+    if (!chunks.empty()) {
+        const auto& chunk = chunks.back();
+        const auto start  = (used + alignment - 1) & ~(alignment - 1);
+        if (start <= chunk.size && size <= chunk.size - start) {
+            used = start + size;
+            return chunk.base + start;
+        }
+    }
+
+    // Chunks start on a huge page, whatever fits in one fits at the start of a new one
+    grow(size);
+    used = size;
+    return chunks.back().base;
+}
+
+void Arena::grow(const std::size_t size) {
+    const auto chunkSize = std::max(CHUNK_SIZE, (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+
+    // mmap only lines mappings up with small pages. Mapping a huge page more and trimming the ends lines it up with a
+    // big one, which the kernel needs to back it with huge pages at all.
+    void* mapping =
+            mmap(nullptr, chunkSize + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        spdlog::error("Couldn't allocate {} bytes for an arena.", chunkSize);
+        exit(EXIT_FAILURE);
+    }
+    const auto start   = reinterpret_cast<std::uintptr_t>(mapping);
+    const auto aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    if (aligned != start) {
+        munmap(mapping, aligned - start);
+    }
+    munmap(reinterpret_cast<void*>(aligned + chunkSize), start + HUGE_PAGE_SIZE - aligned);
+
+    // Neither is more than a hint, nothing has been touched yet so both still apply to every page
+    auto* base = reinterpret_cast<std::uint8_t*>(aligned);
+    madvise(base, chunkSize, MADV_HUGEPAGE);
+    preferNode(base, chunkSize, numaNode);
+
+    chunks.push_back({base, chunkSize});
+}
@@ -1,403 +1,492 @@
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 
 #include "backends/ClassicalBackend.hpp"
 
-// An interpreter-based backend
+namespace {
+    // Where a PER_BLOCK segment ends. Fused calls and compares aren't, the jump or branch after them is.
+    bool endsSegment(const MicroOpHandler handler) {
+        switch (handler) {
+            case MicroOpHandler::JAL:
+            case MicroOpHandler::J:
+            case MicroOpHandler::JALR:
+            case MicroOpHandler::JR:
+            case MicroOpHandler::BEQ:
+            case MicroOpHandler::BNE:
+            case MicroOpHandler::BLT:
+            case MicroOpHandler::BGE:
+            case MicroOpHandler::BLTU:
+            case MicroOpHandler::BGEU:
+            case MicroOpHandler::ECALL:
+            case MicroOpHandler::ILLEGAL: {
+                return true;
+            }
+            default: {
+                return false;
+            }
+        }
+    }
+} // namespace
 
-void runInstruction(State& state, std::uint32_t inst, uint8_t* memory) {
-    // Step 1: Figure out instruction length
-    // Instructions come in 16 bit increments
-    // 16 bit: lowest two bits != 11
-    // 32 bit: lowest two bits == 11, next three bits != 111
-    // 48 bit: ends in 011111
-    // 64 bit: ends in 0111111
-    // Larger size instructions don't need to be supported, but they
-    // all end in some amount of 1s and have other features
-    // Note that this means instruction of all 0s is ILLEGAL
-    // All 1s is also ILLEGAL
+// An interpreter-based backend
+//
+// The program is decoded into micro-ops once, when the backend is built (see MicroOp.hpp), and run() executes them with
+// direct threading: every handler ends by jumping straight to the handler of the next micro-op through a table of label
+// addresses. That's a GNU extension, but GCC and Clang both have it. Compared to a single switch in a loop, every
+// handler gets its own indirect jump, so the branch predictor can learn "what usually comes after a BNE" separately
+// from "what usually comes after an ADDI".
+//
+// Tracing, coverage, comparison logging, bounds checks and instruction counting all hang off the Policy template
+// parameter and are if constexpr'd away when off, so ClassicalBackend<ProductionPolicy> is just the handlers and the
+// jumps.
+//
+// Loads and stores go through the TLB of the PagedMemory. A hit is inlined into the handler, only a miss (a different
+// page than the last access) calls out.
 
-    // Since we're gonna be doing RV32 only, we're only gonna support
-    // the 32 and 16 bit instructions
-    // Because of this, I'm electing to always just load 32 bits
-    // when reading for the next instruction. Note also that these 16 bit
-    // instructions will break alignment. But yeah, we do have to be careful
-    // that we don't read out of bounds when reading literally the last instruction
-    // if it happens to be 16 bits. Therefore, so that we can always read 32 bits,
-    // it makes sense to pad the program if the last instruction is 16 bits.
+template <typename Policy>
+ClassicalBackend<Policy>::ClassicalBackend(std::shared_ptr<const PageImage> image, State state,
+                                           std::size_t programSize, std::uint64_t instructionLimit)
+    : AbstractMachineBackend(image->data(), state, programSize), microOps(decodeProgram(program, programSize)),
+      initialState(state), pagedMemory(std::move(image)),
+      guestSystem(1, pagedMemory.pageImage().end(), GUEST_ADDRESS_SPACE - GUEST_STACK_SIZE),
+      instructionLimit(instructionLimit) {
+    if constexpr (Policy::RECORD_COVERAGE) {
+        coverage.resize(COVERAGE_MAP_SIZE);
+    }
+    if constexpr (Policy::RECORD_COMPARISONS) {
+        comparisonLog.reserve(MAX_COMPARISONS);
+    }
+    if constexpr (Policy::COUNT_INSTRUCTIONS == InstructionCounting::PER_BLOCK) {
+        // Backwards from the sentinel, which costs nothing
+        segmentCosts.resize(microOps.size());
+        for (auto i = numberOfInstructions; i-- > 0;) {
+            segmentCosts[i] = endsSegment(microOps[i].handler) ? 1 : 1 + segmentCosts[i + 1];
+        }
+    }
+}
 
-    // Since we're emulating, we can't use the same hardware optimizations that the ISA
-    // was designed to make easy (I think) because we get all the bits from the memory
-    // load at the same time.
+template <typename Policy>
+void ClassicalBackend<Policy>::reset() {
+    pagedMemory.reset();
+    state = initialState;
+}
 
-    // Normally this is the destination register, but in S and B type instructions
-    // where there is not destination register these same bits communicate parts of an immediate
-    // value. We always need to look at these bits as a unit no matter what
-    const auto rd = (inst >> 7) & 0x1f; // Bits 11 to 7
+template <typename Policy>
+void ClassicalBackend<Policy>::run() {
+    // Must be in the same order as MicroOpHandler
+    static void* const DISPATCH_TABLE[] = {
+            &&lui,          &&auipc, &&jal,  &&j,      &&jalr,   &&jr,     &&beq,    &&bne,
+            &&blt,          &&bge,   &&bltu, &&bgeu,   &&lb,     &&lh,     &&lw,     &&lbu,
+            &&lhu,          &&sb,    &&sh,   &&sw,     &&addi,   &&slti,   &&sltiu,  &&xori,
+            &&ori,          &&andi,  &&slli, &&srli,   &&srai,   &&add,    &&sub,    &&sll,
+            &&slt,          &&sltu,  &&xor_, &&srl,    &&sra,    &&or_,    &&and_,   &&nop,
+            &&ecall,        &&li,    &&call, &&lbuBeq, &&lbuBne, &&addiSw, &&lwAddi, &&illegal,
+            &&outOfProgram,
+    };
+    static_assert(sizeof(DISPATCH_TABLE) / sizeof(DISPATCH_TABLE[0]) ==
+                  static_cast<std::size_t>(MicroOpHandler::HANDLER_COUNT));
 
-    const auto opcode = inst & 0x7f;
+    const MicroOp* const microOpBase = microOps.data();
+    MachineWord* const x             = state.x;
 
-    switch (opcode) {
-        case 0x37: // lui
-        {
-            // We don't need to load it into low bits, then reshift it into high bits... can just read the bits in
-            // place! Lower bits are filled with zeros according to standard
-            state.x[rd] = inst & 0xfffff000;
-            state.pc += 4;
-            break;
-        }
-        case 0x17: // auipc
-        {
-            // Mirrors the above, but result is imm + offset from pc
-            state.x[rd] = state.pc + (inst & 0xfffff000);
-            state.pc += 4;
-            break;
-        }
-        case 0x6f: // jal
-        {
-            // This part seems like it would be much nicer in hardware...
-            // The bit order is very strange, [20|10:1|11|19:12]
-            // so 31 -> 20 == 11, 30 -> 10 == 20, 20 -> 11 == 9, 19 -> 19 == 0
-            // Since right shift doing sign extension is implementation dependent, and
-            // this wants sign extension, we do it manually...
-            // also, yes, this is correct -- it doesn't set lsb
-            std::uint32_t imm = ((inst & (1u << 31)) >> 11) | ((inst & 0x7fe00000) >> 20) | ((inst & 0x00100000) >> 9) |
-                                (inst & 0x000ff000);
-            state.x[rd] = state.pc + 4;
-            // Two cases: either our machine does sign extension and this is redundant, or it defaults to 0 extension
-            // and we need this No machine will default to 1 extension so we're all good
-            if (inst & (1u << 31)) {
-                imm |= 0xffe00000;
-            }
-            state.pc += imm;
-            break;
+    // Turns a pc into the micro-op to continue at. Anything that isn't the start of an instruction in the program
+    // lands on the sentinel.
+    const auto microOpAt = [&](const MachineWord pc) {
+        if (pc % 4 != 0 || pc / 4 >= numberOfInstructions) {
+            return microOpBase + numberOfInstructions;
         }
-        case 0x67: // jalr
-        {
-            // This wants us to use a temporary in case the destination register and source register are the same
-            std::uint32_t rs1  = (inst >> 15) & 0x1f;
-            std::uint32_t temp = state.pc + 4;
-            // Oh yeah we have to sign this one again, but bits are nicer, [11:0], so 31 -> 11 == 20
-            std::uint32_t imm = (inst >> 20);
-            if (inst & (1u << 31)) {
-                imm |= 0xfffff000;
-            }
-            state.pc    = (state.x[rs1] + imm) & ~1;
-            state.x[rd] = temp;
-            break;
-        }
-        case 0x63: // beq, bne, blt, bge, bltu, bgeu
-        {
-            std::uint32_t rs1 = (inst >> 15) & 0x1f;
-            std::uint32_t rs2 = (inst >> 20) & 0x1f;
-            // The immediate for jump offset is cursed again, high bits are [12|10:5] and then rd has [4:1|11]
-            // 31 -> 12 == 19, 30 -> 10 == 20, 4 -> 4 == 0, 0 -> 11 == -11
-            // we have to sign extend again as well
-            std::uint32_t imm =
-                    ((inst & (1u << 31)) >> 19) | ((inst & 0x7e000000) >> 20) | (rd & 0x1e) | ((rd & 0x1) << 11);
-            if (inst & (1u << 31)) {
-                imm |= 0xffffe000;
-            }
-            // funct3 (bits 14:12) determines which of the comparisons to do
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // beq
-                {
-                    if (state.x[rs1] == state.x[rs2]) {
-                        state.pc += imm;
-                    }
-                    break;
-                }
-                case 0x1: // bne
-                {
-                    if (state.x[rs1] != state.x[rs2]) {
-                        state.pc += imm;
-                    }
-                    break;
-                }
-                case 0x4: // blt (this is signed)
-                {
-                    if (static_cast<int32_t>(state.x[rs1]) < static_cast<int32_t>(state.x[rs2])) {
-                        state.pc += imm;
-                    }
-                    break;
-                }
-                case 0x5: // bge (this is signed)
-                {
-                    if (static_cast<int32_t>(state.x[rs1]) >= static_cast<int32_t>(state.x[rs2])) {
-                        state.pc += imm;
-                    }
-                    break;
-                }
-                case 0x6: // bltu (this is unsigned)
-                {
-                    if (static_cast<std::uint32_t>(state.x[rs1]) < static_cast<std::uint32_t>(state.x[rs2])) {
-                        state.pc += imm;
-                    }
-                    break;
-                }
-                case 0x7: // bgeu (this is unsigned)
-                {
-                    if (static_cast<std::uint32_t>(state.x[rs1]) >= static_cast<std::uint32_t>(state.x[rs2])) {
-                        state.pc += imm;
-                    }
-                    break;
-                }
-                    // TODO: handle if it isn't one of these? Set trap maybe?
-            }
-            state.pc += 4;
-            break;
-        }
-        case 0x03: // lb, lh, lw, lbu, lhu
-        {
-            std::uint32_t rs1 = (inst >> 15) & 0x1f;
-            // Same format as jalr
-            std::uint32_t imm = (inst >> 20);
-            if (inst & (1u << 31)) {
-                imm |= 0xfffff000;
-            }
-            // funct3 again
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // lb
-                {
-                    uint8_t loaded = *(memory + (state.x[rs1] + imm));
-                    state.x[rd]    = (loaded & (1u << 7)) ? loaded | 0xffffff00 : loaded;
-                    break;
-                }
-                case 0x1: // lh
-                {
-                    uint16_t loaded = *reinterpret_cast<uint16_t*>(memory + (state.x[rs1] + imm));
-                    state.x[rd]     = (loaded & (1u << 15)) ? loaded | 0xffff0000 : loaded;
-                    break;
-                }
-                case 0x2: // lw
-                {
-                    state.x[rd] = *reinterpret_cast<std::uint32_t*>(memory + (state.x[rs1] + imm));
-                    break;
-                }
-                case 0x4: // lbu
-                {
-                    uint8_t loaded = *(memory + (state.x[rs1] + imm));
-                    state.x[rd]    = loaded & 0x000000ff;
-                    break;
-                }
-                case 0x5: // lhu
-                {
-                    uint16_t loaded = *reinterpret_cast<uint16_t*>(memory + (state.x[rs1] + imm));
-                    state.x[rd]     = loaded & 0x0000ffff;
-                    break;
-                }
-                    // TODO: handle if it isn't one of these? Set trap maybe?
-            }
-            state.pc += 4;
-            break;
-        }
-        case 0x23: // sb, sh, sw
-        {
-            // In this one, we reuse rs1 as the memory location (well plus the immediate offset) and we use rs2 as the
-            // source This means the immediate is split up again
-            std::uint32_t rs1 = (inst >> 15) & 0x1f;
-            std::uint32_t rs2 = (inst >> 20) & 0x1f;
-            std::uint32_t imm = ((inst & 0xfe000000) >> 20) | rd;
-            if (inst & (1u << 31)) {
-                imm |= 0xfffff000;
-            }
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // sb
-                {
-                    *(memory + (state.x[rs1] + imm)) = state.x[rs2];
-                    break;
-                }
-                case 0x1: // sh
-                {
-                    *reinterpret_cast<uint16_t*>(memory + (state.x[rs1] + imm)) = state.x[rs2];
-                    break;
-                }
-                case 0x2: // sw
-                {
-                    *reinterpret_cast<std::uint32_t*>(memory + (state.x[rs1] + imm)) = state.x[rs2];
-                    break;
-                }
-                    // TODO: handle default?
-            }
-            state.pc += 4;
-            break;
-        }
-        case 0x13: // addi, slti, sltiu, xori, ori, andi, slli, srli, srai
-        {
-            std::uint32_t rs1 = (inst >> 15) & 0x1f;
-            std::uint32_t imm = (inst >> 20);
-            if (inst & (1u << 31)) {
-                imm |= 0xfffff000;
-            }
-            // funct3 again
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // addi
-                {
-                    state.x[rd] = state.x[rs1] + imm;
-                    break;
-                }
-                case 0x2: // slti
-                {
-                    // I'm pretty sure c standard says true statements always get set to 1 but just to make
-                    // it clear
-                    state.x[rd] = (static_cast<int32_t>(state.x[rs1]) < static_cast<int32_t>(imm)) ? 1 : 0;
-                    break;
-                }
-                case 0x3: // sltiu
-                {
-                    state.x[rd] = (static_cast<std::uint32_t>(state.x[rs1]) < static_cast<std::uint32_t>(imm)) ? 1 : 0;
-                    break;
-                }
-                case 0x4: // xori
-                {
-                    state.x[rd] = state.x[rs1] ^ imm;
-                    break;
-                }
-                case 0x6: // ori
-                {
-                    state.x[rd] = state.x[rs1] | imm;
-                    break;
-                }
-                case 0x7: // andi
-                {
-                    state.x[rd] = state.x[rs1] & imm;
-                    break;
-                }
-                case 0x1: // slli
-                {
-                    // TODO: these instructions only use the lowest 5 bits of imm, and
-                    // the standard says the high bits are all 0 (or 1 of them is 1 for srai)
-                    // I assume it should be illegal operation if that's not the case?
-                    state.x[rd] = state.x[rs1] << (imm & 0x1f);
-                    break;
-                }
-                case 0x5: // srli, srai are differentiated by a 1 in the 30th bit
-                {
-                    std::uint32_t shamt = imm & 0x1f;
-                    if (inst & (1u << 30)) {
-                        state.x[rd] = static_cast<int32_t>(state.x[rs1]) >> shamt;
-                        if ((state.x[rs1] & (1u << 31)) && shamt) {
-                            // Bit shifts by 32 are undefined by c standard so we actually can't use this which is
-                            // extremely cringe because it won't work on 0 shift... so we just special case it.
-                            state.x[rd] |= ~0 << (32 - shamt);
-                        }
-                    } else {
-                        // Don't do sign extension (don't need to do anything special here)
-                        state.x[rd] = static_cast<std::uint32_t>(state.x[rs1]) >> shamt;
-                    }
-                    break;
-                }
-            }
-            state.pc += 4;
-            break;
-        }
-        case 0x33: // add, sub, sll, slt, sltu, xor, srl, sra, or, and
-        {
-            const auto rs1 = (inst >> 15) & 0x1f;
-            const auto rs2 = (inst >> 20) & 0x1f;
-            switch ((inst >> 12) & 0x7) {
-                case 0x0: // add, sub are differentiated again by funct7 (only 1 bit of it tho), inst bit 30
-                {
-                    // Oh and arithmetic overflow is ignored (aka we don't care, and you know what, just use what our
-                    // implementation does) This isn't 122
-                    if (inst & (1u << 30)) // add
-                    {
-                        state.x[rd] = state.x[rs1] + state.x[rs2];
-                    } else // sub
-                    {
-                        state.x[rd] = state.x[rs1] - state.x[rs2];
-                    }
-                    break;
-                }
-                case 0x1: // sll
-                {
-                    // This only cares about the lower 5 bits
-                    state.x[rd] = state.x[rs1] << (state.x[rs2] & 0x1f);
-                    break;
-                }
-                case 0x2: // slt
-                {
-                    state.x[rd] = (static_cast<int32_t>(state.x[rs1]) < static_cast<int32_t>(state.x[rs2])) ? 1 : 0;
-                    break;
-                }
-                case 0x3: // sltu
-                {
-                    state.x[rd] = (static_cast<std::uint32_t>(state.x[rs1]) < static_cast<std::uint32_t>(state.x[rs2]))
-                                          ? 1
-                                          : 0;
-                    break;
-                }
-                case 0x4: // xor
-                {
-                    state.x[rd] = state.x[rs1] ^ state.x[rs2];
-                    break;
-                }
-                case 0x5: // srl, sra
-                {
-                    std::uint32_t shamt = state.x[rs2] & 0x1f;
-                    if (inst & (1u << 30)) {
-                        state.x[rd] = static_cast<int32_t>(state.x[rs1]) >> shamt;
-                        if (state.x[rs1] & (1u << 31) && shamt) {
-                            state.x[rd] |= ~0 << (32 - shamt);
-                        }
-                    } else {
-                        state.x[rd] = static_cast<std::uint32_t>(state.x[rs1]) >> shamt;
-                    }
-                    break;
-                }
-                case 0x6: // or
-                {
-                    state.x[rd] = state.x[rs1] | state.x[rs2];
-                    break;
-                }
-                case 0x7: // and
-                {
-                    state.x[rd] = state.x[rs1] & state.x[rs2];
-                    break;
-                }
-            }
-            state.pc += 4;
-            break;
-        }
-        case 0x0f: // fence, fence.i
-        {
-            // TODO: do something other than nop?
-            state.pc += 4;
-            break;
+        return microOpBase + pc / 4;
+    };
+
+    const MicroOp* op = microOpAt(state.pc);
+
+    [[maybe_unused]] std::uint64_t count{};
+    [[maybe_unused]] std::uint32_t previousLocation{};
+    if constexpr (Policy::RECORD_COVERAGE) {
+        std::ranges::fill(coverage, 0);
+    }
+    result = ExecutionResult{};
+    comparisonLog.clear();
+    guestSystem.reset();
+
+    // DebugPolicy's trace, as it's always been: every instruction's raw word, then the pc it left for.
+    // Superinstructions print both of theirs, the first of the two never jumps anywhere.
+    [[maybe_unused]] bool traced = false;
+    [[maybe_unused]] const auto trace = [&](const MicroOp* next) {
+        const auto pc = static_cast<MachineWord>((next - microOpBase) * 4);
+        if (traced) {
+            printf("pc = %x\n", pc);
         }
-        case 0x73: // ecall, ebreak, csrrw, csrrs, csrrc, csrrwi, csrrsi, csrrci
-        {
-            // TODO: do something other than nop?
-            state.pc += 4;
-            break;
+        traced = true;
+        if (next->handler == MicroOpHandler::OUT_OF_PROGRAM) {
+            return;
         }
-        default: {
-            std::cerr << "Encountered unknown opcode!" << std::endl;
+        printf("executing raw: %x\n", *reinterpret_cast<const std::uint32_t*>(program + pc));
+        if (isSuperinstruction(next->handler)) {
+            printf("pc = %x\n", pc + 4);
+            printf("executing raw: %x\n", *reinterpret_cast<const std::uint32_t*>(program + pc + 4));
         }
-    }
+    };
+
+
+#define DISPATCH()                                                                                                     \
+    do {                                                                                                               \
+        if constexpr (Policy::COUNT_INSTRUCTIONS == InstructionCounting::EXACT) {                                      \
+            if (++count > instructionLimit) {                                                                          \
+                goto instructionLimitReached;                                                                          \
+            }                                                                                                          \
+        }                                                                                                              \
+        if constexpr (Policy::TRACE) {                                                                                 \
+            trace(op);                                                                                                 \
+        }                                                                                                              \
+        goto* DISPATCH_TABLE[static_cast<std::size_t>(op->handler)];                                                   \
+    } while (false)
+
+// A superinstruction retires two instructions for one dispatch
+#define COUNT_FUSED()                                                                                                  \
+    do {                                                                                                               \
+        if constexpr (Policy::COUNT_INSTRUCTIONS == InstructionCounting::EXACT) {                                      \
+            ++count;                                                                                                   \
+        }                                                                                                              \
+    } while (false)
+
+// Control just landed on op, PER_BLOCK pays for everything up to the next control transfer now
+#define CHARGE()                                                                                                       \
+    do {                                                                                                               \
+        if constexpr (Policy::COUNT_INSTRUCTIONS == InstructionCounting::PER_BLOCK) {                                  \
+            count += segmentCosts[op - microOpBase];                                                                   \
+            if (count > instructionLimit) {                                                                            \
+                goto instructionLimitReached;                                                                          \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+
+// A jump, call, return or branch (taken or not) just landed on op: an edge for the coverage map, then CHARGE()
+#define JUMPED()                                                                                                       \
+    do {                                                                                                               \
+        if constexpr (Policy::RECORD_COVERAGE) {                                                                       \
+            const auto location = coverageLocation(static_cast<MachineWord>((op - microOpBase) * 4));                  \
+            ++coverage[location ^ previousLocation];                                                                   \
+            previousLocation = location >> 1;                                                                          \
+        }                                                                                                              \
+        CHARGE();                                                                                                      \
+    } while (false)
+
+// Guest addresses are relative to memory, which starts with the program image and has the MEMORY_SIZE bytes after it.
+// T says how wide the access is, and whether a load sign-extends. Unchecked, an access outside the address space reads
+// zeros or goes nowhere.
+#define LOAD(T, destination, address)                                                                                  \
+    do {                                                                                                               \
+        T value_;                                                                                                      \
+        if (!pagedMemory.load<T>((address), value_)) {                                                                 \
+            if constexpr (Policy::BOUNDS_CHECK == BoundsCheckMode::CHECKED) {                                          \
+                goto outOfBounds;                                                                                      \
+            }                                                                                                          \
+        }                                                                                                              \
+        (destination) = static_cast<MachineWord>(value_);                                                              \
+    } while (false)
+
+#define STORE(T, address, value)                                                                                       \
+    do {                                                                                                               \
+        if (!pagedMemory.store<T>((address), static_cast<T>(value))) {                                                 \
+            if constexpr (Policy::BOUNDS_CHECK == BoundsCheckMode::CHECKED) {                                          \
+                goto outOfBounds;                                                                                      \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+
+// offset is 0 for a plain branch and 1 for the fused ones, where the branch is the second instruction of the pair.
+// Fusing leaves that one alone, so it still says which registers the branch compares.
+#define BRANCH(condition, offset)                                                                                      \
+    do {                                                                                                               \
+        const bool taken = (condition);                                                                                \
+        if constexpr (Policy::RECORD_COMPARISONS) {                                                                    \
+            const auto& branch = op[(offset)];                                                                         \
+            if (x[branch.rs1] != x[branch.rs2] && comparisonLog.size() < MAX_COMPARISONS) {                            \
+                comparisonLog.push_back({static_cast<MachineWord>((op - microOpBase + (offset)) * 4), x[branch.rs1],   \
+                                         x[branch.rs2]});                                                              \
+            }                                                                                                          \
+        }                                                                                                              \
+        op = taken ? microOpBase + op->target : op + 1 + (offset);                                                     \
+        JUMPED();                                                                                                      \
+    } while (false)
+
+    CHARGE();
+    DISPATCH();
 
-    // We could have written to 0, so just put it back to 0
-    if (rd == 0) {
-        state.x[rd] = 0;
+lui:
+    // Both of these were folded into the immediate at decode time
+auipc:
+    x[op->rd] = op->imm;
+    ++op;
+    DISPATCH();
+jal:
+    x[op->rd] = op->imm;
+j:
+    op = microOpBase + op->target;
+    JUMPED();
+    DISPATCH();
+jalr:
+jr: {
+    // The destination has to be computed before the link is written, rd and rs1 may be the same register
+    const MachineWord destination = (x[op->rs1] + op->imm) & ~1u;
+    if (op->handler == MicroOpHandler::JALR) {
+        x[op->rd] = op->target;
     }
+    if (destination == DONE_ADDRESS) {
+        state.pc = DONE_ADDRESS;
+        goto done;
+    }
+    op = microOpAt(destination);
+    JUMPED();
+    DISPATCH();
+}
+beq:
+    BRANCH(x[op->rs1] == x[op->rs2], 0);
+    DISPATCH();
+bne:
+    BRANCH(x[op->rs1] != x[op->rs2], 0);
+    DISPATCH();
+blt:
+    BRANCH(static_cast<std::int32_t>(x[op->rs1]) < static_cast<std::int32_t>(x[op->rs2]), 0);
+    DISPATCH();
+bge:
+    BRANCH(static_cast<std::int32_t>(x[op->rs1]) >= static_cast<std::int32_t>(x[op->rs2]), 0);
+    DISPATCH();
+bltu:
+    BRANCH(x[op->rs1] < x[op->rs2], 0);
+    DISPATCH();
+bgeu:
+    BRANCH(x[op->rs1] >= x[op->rs2], 0);
+    DISPATCH();
+lb:
+    LOAD(std::int8_t, x[op->rd], x[op->rs1] + op->imm);
+    ++op;
+    DISPATCH();
+lh:
+    LOAD(std::int16_t, x[op->rd], x[op->rs1] + op->imm);
+    ++op;
+    DISPATCH();
+lw:
+    LOAD(std::uint32_t, x[op->rd], x[op->rs1] + op->imm);
+    ++op;
+    DISPATCH();
+lbu:
+    LOAD(std::uint8_t, x[op->rd], x[op->rs1] + op->imm);
+    ++op;
+    DISPATCH();
+lhu:
+    LOAD(std::uint16_t, x[op->rd], x[op->rs1] + op->imm);
+    ++op;
+    DISPATCH();
+sb:
+    STORE(std::uint8_t, x[op->rs1] + op->imm, x[op->rs2]);
+    ++op;
+    DISPATCH();
+sh:
+    STORE(std::uint16_t, x[op->rs1] + op->imm, x[op->rs2]);
+    ++op;
+    DISPATCH();
+sw:
+    STORE(std::uint32_t, x[op->rs1] + op->imm, x[op->rs2]);
+    ++op;
+    DISPATCH();
+addi:
+    x[op->rd] = x[op->rs1] + op->imm;
+    ++op;
+    DISPATCH();
+slti:
+    x[op->rd] = static_cast<std::int32_t>(x[op->rs1]) < static_cast<std::int32_t>(op->imm) ? 1 : 0;
+    ++op;
+    DISPATCH();
+sltiu:
+    x[op->rd] = x[op->rs1] < op->imm ? 1 : 0;
+    ++op;
+    DISPATCH();
+xori:
+    x[op->rd] = x[op->rs1] ^ op->imm;
+    ++op;
+    DISPATCH();
+ori:
+    x[op->rd] = x[op->rs1] | op->imm;
+    ++op;
+    DISPATCH();
+andi:
+    x[op->rd] = x[op->rs1] & op->imm;
+    ++op;
+    DISPATCH();
+slli:
+    // The shift amount was already masked down to 5 bits when decoding
+    x[op->rd] = x[op->rs1] << op->imm;
+    ++op;
+    DISPATCH();
+srli:
+    x[op->rd] = x[op->rs1] >> op->imm;
+    ++op;
+    DISPATCH();
+srai:
+    // Since C++20, right shifts of negative numbers are arithmetic, so no more special-casing
+    x[op->rd] = static_cast<std::int32_t>(x[op->rs1]) >> op->imm;
+    ++op;
+    DISPATCH();
+add:
+    x[op->rd] = x[op->rs1] + x[op->rs2];
+    ++op;
+    DISPATCH();
+sub:
+    x[op->rd] = x[op->rs1] - x[op->rs2];
+    ++op;
+    DISPATCH();
+sll:
+    x[op->rd] = x[op->rs1] << (x[op->rs2] & 0x1f);
+    ++op;
+    DISPATCH();
+slt:
+    x[op->rd] = static_cast<std::int32_t>(x[op->rs1]) < static_cast<std::int32_t>(x[op->rs2]) ? 1 : 0;
+    ++op;
+    DISPATCH();
+sltu:
+    x[op->rd] = x[op->rs1] < x[op->rs2] ? 1 : 0;
+    ++op;
+    DISPATCH();
+xor_:
+    x[op->rd] = x[op->rs1] ^ x[op->rs2];
+    ++op;
+    DISPATCH();
+srl:
+    x[op->rd] = x[op->rs1] >> (x[op->rs2] & 0x1f);
+    ++op;
+    DISPATCH();
+sra:
+    x[op->rd] = static_cast<std::int32_t>(x[op->rs1]) >> (x[op->rs2] & 0x1f);
+    ++op;
+    DISPATCH();
+or_:
+    x[op->rd] = x[op->rs1] | x[op->rs2];
+    ++op;
+    DISPATCH();
+and_:
+    x[op->rd] = x[op->rs1] & x[op->rs2];
+    ++op;
+    DISPATCH();
+nop:
+    ++op;
+    DISPATCH();
+ecall: {
+    const auto [value, exit] = guestSystem.call(0, x[SYSCALL_NUMBER_REGISTER], x[10], x[11], x[12], pagedMemory, count);
+    x[SYSCALL_RESULT_REGISTER] = value;
+    if (exit) {
+        state.pc = DONE_ADDRESS;
+        goto done;
+    }
+    ++op;
+    CHARGE();
+    DISPATCH();
 }
 
-void ClassicalBackend::run() {
-    while (true) {
-        auto instruction = *reinterpret_cast<std::uint32_t*>(program + state.pc);
-        printf("executing raw: %x\n", instruction);
-        runInstruction(state, instruction, memory);
-        printf("pc = %x\n", state.pc);
-        if (state.pc == DONE_ADDRESS) {
-            break;
-        }
+    // Superinstructions. Each one does the work of two instructions, then skips over the second.
+li:
+    COUNT_FUSED();
+    x[op->rd] = op->imm;
+    op += 2;
+    DISPATCH();
+call:
+    COUNT_FUSED();
+    // The link register may be the same as the auipc destination (it usually is, ra), so write it second
+    x[op->rd]  = op->imm;
+    x[op->rs2] = (op - microOpBase + 2) * 4;
+    x[0]       = 0; // Tail calls link into x0
+    op         = microOpBase + op->target;
+    JUMPED();
+    DISPATCH();
+lbuBeq:
+    COUNT_FUSED();
+    LOAD(std::uint8_t, x[op->rd], x[op->rs1] + op->imm);
+    BRANCH(x[op->rd] == x[op->rs2], 1);
+    DISPATCH();
+lbuBne:
+    COUNT_FUSED();
+    LOAD(std::uint8_t, x[op->rd], x[op->rs1] + op->imm);
+    BRANCH(x[op->rd] != x[op->rs2], 1);
+    DISPATCH();
+addiSw:
+    COUNT_FUSED();
+    x[op->rd] = x[op->rs1] + op->imm;
+    STORE(std::uint32_t, x[op->rd] + op->target, x[op->rs2]);
+    op += 2;
+    DISPATCH();
+lwAddi:
+    COUNT_FUSED();
+    LOAD(std::uint32_t, x[op->rd], x[op->rs1] + op->imm);
+    x[op->rs1] += op->target;
+    op += 2;
+    DISPATCH();
+illegal:
+    if constexpr (Policy::TRACE) {
+        std::cerr << "Encountered unknown opcode!" << std::endl;
+    }
+    result.error = ExecutionError::ILLEGAL_INSTRUCTION;
+    state.pc     = (op - microOpBase) * 4;
+    goto done;
+outOfProgram:
+    if constexpr (Policy::TRACE) {
+        std::cerr << "Control left the program!" << std::endl;
+    }
+    result.error = ExecutionError::OUT_OF_PROGRAM;
+    state.pc     = (op - microOpBase) * 4;
+    goto done;
+[[maybe_unused]] outOfBounds:
+    if constexpr (Policy::TRACE) {
+        std::cerr << "Memory access out of bounds!" << std::endl;
+    }
+    result.error = ExecutionError::OUT_OF_BOUNDS;
+    state.pc     = (op - microOpBase) * 4;
+    goto done;
+[[maybe_unused]] instructionLimitReached:
+    if constexpr (Policy::TRACE) {
+        std::cerr << "Instruction limit reached!" << std::endl;
+    }
+    result.error = ExecutionError::INSTRUCTION_LIMIT;
+    state.pc     = (op - microOpBase) * 4;
+    if constexpr (Policy::COUNT_INSTRUCTIONS == InstructionCounting::PER_BLOCK) {
+        // The block that went over isn't run at all, report it the way EXACT does
+        count = instructionLimit + 1;
+    }
+    goto done;
+
+#undef BRANCH
+#undef JUMPED
+#undef CHARGE
+#undef COUNT_FUSED
+#undef LOAD
+#undef STORE
+#undef DISPATCH
+
+done:
+    result.returnValue = static_cast<std::int32_t>(x[10]);
+    if constexpr (Policy::COUNT_INSTRUCTIONS != InstructionCounting::NONE) {
+        result.instructionCount = count;
     }
 
-    std::uint32_t const BYTES_PER_LINE = 4 * 4;
-    for (std::uint32_t i = 0; i < MEMORY_SIZE; i += 4) {
-        if (i % BYTES_PER_LINE == 0) {
-            printf("\n");
+    if constexpr (Policy::TRACE) {
+        if (traced) {
+            printf("pc = %x\n", state.pc);
         }
-        printf("%08x ", *reinterpret_cast<std::uint32_t*>(memory + i));
+        std::uint32_t const BYTES_PER_LINE = 4 * 4;
+        // The MEMORY_SIZE bytes after the program image
+        for (std::uint32_t i = 0; i < MEMORY_SIZE; i += 4) {
+            if (i % BYTES_PER_LINE == 0) {
+                printf("\n");
+            }
+            std::uint32_t word;
+            pagedMemory.load(programSize + i, word);
+            printf("%08x ", word);
+        }
+        printf("\n");
     }
-    printf("\n");
 }
+
+template class ClassicalBackend<ProductionPolicy>;
+template class ClassicalBackend<DebugPolicy>;
+template class ClassicalBackend<CmpLogPolicy>;
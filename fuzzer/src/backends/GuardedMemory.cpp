@@ -0,0 +1,79 @@
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <mutex>
+
+#include <sys/mman.h>
+
+#include "backends/GuardedMemory.hpp"
+#include "spdlog/spdlog.h"
+
+namespace {
+    // Every live GuardedMemory, for the signal handler to search. It can't take a lock, so slots are claimed and
+    // released with compare-and-swap, and a slot is only ever read whole.
+    constexpr std::size_t MAX_RESERVATIONS = 256;
+    std::array<std::atomic<const GuardedMemory*>, MAX_RESERVATIONS> reservations{};
+
+    std::once_flag installed;
+    struct sigaction previous {};
+} // namespace
+
+GuardedMemory::GuardedMemory(const std::uint64_t size, const FaultHandler handler, void* owner)
+    : validSize((size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE), handler(handler), owner(owner) {
+    // MAP_NORESERVE, so a few of these don't count against the overcommit limit
+    void* mapping = mmap(nullptr, RESERVATION, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED || mprotect(mapping, validSize, PROT_READ | PROT_WRITE) != 0) {
+        spdlog::error("Couldn't reserve {} bytes of address space for guest memory.", RESERVATION);
+        exit(EXIT_FAILURE);
+    }
+    base = static_cast<std::uint8_t*>(mapping);
+
+    std::call_once(installed, [] {
+        struct sigaction action {};
+        action.sa_sigaction = onFault;
+        action.sa_flags     = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous);
+    });
+
+    for (auto& slot : reservations) {
+        const GuardedMemory* empty = nullptr;
+        if (slot.compare_exchange_strong(empty, this)) {
+            return;
+        }
+    }
+    spdlog::error("More than {} guarded guest memories at once.", MAX_RESERVATIONS);
+    exit(EXIT_FAILURE);
+}
+
+GuardedMemory::~GuardedMemory() {
+    for (auto& slot : reservations) {
+        const GuardedMemory* self = this;
+        if (slot.compare_exchange_strong(self, nullptr)) {
+            break;
+        }
+    }
+    munmap(base, RESERVATION);
+}
+
+void GuardedMemory::discard(const std::uint64_t from) {
+    if (from < validSize) {
+        madvise(base + from, validSize - from, MADV_DONTNEED);
+    }
+}
+
+void GuardedMemory::onFault(const int signal, siginfo_t* info, void* context) {
+    const auto address = reinterpret_cast<std::uintptr_t>(info->si_addr);
+    for (const auto& slot : reservations) {
+        const auto* memory = slot.load(std::memory_order_acquire);
+        if (memory && address - reinterpret_cast<std::uintptr_t>(memory->base) < RESERVATION &&
+            memory->handler(memory->owner, static_cast<ucontext_t*>(context))) {
+            return;
+        }
+    }
+
+    // Not a guest's. Put back whatever was handling these before (the default, most likely), which gets the fault when
+    // the instruction runs again.
+    sigaction(signal, &previous, nullptr);
+}
@@ -0,0 +1,24 @@
+#include "backends/GuestSystem.hpp"
+
+void GuestIO::flush(std::FILE* file) {
+    std::fwrite(output.data(), 1, output.size(), file);
+    output.clear();
+}
+
+GuestSystem::GuestSystem(const std::size_t instances, const MachineWord heapStart, const MachineWord heapLimit)
+    : instances(instances), heapStart(heapStart), heapLimit(heapLimit) {
+    reset();
+}
+
+void GuestSystem::reset() {
+    for (std::size_t instance = 0; instance < instances.size(); instance++) {
+        reset(instance);
+    }
+}
+
+void GuestSystem::reset(const std::size_t instance) {
+    auto& io = instances[instance];
+    io.output.clear();
+    io.inputPosition = 0;
+    io.programBreak  = heapStart;
+}
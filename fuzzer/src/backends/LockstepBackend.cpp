@@ -0,0 +1,462 @@
+#include <algorithm>
+
+#include "backends/LockstepBackend.hpp"
+
+// A portable multi-instance interpreter
+//
+// All lanes share one decoded program. Each step picks a group of lanes sitting at the same pc and runs that one
+// micro-op for the whole group: register operations are written as a loop over every lane with a select on the group
+// mask, so they come out as a handful of vector instructions. step() is built for AVX-512, AVX2 and plain x86-64, and
+// the dynamic loader picks the one the CPU can run, so the same binary works on every host. Loads and stores touch a
+// different address per lane and are done one lane at a time.
+//
+// Lanes that branch different ways split into groups by pc, and the group with the lowest pc always goes first. Lanes
+// that jumped ahead wait there for the others to catch up, which is usually where they'd have met again anyway (the
+// end of an if/else, the exit of a loop).
+//
+// A lane's result is written the moment it stops. Given a LaneRefill, run() hands it the lane right after that step,
+// so a lane that's done early starts on the next input instead of sitting out the rest of the batch.
+
+namespace {
+    constexpr MachineWord NO_PC = 0xffffffffu;
+} // namespace
+
+template <std::size_t LANES>
+LockstepBackend<LANES>::LockstepBackend(std::shared_ptr<const PageImage> image, State state,
+                                        std::size_t programSize, std::uint64_t instructionLimit, Arena* arena)
+    : AbstractMachineBackend(image->data(), state, programSize), microOps(decodeProgram(program, programSize)),
+      laneMemories(makeLaneMemories(image, arena)),
+      guestSystem(LANES, laneMemories[0].pageImage().end(), GUEST_ADDRESS_SPACE - GUEST_STACK_SIZE),
+      instructionLimit(instructionLimit) {
+    reset();
+}
+
+template <std::size_t LANES>
+std::vector<PagedMemory> LockstepBackend<LANES>::makeLaneMemories(const std::shared_ptr<const PageImage>& image,
+                                                                  Arena* arena) {
+    // Every lane reads the image's pages until it writes to them
+    std::vector<PagedMemory> memories;
+    memories.reserve(LANES);
+    for (std::size_t lane = 0; lane < LANES; lane++) {
+        memories.emplace_back(image, arena);
+    }
+    return memories;
+}
+
+template <std::size_t LANES>
+void LockstepBackend<LANES>::reset() {
+    for (std::size_t lane = 0; lane < LANES; lane++) {
+        resetLane(lane);
+    }
+}
+
+template <std::size_t LANES>
+void LockstepBackend<LANES>::resetLane(const std::size_t lane) {
+    laneMemories[lane].reset();
+    lanes.pc[lane] = state.pc;
+    for (auto reg = 0; reg < 32; reg++) {
+        lanes.x[reg][lane] = state.x[reg];
+    }
+    running[lane]     = 1;
+    counts[lane]      = 0;
+    laneResults[lane] = ExecutionResult{};
+    guestSystem.reset(lane);
+}
+
+template <std::size_t LANES>
+bool LockstepBackend<LANES>::writeInput(const std::size_t lane, const MachineWord address, const std::uint8_t* data,
+                                        const std::size_t size) {
+    return laneMemories[lane].write(address, data, size);
+}
+
+template <std::size_t LANES>
+void LockstepBackend<LANES>::stopLane(const std::size_t lane, const ExecutionError error) {
+    running[lane]                = 0;
+    activeMask[lane]             = 0;
+    laneResults[lane]            = {static_cast<std::int32_t>(lanes.x[10][lane]), error, counts[lane]};
+    stoppedLanes[stoppedCount++] = static_cast<std::uint8_t>(lane);
+}
+
+template <std::size_t LANES>
+void LockstepBackend<LANES>::run() {
+    run(nullptr);
+}
+
+template <std::size_t LANES>
+void LockstepBackend<LANES>::run(const LaneRefill& refill) {
+    auto& pc = lanes.pc;
+
+    while (true) {
+        MachineWord groupPc = NO_PC;
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            groupPc = std::min(groupPc, running[lane] ? pc[lane] : NO_PC);
+        }
+        if (groupPc == NO_PC) {
+            break;
+        }
+
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            activeMask[lane] = running[lane] & (pc[lane] == groupPc ? 1u : 0u);
+        }
+
+        // Anything that isn't the start of an instruction in the program lands on the sentinel
+        const auto index = groupPc % 4 != 0 || groupPc / 4 >= numberOfInstructions ? numberOfInstructions : groupPc / 4;
+        const auto& op   = microOps[index];
+
+        const std::uint64_t retired = isSuperinstruction(op.handler) ? 2 : 1;
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            counts[lane] += activeMask[lane] * retired;
+        }
+
+        step(op, groupPc);
+
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            if (running[lane] && counts[lane] > instructionLimit) {
+                stopLane(lane, ExecutionError::INSTRUCTION_LIMIT);
+            }
+        }
+
+        // A lane the refill starts over is running again, resetLane() saw to that
+        if (refill) {
+            for (std::size_t i = 0; i < stoppedCount; i++) {
+                refill(stoppedLanes[i], laneResults[stoppedLanes[i]]);
+            }
+        }
+        stoppedCount = 0;
+    }
+}
+
+template <std::size_t LANES>
+void LockstepBackend<LANES>::step(const MicroOp& op, const MachineWord groupPc) {
+    auto& x           = lanes.x;
+    auto& pc          = lanes.pc;
+    const auto& mask  = activeMask;
+    const auto target = op.target * 4;
+
+    // x[rd] = value(lane) in this group, every other lane keeps what it had
+    const auto write = [&](const std::uint8_t rd, const auto value) {
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            const MachineWord result = value(lane);
+            x[rd][lane]              = mask[lane] ? result : x[rd][lane];
+        }
+    };
+    const auto advance = [&](const MachineWord instructions) {
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            pc[lane] = mask[lane] ? groupPc + instructions * 4 : pc[lane];
+        }
+    };
+    const auto jump = [&](const MachineWord destination) {
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            pc[lane] = mask[lane] ? destination : pc[lane];
+        }
+    };
+    // instructions is how far the not-taken side moves, 2 for the fused compare-and-branch ops
+    const auto branch = [&](const auto condition, const MachineWord instructions) {
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            const MachineWord next = condition(lane) ? target : groupPc + instructions * 4;
+            pc[lane]               = mask[lane] ? next : pc[lane];
+        }
+    };
+
+    // Every lane goes through its own memory's TLB. An access outside the address space stops the lane, whatever the
+    // policy would be elsewhere. type is only there for its type: std::int8_t{} for lb, std::uint16_t{} for lhu and so
+    // on.
+    const auto load = [&](auto type, const std::uint8_t rd, const std::uint8_t base, const MachineWord offset) {
+        using T = decltype(type);
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            if (!mask[lane]) {
+                continue;
+            }
+            T value;
+            if (laneMemories[lane].load(x[base][lane] + offset, value)) {
+                x[rd][lane] = static_cast<MachineWord>(value); // Sign-extends when T is signed
+            } else {
+                stopLane(lane, ExecutionError::OUT_OF_BOUNDS);
+            }
+        }
+    };
+    const auto store = [&](auto type, const std::uint8_t source, const std::uint8_t base, const MachineWord offset) {
+        using T = decltype(type);
+        for (std::size_t lane = 0; lane < LANES; lane++) {
+            if (mask[lane] && !laneMemories[lane].store(x[base][lane] + offset, static_cast<T>(x[source][lane]))) {
+                stopLane(lane, ExecutionError::OUT_OF_BOUNDS);
+            }
+        }
+    };
+    const auto signedReg = [&](const std::uint8_t reg, const std::size_t lane) {
+        return static_cast<std::int32_t>(x[reg][lane]);
+    };
+
+    switch (op.handler) {
+        case MicroOpHandler::LUI:
+        case MicroOpHandler::AUIPC: {
+            write(op.rd, [&](std::size_t) { return op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::JAL: {
+            write(op.rd, [&](std::size_t) { return op.imm; });
+            jump(target);
+            break;
+        }
+        case MicroOpHandler::J: {
+            jump(target);
+            break;
+        }
+        case MicroOpHandler::JALR:
+        case MicroOpHandler::JR: {
+            for (std::size_t lane = 0; lane < LANES; lane++) {
+                if (!mask[lane]) {
+                    continue;
+                }
+                // The destination has to be computed before the link is written, rd and rs1 may be the same register
+                const MachineWord destination = (x[op.rs1][lane] + op.imm) & ~1u;
+                if (op.handler == MicroOpHandler::JALR) {
+                    x[op.rd][lane] = op.target;
+                }
+                pc[lane] = destination;
+                if (destination == DONE_ADDRESS) {
+                    stopLane(lane, ExecutionError::NONE);
+                }
+            }
+            break;
+        }
+        case MicroOpHandler::BEQ: {
+            branch([&](std::size_t lane) { return x[op.rs1][lane] == x[op.rs2][lane]; }, 1);
+            break;
+        }
+        case MicroOpHandler::BNE: {
+            branch([&](std::size_t lane) { return x[op.rs1][lane] != x[op.rs2][lane]; }, 1);
+            break;
+        }
+        case MicroOpHandler::BLT: {
+            branch([&](std::size_t lane) { return signedReg(op.rs1, lane) < signedReg(op.rs2, lane); }, 1);
+            break;
+        }
+        case MicroOpHandler::BGE: {
+            branch([&](std::size_t lane) { return signedReg(op.rs1, lane) >= signedReg(op.rs2, lane); }, 1);
+            break;
+        }
+        case MicroOpHandler::BLTU: {
+            branch([&](std::size_t lane) { return x[op.rs1][lane] < x[op.rs2][lane]; }, 1);
+            break;
+        }
+        case MicroOpHandler::BGEU: {
+            branch([&](std::size_t lane) { return x[op.rs1][lane] >= x[op.rs2][lane]; }, 1);
+            break;
+        }
+        case MicroOpHandler::LB: {
+            load(std::int8_t{}, op.rd, op.rs1, op.imm);
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::LH: {
+            load(std::int16_t{}, op.rd, op.rs1, op.imm);
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::LW: {
+            load(std::uint32_t{}, op.rd, op.rs1, op.imm);
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::LBU: {
+            load(std::uint8_t{}, op.rd, op.rs1, op.imm);
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::LHU: {
+            load(std::uint16_t{}, op.rd, op.rs1, op.imm);
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SB: {
+            store(std::uint8_t{}, op.rs2, op.rs1, op.imm);
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SH: {
+            store(std::uint16_t{}, op.rs2, op.rs1, op.imm);
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SW: {
+            store(std::uint32_t{}, op.rs2, op.rs1, op.imm);
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::ADDI: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] + op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SLTI: {
+            write(op.rd, [&](std::size_t lane) { return signedReg(op.rs1, lane) < static_cast<std::int32_t>(op.imm); });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SLTIU: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] < op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::XORI: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] ^ op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::ORI: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] | op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::ANDI: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] & op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SLLI: {
+            // The shift amount was already masked down to 5 bits when decoding
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] << op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SRLI: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] >> op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SRAI: {
+            write(op.rd, [&](std::size_t lane) { return signedReg(op.rs1, lane) >> op.imm; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::ADD: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] + x[op.rs2][lane]; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SUB: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] - x[op.rs2][lane]; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SLL: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] << (x[op.rs2][lane] & 0x1f); });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SLT: {
+            write(op.rd, [&](std::size_t lane) { return signedReg(op.rs1, lane) < signedReg(op.rs2, lane); });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SLTU: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] < x[op.rs2][lane]; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::XOR: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] ^ x[op.rs2][lane]; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SRL: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] >> (x[op.rs2][lane] & 0x1f); });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::SRA: {
+            write(op.rd, [&](std::size_t lane) { return signedReg(op.rs1, lane) >> (x[op.rs2][lane] & 0x1f); });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::OR: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] | x[op.rs2][lane]; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::AND: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] & x[op.rs2][lane]; });
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::NOP: {
+            advance(1);
+            break;
+        }
+        case MicroOpHandler::ECALL: {
+            // One lane at a time, like loads and stores
+            for (std::size_t lane = 0; lane < LANES; lane++) {
+                if (!mask[lane]) {
+                    continue;
+                }
+                const auto [value, exit] = guestSystem.call(lane, x[SYSCALL_NUMBER_REGISTER][lane], x[10][lane],
+                                                            x[11][lane], x[12][lane], laneMemories[lane], counts[lane]);
+                x[SYSCALL_RESULT_REGISTER][lane] = value;
+                pc[lane]                         = groupPc + 4;
+                if (exit) {
+                    pc[lane] = DONE_ADDRESS;
+                    stopLane(lane, ExecutionError::NONE);
+                }
+            }
+            break;
+        }
+
+        // Superinstructions, see MicroOpHandler for what the fields mean
+        case MicroOpHandler::LI: {
+            write(op.rd, [&](std::size_t) { return op.imm; });
+            advance(2);
+            break;
+        }
+        case MicroOpHandler::CALL: {
+            // The link register may be the same as the auipc destination (it usually is, ra), so write it second
+            write(op.rd, [&](std::size_t) { return op.imm; });
+            write(op.rs2, [&](std::size_t) { return groupPc + 8; });
+            std::fill_n(x[0], LANES, 0); // Tail calls link into x0
+            jump(target);
+            break;
+        }
+        case MicroOpHandler::LBU_BEQ: {
+            load(std::uint8_t{}, op.rd, op.rs1, op.imm);
+            branch([&](std::size_t lane) { return x[op.rd][lane] == x[op.rs2][lane]; }, 2);
+            break;
+        }
+        case MicroOpHandler::LBU_BNE: {
+            load(std::uint8_t{}, op.rd, op.rs1, op.imm);
+            branch([&](std::size_t lane) { return x[op.rd][lane] != x[op.rs2][lane]; }, 2);
+            break;
+        }
+        case MicroOpHandler::ADDI_SW: {
+            write(op.rd, [&](std::size_t lane) { return x[op.rs1][lane] + op.imm; });
+            store(std::uint32_t{}, op.rs2, op.rd, op.target);
+            advance(2);
+            break;
+        }
+        case MicroOpHandler::LW_ADDI: {
+            load(std::uint32_t{}, op.rd, op.rs1, op.imm);
+            write(op.rs1, [&](std::size_t lane) { return x[op.rs1][lane] + op.target; });
+            advance(2);
+            break;
+        }
+        case MicroOpHandler::OUT_OF_PROGRAM: {
+            for (std::size_t lane = 0; lane < LANES; lane++) {
+                if (mask[lane]) {
+                    stopLane(lane, ExecutionError::OUT_OF_PROGRAM);
+                }
+            }
+            break;
+        }
+        default: {
+            for (std::size_t lane = 0; lane < LANES; lane++) {
+                if (mask[lane]) {
+                    stopLane(lane, ExecutionError::ILLEGAL_INSTRUCTION);
+                }
+            }
+            break;
+        }
+    }
+}
+
+template class LockstepBackend<8>;
+template class LockstepBackend<16>;
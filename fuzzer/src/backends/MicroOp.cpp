@@ -0,0 +1,447 @@
+#include <cstring>
+
+#include "backends/GuestSystem.hpp"
+#include "backends/MicroOp.hpp"
+
+namespace {
+    MicroOp decodeInstruction(const Instruction instruction, const MachineWord pc, const std::size_t instructionCount) {
+        const auto opcode = static_cast<Opcode>(instruction.opcode());
+        const auto fn3    = instruction.funct3();
+
+        auto op = MicroOp{
+                .handler = MicroOpHandler::ILLEGAL,
+                .rd      = static_cast<std::uint8_t>(instruction.rd()),
+                .rs1     = static_cast<std::uint8_t>(instruction.rs1()),
+                .rs2     = static_cast<std::uint8_t>(instruction.rs2()),
+        };
+
+        // Static control transfers are resolved to micro-op indices here. Anything that would leave the program (or
+        // land in the middle of an instruction) goes to the sentinel instead.
+        const auto resolveTarget = [&](const MachineWord offset) -> MachineWord {
+            const auto destination = pc + offset;
+            if (destination % 4 != 0 || destination / 4 >= instructionCount) {
+                return instructionCount;
+            }
+            return destination / 4;
+        };
+
+        switch (opcode) {
+            case Opcode::LUI: {
+                op.handler = MicroOpHandler::LUI;
+                op.imm     = instruction.immU();
+                break;
+            }
+            case Opcode::AUIPC: {
+                op.handler = MicroOpHandler::AUIPC;
+                op.imm     = pc + instruction.immU();
+                break;
+            }
+            case Opcode::JAL: {
+                op.handler = op.rd == 0 ? MicroOpHandler::J : MicroOpHandler::JAL;
+                op.imm     = pc + 4;
+                op.target  = resolveTarget(instruction.immJ());
+                return op;
+            }
+            case Opcode::JALR: {
+                op.handler = op.rd == 0 ? MicroOpHandler::JR : MicroOpHandler::JALR;
+                op.imm     = instruction.imm();
+                op.target  = pc + 4;
+                return op;
+            }
+            case Opcode::BRANCH: {
+                static constexpr MicroOpHandler BRANCHES[8] = {
+                        MicroOpHandler::BEQ,     MicroOpHandler::BNE, MicroOpHandler::ILLEGAL, MicroOpHandler::ILLEGAL,
+                        MicroOpHandler::BLT,     MicroOpHandler::BGE, MicroOpHandler::BLTU,    MicroOpHandler::BGEU,
+                };
+                op.handler = BRANCHES[fn3];
+                op.imm     = instruction.immB();
+                op.target  = resolveTarget(op.imm);
+                return op;
+            }
+            case Opcode::LOAD: {
+                static constexpr MicroOpHandler LOADS[8] = {
+                        MicroOpHandler::LB,  MicroOpHandler::LH,  MicroOpHandler::LW,      MicroOpHandler::ILLEGAL,
+                        MicroOpHandler::LBU, MicroOpHandler::LHU, MicroOpHandler::ILLEGAL, MicroOpHandler::ILLEGAL,
+                };
+                op.handler = LOADS[fn3];
+                op.imm     = instruction.imm();
+                break;
+            }
+            case Opcode::STORE: {
+                static constexpr MicroOpHandler STORES[8] = {
+                        MicroOpHandler::SB,      MicroOpHandler::SH,      MicroOpHandler::SW,
+                        MicroOpHandler::ILLEGAL, MicroOpHandler::ILLEGAL, MicroOpHandler::ILLEGAL,
+                        MicroOpHandler::ILLEGAL, MicroOpHandler::ILLEGAL,
+                };
+                op.handler = STORES[fn3];
+                op.imm     = instruction.immS();
+                return op; // No rd, the bits are part of the immediate
+            }
+            case Opcode::IMM: {
+                static constexpr MicroOpHandler IMMS[8] = {
+                        MicroOpHandler::ADDI, MicroOpHandler::SLLI, MicroOpHandler::SLTI, MicroOpHandler::SLTIU,
+                        MicroOpHandler::XORI, MicroOpHandler::SRLI, MicroOpHandler::ORI,  MicroOpHandler::ANDI,
+                };
+                op.handler = IMMS[fn3];
+                op.imm     = instruction.imm();
+                if (op.handler == MicroOpHandler::SRLI && instruction.isSecondHighestBitSet()) {
+                    op.handler = MicroOpHandler::SRAI;
+                }
+                if (op.handler == MicroOpHandler::SLLI || op.handler == MicroOpHandler::SRLI ||
+                    op.handler == MicroOpHandler::SRAI) {
+                    op.imm &= 0x1f;
+                }
+                break;
+            }
+            case Opcode::ARITH: {
+                static constexpr MicroOpHandler ARITHS[8] = {
+                        MicroOpHandler::ADD, MicroOpHandler::SLL, MicroOpHandler::SLT, MicroOpHandler::SLTU,
+                        MicroOpHandler::XOR, MicroOpHandler::SRL, MicroOpHandler::OR,  MicroOpHandler::AND,
+                };
+                op.handler = ARITHS[fn3];
+                if (instruction.isSecondHighestBitSet()) {
+                    if (op.handler == MicroOpHandler::ADD) {
+                        op.handler = MicroOpHandler::SUB;
+                    } else if (op.handler == MicroOpHandler::SRL) {
+                        op.handler = MicroOpHandler::SRA;
+                    }
+                }
+                break;
+            }
+            case Opcode::MEMORY: {
+                op.handler = MicroOpHandler::NOP;
+                return op;
+            }
+            case Opcode::SYSCALL: {
+                // Only ecall does anything, ebreak and the csr instructions are nops
+                op.handler = instruction.raw == 0x00000073 ? MicroOpHandler::ECALL : MicroOpHandler::NOP;
+                return op;
+            }
+            default: {
+                return op;
+            }
+        }
+
+        // Everything that falls through to here only writes rd. x0 is hardwired to zero, so if that's the destination
+        // the whole instruction does nothing and we don't have to restore x0 after every instruction.
+        if (op.rd == 0 && op.handler != MicroOpHandler::ILLEGAL) {
+            op.handler = MicroOpHandler::NOP;
+        }
+
+        return op;
+    }
+} // namespace
+
+std::vector<MicroOp> decodeProgram(const std::uint8_t* program, const std::size_t programSize, const bool fuse) {
+    const auto instructionCount = programSize / 4;
+
+    std::vector<MicroOp> microOps;
+    microOps.reserve(instructionCount + 1);
+
+    for (auto i = 0ull; i < instructionCount; i++) {
+        Instruction instruction{};
+        std::memcpy(&instruction.raw, program + i * 4, sizeof(instruction.raw));
+        microOps.push_back(decodeInstruction(instruction, i * 4, instructionCount));
+    }
+
+    microOps.push_back(MicroOp{.handler = MicroOpHandler::OUT_OF_PROGRAM});
+
+    if (fuse) {
+        fuseSuperinstructions(microOps);
+    }
+
+    return microOps;
+}
+
+void fuseSuperinstructions(std::vector<MicroOp>& microOps) {
+    // The last entry is the sentinel, never fuse into or out of it
+    const auto instructionCount = microOps.size() - 1;
+
+    for (auto i = 0ull; i + 1 < instructionCount; i++) {
+        auto& first        = microOps[i];
+        const auto& second = microOps[i + 1];
+
+        switch (first.handler) {
+            case MicroOpHandler::LUI:
+            case MicroOpHandler::AUIPC: {
+                // lui a0, %hi(x); addi a0, a0, %lo(x) is just a 32-bit constant
+                if (second.handler == MicroOpHandler::ADDI && second.rd == first.rd && second.rs1 == first.rd) {
+                    first.handler = MicroOpHandler::LI;
+                    first.imm += second.imm;
+                    break;
+                }
+                // auipc ra, %hi(f); jalr ra, %lo(f)(ra) has a target we can resolve right now (same for lui)
+                if ((second.handler == MicroOpHandler::JALR || second.handler == MicroOpHandler::JR) &&
+                    second.rs1 == first.rd) {
+                    const auto destination = (first.imm + second.imm) & ~1u;
+                    if (destination % 4 != 0 || destination / 4 >= instructionCount) {
+                        break; // Leave anything weird (including DONE_ADDRESS) to the JALR handler
+                    }
+                    first.handler = MicroOpHandler::CALL;
+                    first.rs2     = second.rd; // x0 for tail calls, the handler writes x0 and puts it back
+                    first.target  = destination / 4;
+                }
+                break;
+            }
+            case MicroOpHandler::LBU: {
+                // The inner loop of every strcmp: lbu a5, 0(a5); beq a5, a4, ...
+                if (second.handler != MicroOpHandler::BEQ && second.handler != MicroOpHandler::BNE) {
+                    break;
+                }
+                if (second.rs1 != first.rd && second.rs2 != first.rd) {
+                    break;
+                }
+                // beq/bne are symmetric, so put whatever isn't the loaded register into rs2
+                const auto other = second.rs1 == first.rd ? second.rs2 : second.rs1;
+                first.handler = second.handler == MicroOpHandler::BEQ ? MicroOpHandler::LBU_BEQ : MicroOpHandler::LBU_BNE;
+                first.rs2     = other;
+                first.target  = second.target;
+                break;
+            }
+            case MicroOpHandler::ADDI: {
+                // addi sp, sp, -32; sw ra, 28(sp)
+                if (second.handler == MicroOpHandler::SW && second.rs1 == first.rd) {
+                    first.handler = MicroOpHandler::ADDI_SW;
+                    first.rs2     = second.rs2;
+                    first.target  = second.imm;
+                }
+                break;
+            }
+            case MicroOpHandler::LW: {
+                // lw ra, 28(sp); addi sp, sp, 32
+                if (second.handler == MicroOpHandler::ADDI && second.rd == first.rs1 && second.rs1 == first.rs1) {
+                    first.handler = MicroOpHandler::LW_ADDI;
+                    first.target  = second.imm;
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
+
+std::vector<bool> findBlockLeaders(const std::vector<MicroOp>& microOps) {
+    const auto instructionCount = microOps.size() - 1;
+
+    std::vector<bool> isLeader(instructionCount + 1, false);
+    isLeader[0]                = true;
+    isLeader[instructionCount] = true;
+    for (auto i = 0ull; i < instructionCount; i++) {
+        const auto& op = microOps[i];
+        switch (op.handler) {
+            case MicroOpHandler::JAL:
+            case MicroOpHandler::J:
+            case MicroOpHandler::BEQ:
+            case MicroOpHandler::BNE:
+            case MicroOpHandler::BLT:
+            case MicroOpHandler::BGE:
+            case MicroOpHandler::BLTU:
+            case MicroOpHandler::BGEU: {
+                isLeader[op.target] = true;
+                isLeader[i + 1]     = true;
+                break;
+            }
+            case MicroOpHandler::JALR:
+            case MicroOpHandler::JR:
+            case MicroOpHandler::ILLEGAL: {
+                isLeader[i + 1] = true;
+                break;
+            }
+            case MicroOpHandler::ECALL: {
+                // The JITs leave the generated code for it, so nothing of a block may come before or after it
+                isLeader[i]     = true;
+                isLeader[i + 1] = true;
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    return isLeader;
+}
+
+GuestRegisterSet registersRead(const MicroOp& op) {
+    const auto bit = [](const std::uint8_t index) { return static_cast<GuestRegisterSet>(1) << index; };
+
+    GuestRegisterSet read{};
+    switch (op.handler) {
+        case MicroOpHandler::LUI:
+        case MicroOpHandler::AUIPC:
+        case MicroOpHandler::JAL:
+        case MicroOpHandler::J:
+        case MicroOpHandler::LI:
+        case MicroOpHandler::CALL:
+        case MicroOpHandler::NOP:
+        case MicroOpHandler::ILLEGAL:
+        case MicroOpHandler::OUT_OF_PROGRAM:
+        case MicroOpHandler::HANDLER_COUNT: {
+            break;
+        }
+        case MicroOpHandler::JALR:
+        case MicroOpHandler::JR:
+        case MicroOpHandler::LB:
+        case MicroOpHandler::LH:
+        case MicroOpHandler::LW:
+        case MicroOpHandler::LBU:
+        case MicroOpHandler::LHU:
+        case MicroOpHandler::ADDI:
+        case MicroOpHandler::SLTI:
+        case MicroOpHandler::SLTIU:
+        case MicroOpHandler::XORI:
+        case MicroOpHandler::ORI:
+        case MicroOpHandler::ANDI:
+        case MicroOpHandler::SLLI:
+        case MicroOpHandler::SRLI:
+        case MicroOpHandler::SRAI:
+        case MicroOpHandler::LW_ADDI: {
+            read = bit(op.rs1);
+            break;
+        }
+        case MicroOpHandler::ECALL: {
+            read = bit(SYSCALL_NUMBER_REGISTER) | bit(10) | bit(11) | bit(12);
+            break;
+        }
+        default: {
+            // Branches, stores, register-register arithmetic and the remaining superinstructions
+            read = bit(op.rs1) | bit(op.rs2);
+            break;
+        }
+    }
+
+    return read & ~static_cast<GuestRegisterSet>(1);
+}
+
+GuestRegisterSet registersWritten(const MicroOp& op) {
+    const auto bit = [](const std::uint8_t index) { return static_cast<GuestRegisterSet>(1) << index; };
+
+    GuestRegisterSet written{};
+    switch (op.handler) {
+        case MicroOpHandler::J:
+        case MicroOpHandler::JR:
+        case MicroOpHandler::BEQ:
+        case MicroOpHandler::BNE:
+        case MicroOpHandler::BLT:
+        case MicroOpHandler::BGE:
+        case MicroOpHandler::BLTU:
+        case MicroOpHandler::BGEU:
+        case MicroOpHandler::SB:
+        case MicroOpHandler::SH:
+        case MicroOpHandler::SW:
+        case MicroOpHandler::NOP:
+        case MicroOpHandler::ILLEGAL:
+        case MicroOpHandler::OUT_OF_PROGRAM:
+        case MicroOpHandler::HANDLER_COUNT: {
+            break;
+        }
+        case MicroOpHandler::CALL: {
+            written = bit(op.rd) | bit(op.rs2);
+            break;
+        }
+        case MicroOpHandler::LW_ADDI: {
+            written = bit(op.rd) | bit(op.rs1);
+            break;
+        }
+        case MicroOpHandler::ECALL: {
+            written = bit(SYSCALL_RESULT_REGISTER);
+            break;
+        }
+        default: {
+            written = bit(op.rd);
+            break;
+        }
+    }
+
+    return written & ~static_cast<GuestRegisterSet>(1);
+}
+
+std::vector<GuestRegisterSet> findVaryingRegisters(const std::vector<MicroOp>& microOps) {
+    const auto instructionCount = microOps.size() - 1;
+
+    // Forward dataflow, a register varies on entry if it does on any way in. Calls are assumed to come back to the
+    // instruction after them, with whatever varies at any return on top of what varied before the call. Code nothing
+    // jumps to (like functions only called through pointers) stays optimistic, the JIT's checks catch it.
+    std::vector<GuestRegisterSet> varyingBefore(instructionCount + 1, 0);
+    GuestRegisterSet varyingAtReturns{};
+
+    for (auto changed = true; changed;) {
+        changed = false;
+
+        const auto merge = [&](const std::size_t index, const GuestRegisterSet varying) {
+            if ((varyingBefore[index] | varying) != varyingBefore[index]) {
+                varyingBefore[index] |= varying;
+                changed = true;
+            }
+        };
+
+        for (auto i = 0ull; i < instructionCount; i++) {
+            const auto& op = microOps[i];
+            const auto in  = varyingBefore[i];
+
+            auto out = in & ~registersWritten(op);
+            switch (op.handler) {
+                case MicroOpHandler::LB:
+                case MicroOpHandler::LH:
+                case MicroOpHandler::LW:
+                case MicroOpHandler::LBU:
+                case MicroOpHandler::LHU:
+                case MicroOpHandler::ECALL: {
+                    // What the system call returns depends on the input as much as anything loaded from memory
+                    out |= registersWritten(op);
+                    break;
+                }
+                default: {
+                    if (registersRead(op) & in) {
+                        out |= registersWritten(op);
+                    }
+                    break;
+                }
+            }
+
+            switch (op.handler) {
+                case MicroOpHandler::BEQ:
+                case MicroOpHandler::BNE:
+                case MicroOpHandler::BLT:
+                case MicroOpHandler::BGE:
+                case MicroOpHandler::BLTU:
+                case MicroOpHandler::BGEU: {
+                    merge(op.target, out);
+                    merge(i + 1, out);
+                    break;
+                }
+                case MicroOpHandler::JAL: {
+                    merge(op.target, out);
+                    merge(i + 1, out | varyingAtReturns);
+                    break;
+                }
+                case MicroOpHandler::J: {
+                    merge(op.target, out);
+                    break;
+                }
+                case MicroOpHandler::JALR: {
+                    merge(i + 1, out | varyingAtReturns);
+                    break;
+                }
+                case MicroOpHandler::JR: {
+                    if ((varyingAtReturns | out) != varyingAtReturns) {
+                        varyingAtReturns |= out;
+                        changed = true;
+                    }
+                    break;
+                }
+                case MicroOpHandler::ILLEGAL: {
+                    break;
+                }
+                default: {
+                    merge(i + 1, out);
+                    break;
+                }
+            }
+        }
+    }
+
+    return varyingBefore;
+}
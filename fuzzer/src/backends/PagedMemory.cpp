@@ -0,0 +1,91 @@
+#include <algorithm>
+
+#include "backends/PagedMemory.hpp"
+
+PageImage::PageImage(const std::size_t size, const std::function<void(std::uint8_t*)>& fill,
+                     const std::size_t addressSpace)
+    : addressSpace(addressSpace), imagePages((size + PAGE_SIZE - 1) / PAGE_SIZE),
+      pages((imagePages + 1) * PAGE_SIZE) {
+    fill(pages.data());
+}
+
+PagedMemory::PagedMemory(std::shared_ptr<const PageImage> image, Arena* arena)
+    : image(std::move(image)), table(this->image->pageCount()), arena(arena) {
+    for (std::size_t index = 0; index < table.size(); index++) {
+        table[index] = const_cast<std::uint8_t*>(this->image->page(index));
+    }
+}
+
+bool PagedMemory::read(const MachineWord address, void* out, const std::size_t bytes) {
+    if (address >= size() || bytes > size() - address) {
+        std::memset(out, 0, bytes);
+        return false;
+    }
+
+    // A page at a time, the last one ends up in the TLB
+    auto* destination = static_cast<std::uint8_t*>(out);
+    for (std::size_t done = 0; done < bytes;) {
+        const auto at     = address + done;
+        const auto offset = at % PageImage::PAGE_SIZE;
+        const auto chunk  = std::min(bytes - done, PageImage::PAGE_SIZE - offset);
+        readTag           = at - offset;
+        readPage          = table[at >> PageImage::PAGE_SHIFT];
+        std::memcpy(destination + done, readPage + offset, chunk);
+        done += chunk;
+    }
+    return true;
+}
+
+bool PagedMemory::write(const MachineWord address, const void* in, const std::size_t bytes) {
+    if (address >= size() || bytes > size() - address) {
+        return false;
+    }
+
+    const auto* source = static_cast<const std::uint8_t*>(in);
+    for (std::size_t done = 0; done < bytes;) {
+        const auto at     = address + done;
+        const auto offset = at % PageImage::PAGE_SIZE;
+        const auto chunk  = std::min(bytes - done, PageImage::PAGE_SIZE - offset);
+        writeTag          = at - offset;
+        writePage         = writable(at >> PageImage::PAGE_SHIFT);
+        std::memcpy(writePage + offset, source + done, chunk);
+        done += chunk;
+    }
+    return true;
+}
+
+std::uint8_t* PagedMemory::writable(const std::size_t index) {
+    if (isPrivate(index)) {
+        return table[index];
+    }
+
+    std::uint8_t* copy;
+    if (!spare.empty()) {
+        copy = spare.back();
+        spare.pop_back();
+    } else if (arena) {
+        copy = static_cast<std::uint8_t*>(arena->allocate(PageImage::PAGE_SIZE, PageImage::PAGE_SIZE));
+    } else {
+        owned.push_back(std::make_unique<std::uint8_t[]>(PageImage::PAGE_SIZE));
+        copy = owned.back().get();
+    }
+    std::memcpy(copy, table[index], PageImage::PAGE_SIZE);
+    table[index] = copy;
+    written.push_back(index);
+
+    // The read TLB may still have the image's page
+    if (readTag == index << PageImage::PAGE_SHIFT) {
+        readPage = copy;
+    }
+    return copy;
+}
+
+void PagedMemory::reset() {
+    for (const auto index : written) {
+        spare.push_back(table[index]);
+        table[index] = const_cast<std::uint8_t*>(image->page(index));
+    }
+    written.clear();
+    readTag  = NO_PAGE;
+    writeTag = NO_PAGE;
+}
@@ -0,0 +1,524 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include "backends/ScalarJITBackend.hpp"
+#include "spdlog/spdlog.h"
+
+// A single-instance JIT backend
+//
+// The program is decoded into (unfused) micro-ops and translated in one go when the backend is built. Guest registers
+// live in the State block, which stays pinned in rbx for the whole run, so every guest register is one memory operand
+// away. Every instruction gets a label: branches and jal jump straight to their target's label, falling off the end of
+// a block just runs into the next one, and jalr looks its destination up in the dispatch table. Blocks pay for all of
+// their instructions on the way in, so a jalr into the middle of one goes through an entry stub that pays for the rest
+// of it. Anything that stops the run (illegal instruction, running out of budget) jumps to a small stub at the end of
+// the code that records the pc and returns the ExecutionError.
+//
+// Loads and stores are the exception, a stub would cost them a compare and a branch each. Guest memory is a
+// GuardedMemory instead, so the address goes straight into the memory operand and a bad one faults. onFault() finds
+// the instruction from the host rip and has the signal handler return into the epilogue, as if a stub had been there.
+
+namespace {
+    namespace x86 = asmjit::x86;
+
+    // Pinned for the whole run. All callee-saved, so they're never spilled, not even around the call out for an ecall.
+    constexpr auto STATE_REGISTER          = x86::rbx;
+    constexpr auto MEMORY_REGISTER         = x86::r12;
+    constexpr auto DISPATCH_REGISTER       = x86::r13;
+    constexpr auto BUDGET_REGISTER         = x86::r14;
+    constexpr auto BUDGET_POINTER_REGISTER = x86::r15;
+
+    // Scratch. 32-bit writes zero the upper half, so RAX can be used as an index right after EAX was computed.
+    constexpr auto EAX = x86::eax;
+    constexpr auto RAX = x86::rax;
+    constexpr auto ECX = x86::ecx;
+
+    x86::Mem guestRegister(const std::uint8_t index) {
+        const auto offset = offsetof(State, x) + index * sizeof(MachineWord);
+        return x86::dword_ptr(STATE_REGISTER, static_cast<std::int32_t>(offset));
+    }
+
+    x86::Mem guestPc() { return x86::dword_ptr(STATE_REGISTER, static_cast<std::int32_t>(offsetof(State, pc))); }
+
+    // asmjit wants immediates that fit the operand size, so hand it the signed view of the word
+    std::int32_t imm32(const MachineWord value) { return static_cast<std::int32_t>(value); }
+} // namespace
+
+ScalarJITBackend::ScalarJITBackend(std::shared_ptr<const PageImage> image, State state, std::size_t programSize,
+                                   std::uint64_t instructionLimit)
+    : AbstractMachineBackend(image->data(), state, programSize), image(std::move(image)), initialState(state),
+      guestMemory(GUEST_ADDRESS_SPACE, onFault, this),
+      guestSystem(1,
+                  (MEMORY_SIZE + programSize + GuardedMemory::PAGE_SIZE - 1) / GuardedMemory::PAGE_SIZE *
+                          GuardedMemory::PAGE_SIZE,
+                  GUEST_ADDRESS_SPACE - GUEST_STACK_SIZE),
+      instructionLimit(instructionLimit) {
+    std::memcpy(guestMemory.data(), memory, MEMORY_SIZE + programSize);
+    translate(decodeProgram(program, programSize, false));
+}
+
+void ScalarJITBackend::reset() {
+    // Whole pages of the image, it has zeros after its end
+    static_assert(PageImage::PAGE_SIZE == GuardedMemory::PAGE_SIZE);
+    const auto imageEnd = (MEMORY_SIZE + programSize + GuardedMemory::PAGE_SIZE - 1) / GuardedMemory::PAGE_SIZE *
+                          GuardedMemory::PAGE_SIZE;
+    std::memcpy(guestMemory.data(), image->data(), imageEnd);
+    guestMemory.discard(imageEnd);
+    state = initialState;
+}
+
+ScalarJITBackend::~ScalarJITBackend() {
+    if (function) {
+        runtime.release(function);
+    }
+}
+
+void ScalarJITBackend::translate(const std::vector<MicroOp>& microOps) {
+    asmjit::CodeHolder code;
+    code.init(runtime.environment(), runtime.cpuFeatures());
+    x86::Assembler assembler(&code);
+
+    const auto instructionCount = numberOfInstructions;
+
+    const auto isLeader = findBlockLeaders(microOps);
+
+    // One per instruction plus the sentinel
+    std::vector<asmjit::Label> labels;
+    labels.reserve(instructionCount + 1);
+    for (auto i = 0ull; i <= instructionCount; i++) {
+        labels.push_back(assembler.newLabel());
+    }
+
+    const auto epilogue     = assembler.newLabel();
+    const auto dispatcher   = assembler.newLabel();
+    const auto leaveProgram = assembler.newLabel();
+
+    // Cold paths, emitted after all the blocks so they stay out of the way
+    struct Stub {
+        asmjit::Label label;
+        MachineWord pc;
+        ExecutionError error;
+    };
+    std::vector<Stub> stubs;
+    const auto stub = [&](const MachineWord pc, const ExecutionError error) {
+        const auto label = assembler.newLabel();
+        stubs.push_back(Stub{label, pc, error});
+        return label;
+    };
+
+    // Prologue: (state, memory, dispatchTable, budget) come in as rdi, rsi, rdx, rcx
+    assembler.push(x86::rbx);
+    assembler.push(x86::r12);
+    assembler.push(x86::r13);
+    assembler.push(x86::r14);
+    assembler.push(x86::r15);
+    assembler.mov(STATE_REGISTER, x86::rdi);
+    assembler.mov(MEMORY_REGISTER, x86::rsi);
+    assembler.mov(DISPATCH_REGISTER, x86::rdx);
+    assembler.mov(BUDGET_POINTER_REGISTER, x86::rcx);
+    assembler.mov(BUDGET_REGISTER, x86::qword_ptr(BUDGET_POINTER_REGISTER));
+    assembler.mov(EAX, guestPc());
+
+    // Dispatcher, EAX holds the guest pc to continue at
+    {
+        const auto notDone = assembler.newLabel();
+        assembler.bind(dispatcher);
+        assembler.cmp(EAX, imm32(DONE_ADDRESS));
+        assembler.jne(notDone);
+        assembler.mov(guestPc(), EAX);
+        assembler.mov(EAX, static_cast<std::int32_t>(ExecutionError::NONE));
+        assembler.jmp(epilogue);
+
+        assembler.bind(notDone);
+        assembler.test(EAX, 3);
+        assembler.jnz(leaveProgram);
+        assembler.cmp(EAX, imm32(instructionCount * 4));
+        assembler.jae(leaveProgram);
+        // Entries are 8 bytes, one per 4 bytes of pc
+        assembler.jmp(x86::qword_ptr(DISPATCH_REGISTER, RAX, 1));
+
+        assembler.bind(leaveProgram);
+        assembler.mov(guestPc(), EAX);
+        assembler.mov(EAX, static_cast<std::int32_t>(ExecutionError::OUT_OF_PROGRAM));
+        assembler.jmp(epilogue);
+    }
+
+    for (auto i = 0ull; i < instructionCount; i++) {
+        const auto& op       = microOps[i];
+        const MachineWord pc = i * 4;
+
+        assembler.bind(labels[i]);
+
+        // Pay for the whole block up front
+        if (isLeader[i]) {
+            auto length = 1ull;
+            while (!isLeader[i + length]) {
+                length++;
+            }
+            assembler.sub(BUDGET_REGISTER, static_cast<std::int32_t>(length));
+            assembler.jl(stub(pc, ExecutionError::INSTRUCTION_LIMIT));
+        }
+
+        // Leaves the guest address in EAX (and RAX). Guest addresses are relative to guest memory, which starts with
+        // the program image and has the MEMORY_SIZE bytes after it. No bounds check, see onFault().
+        const auto emitAddress = [&](const std::uint8_t base, const MachineWord offset) {
+            assembler.mov(EAX, guestRegister(base));
+            if (offset != 0) {
+                assembler.add(EAX, imm32(offset));
+            }
+        };
+
+        switch (op.handler) {
+            case MicroOpHandler::LUI:
+            case MicroOpHandler::AUIPC: {
+                // Both were folded into the immediate at decode time
+                assembler.mov(guestRegister(op.rd), imm32(op.imm));
+                break;
+            }
+            case MicroOpHandler::JAL: {
+                assembler.mov(guestRegister(op.rd), imm32(op.imm));
+                assembler.jmp(labels[op.target]);
+                break;
+            }
+            case MicroOpHandler::J: {
+                assembler.jmp(labels[op.target]);
+                break;
+            }
+            case MicroOpHandler::JALR:
+            case MicroOpHandler::JR: {
+                // The destination has to be computed before the link is written, rd and rs1 may be the same register
+                assembler.mov(EAX, guestRegister(op.rs1));
+                if (op.imm != 0) {
+                    assembler.add(EAX, imm32(op.imm));
+                }
+                assembler.and_(EAX, -2);
+                if (op.handler == MicroOpHandler::JALR) {
+                    assembler.mov(guestRegister(op.rd), imm32(op.target));
+                }
+                assembler.jmp(dispatcher);
+                break;
+            }
+            case MicroOpHandler::BEQ:
+            case MicroOpHandler::BNE:
+            case MicroOpHandler::BLT:
+            case MicroOpHandler::BGE:
+            case MicroOpHandler::BLTU:
+            case MicroOpHandler::BGEU: {
+                assembler.mov(EAX, guestRegister(op.rs1));
+                assembler.cmp(EAX, guestRegister(op.rs2));
+                const auto& target = labels[op.target];
+                switch (op.handler) {
+                    case MicroOpHandler::BEQ: {
+                        assembler.je(target);
+                        break;
+                    }
+                    case MicroOpHandler::BNE: {
+                        assembler.jne(target);
+                        break;
+                    }
+                    case MicroOpHandler::BLT: {
+                        assembler.jl(target);
+                        break;
+                    }
+                    case MicroOpHandler::BGE: {
+                        assembler.jge(target);
+                        break;
+                    }
+                    case MicroOpHandler::BLTU: {
+                        assembler.jb(target);
+                        break;
+                    }
+                    default: {
+                        assembler.jae(target);
+                        break;
+                    }
+                }
+                // Not taken runs straight into the next block
+                break;
+            }
+            case MicroOpHandler::LB: {
+                emitAddress(op.rs1, op.imm);
+                assembler.movsx(ECX, x86::byte_ptr(MEMORY_REGISTER, RAX));
+                assembler.mov(guestRegister(op.rd), ECX);
+                break;
+            }
+            case MicroOpHandler::LH: {
+                emitAddress(op.rs1, op.imm);
+                assembler.movsx(ECX, x86::word_ptr(MEMORY_REGISTER, RAX));
+                assembler.mov(guestRegister(op.rd), ECX);
+                break;
+            }
+            case MicroOpHandler::LW: {
+                emitAddress(op.rs1, op.imm);
+                assembler.mov(ECX, x86::dword_ptr(MEMORY_REGISTER, RAX));
+                assembler.mov(guestRegister(op.rd), ECX);
+                break;
+            }
+            case MicroOpHandler::LBU: {
+                emitAddress(op.rs1, op.imm);
+                assembler.movzx(ECX, x86::byte_ptr(MEMORY_REGISTER, RAX));
+                assembler.mov(guestRegister(op.rd), ECX);
+                break;
+            }
+            case MicroOpHandler::LHU: {
+                emitAddress(op.rs1, op.imm);
+                assembler.movzx(ECX, x86::word_ptr(MEMORY_REGISTER, RAX));
+                assembler.mov(guestRegister(op.rd), ECX);
+                break;
+            }
+            case MicroOpHandler::SB: {
+                emitAddress(op.rs1, op.imm);
+                assembler.mov(ECX, guestRegister(op.rs2));
+                assembler.mov(x86::byte_ptr(MEMORY_REGISTER, RAX), x86::cl);
+                break;
+            }
+            case MicroOpHandler::SH: {
+                emitAddress(op.rs1, op.imm);
+                assembler.mov(ECX, guestRegister(op.rs2));
+                assembler.mov(x86::word_ptr(MEMORY_REGISTER, RAX), x86::cx);
+                break;
+            }
+            case MicroOpHandler::SW: {
+                emitAddress(op.rs1, op.imm);
+                assembler.mov(ECX, guestRegister(op.rs2));
+                assembler.mov(x86::dword_ptr(MEMORY_REGISTER, RAX), ECX);
+                break;
+            }
+            case MicroOpHandler::ADDI:
+            case MicroOpHandler::XORI:
+            case MicroOpHandler::ORI:
+            case MicroOpHandler::ANDI:
+            case MicroOpHandler::SLLI:
+            case MicroOpHandler::SRLI:
+            case MicroOpHandler::SRAI: {
+                assembler.mov(EAX, guestRegister(op.rs1));
+                switch (op.handler) {
+                    case MicroOpHandler::ADDI: {
+                        assembler.add(EAX, imm32(op.imm));
+                        break;
+                    }
+                    case MicroOpHandler::XORI: {
+                        assembler.xor_(EAX, imm32(op.imm));
+                        break;
+                    }
+                    case MicroOpHandler::ORI: {
+                        assembler.or_(EAX, imm32(op.imm));
+                        break;
+                    }
+                    case MicroOpHandler::ANDI: {
+                        assembler.and_(EAX, imm32(op.imm));
+                        break;
+                    }
+                    case MicroOpHandler::SLLI: {
+                        // The shift amount was already masked down to 5 bits when decoding
+                        assembler.shl(EAX, imm32(op.imm));
+                        break;
+                    }
+                    case MicroOpHandler::SRLI: {
+                        assembler.shr(EAX, imm32(op.imm));
+                        break;
+                    }
+                    default: {
+                        assembler.sar(EAX, imm32(op.imm));
+                        break;
+                    }
+                }
+                assembler.mov(guestRegister(op.rd), EAX);
+                break;
+            }
+            case MicroOpHandler::SLTI:
+            case MicroOpHandler::SLTIU: {
+                assembler.xor_(EAX, EAX);
+                assembler.cmp(guestRegister(op.rs1), imm32(op.imm));
+                if (op.handler == MicroOpHandler::SLTI) {
+                    assembler.setl(x86::al);
+                } else {
+                    assembler.setb(x86::al);
+                }
+                assembler.mov(guestRegister(op.rd), EAX);
+                break;
+            }
+            case MicroOpHandler::ADD:
+            case MicroOpHandler::SUB:
+            case MicroOpHandler::XOR:
+            case MicroOpHandler::OR:
+            case MicroOpHandler::AND: {
+                assembler.mov(EAX, guestRegister(op.rs1));
+                switch (op.handler) {
+                    case MicroOpHandler::ADD: {
+                        assembler.add(EAX, guestRegister(op.rs2));
+                        break;
+                    }
+                    case MicroOpHandler::SUB: {
+                        assembler.sub(EAX, guestRegister(op.rs2));
+                        break;
+                    }
+                    case MicroOpHandler::XOR: {
+                        assembler.xor_(EAX, guestRegister(op.rs2));
+                        break;
+                    }
+                    case MicroOpHandler::OR: {
+                        assembler.or_(EAX, guestRegister(op.rs2));
+                        break;
+                    }
+                    default: {
+                        assembler.and_(EAX, guestRegister(op.rs2));
+                        break;
+                    }
+                }
+                assembler.mov(guestRegister(op.rd), EAX);
+                break;
+            }
+            case MicroOpHandler::SLL:
+            case MicroOpHandler::SRL:
+            case MicroOpHandler::SRA: {
+                // x86 masks 32-bit shift counts down to 5 bits, same as RISC-V
+                assembler.mov(EAX, guestRegister(op.rs1));
+                assembler.mov(ECX, guestRegister(op.rs2));
+                if (op.handler == MicroOpHandler::SLL) {
+                    assembler.shl(EAX, x86::cl);
+                } else if (op.handler == MicroOpHandler::SRL) {
+                    assembler.shr(EAX, x86::cl);
+                } else {
+                    assembler.sar(EAX, x86::cl);
+                }
+                assembler.mov(guestRegister(op.rd), EAX);
+                break;
+            }
+            case MicroOpHandler::SLT:
+            case MicroOpHandler::SLTU: {
+                assembler.mov(ECX, guestRegister(op.rs1));
+                assembler.xor_(EAX, EAX);
+                assembler.cmp(ECX, guestRegister(op.rs2));
+                if (op.handler == MicroOpHandler::SLT) {
+                    assembler.setl(x86::al);
+                } else {
+                    assembler.setb(x86::al);
+                }
+                assembler.mov(guestRegister(op.rd), EAX);
+                break;
+            }
+            case MicroOpHandler::NOP: {
+                break;
+            }
+            case MicroOpHandler::ECALL: {
+                // Out to systemCall(), which works on the guest registers in the State block and returns the pc to go
+                // on at. The five pushes of the prologue left the stack aligned for the call.
+                assembler.mov(x86::rdi, static_cast<void*>(this));
+                assembler.mov(x86::esi, imm32(pc));
+                assembler.mov(x86::rdx, BUDGET_REGISTER);
+                assembler.mov(RAX, reinterpret_cast<const void*>(&ScalarJITBackend::systemCall));
+                assembler.call(RAX);
+                assembler.jmp(dispatcher);
+                break;
+            }
+            default: {
+                // ILLEGAL, and superinstructions can't show up since we asked for an unfused decode
+                assembler.jmp(stub(pc, ExecutionError::ILLEGAL_INSTRUCTION));
+                break;
+            }
+        }
+    }
+
+    // Sentinel, for falling off the end of the program or jumping at something that isn't in it
+    assembler.bind(labels[instructionCount]);
+    assembler.mov(EAX, imm32(instructionCount * 4));
+    assembler.jmp(leaveProgram);
+
+    // Entry stubs, for every instruction that doesn't start a block. Compiled code only ever jalrs to return addresses
+    // and function entries, which do, but anything else still has to be paid for.
+    std::vector<asmjit::Label> entries(instructionCount);
+    for (auto i = instructionCount; i-- > 0;) {
+        if (isLeader[i]) {
+            continue;
+        }
+        auto length = 1ull;
+        while (!isLeader[i + length]) {
+            length++;
+        }
+        entries[i] = assembler.newLabel();
+        assembler.bind(entries[i]);
+        assembler.sub(BUDGET_REGISTER, static_cast<std::int32_t>(length));
+        assembler.jl(stub(i * 4, ExecutionError::INSTRUCTION_LIMIT));
+        assembler.jmp(labels[i]);
+    }
+
+    for (const auto& [label, pc, error] : stubs) {
+        assembler.bind(label);
+        assembler.mov(guestPc(), imm32(pc));
+        assembler.mov(EAX, static_cast<std::int32_t>(error));
+        assembler.jmp(epilogue);
+    }
+
+    // Epilogue, EAX holds the ExecutionError
+    assembler.bind(epilogue);
+    assembler.mov(x86::qword_ptr(BUDGET_POINTER_REGISTER), BUDGET_REGISTER);
+    assembler.pop(x86::r15);
+    assembler.pop(x86::r14);
+    assembler.pop(x86::r13);
+    assembler.pop(x86::r12);
+    assembler.pop(x86::rbx);
+    assembler.ret();
+
+    if (const auto error = runtime.add(&function, &code); error != asmjit::kErrorOk) {
+        spdlog::error("Failed to add the translated program to the JIT runtime: {}",
+                      asmjit::DebugUtils::errorAsString(error));
+        exit(EXIT_FAILURE);
+    }
+
+    const auto base = reinterpret_cast<std::uintptr_t>(function);
+    codeSize        = code.codeSize();
+    epilogueAddress = reinterpret_cast<const void*>(base + code.labelOffsetFromBase(epilogue));
+    dispatchTable.resize(instructionCount);
+    instructionAddresses.resize(instructionCount);
+    for (auto i = 0ull; i < instructionCount; i++) {
+        instructionAddresses[i] = reinterpret_cast<const void*>(base + code.labelOffsetFromBase(labels[i]));
+        dispatchTable[i]        = isLeader[i] ? instructionAddresses[i]
+                                              : reinterpret_cast<const void*>(base + code.labelOffsetFromBase(entries[i]));
+    }
+
+    spdlog::info("Translated {} instructions into {} bytes of code.", instructionCount, code.codeSize());
+}
+
+MachineWord ScalarJITBackend::systemCall(ScalarJITBackend* backend, const MachineWord pc, const std::int64_t budget) {
+    auto& x = backend->state.x;
+    const FlatGuestMemory memory{backend->guestMemory.data(), backend->guestMemory.size()};
+    const auto [value, exit] = backend->guestSystem.call(0, x[SYSCALL_NUMBER_REGISTER], x[10], x[11], x[12], memory,
+                                                         backend->instructionLimit - budget);
+    x[SYSCALL_RESULT_REGISTER] = value;
+    return exit ? DONE_ADDRESS : pc + 4;
+}
+
+void ScalarJITBackend::run() {
+    auto budget = static_cast<std::int64_t>(instructionLimit);
+    guestSystem.reset();
+
+    result.error = static_cast<ExecutionError>(function(&state, guestMemory.data(), dispatchTable.data(), &budget));
+    result.returnValue      = static_cast<std::int32_t>(state.x[10]);
+    result.instructionCount = result.error == ExecutionError::INSTRUCTION_LIMIT
+                                      ? instructionLimit
+                                      : instructionLimit - static_cast<std::uint64_t>(budget);
+}
+
+bool ScalarJITBackend::onFault(void* owner, ucontext_t* context) {
+    auto* backend   = static_cast<ScalarJITBackend*>(owner);
+    auto& registers = context->uc_mcontext.gregs;
+    const auto rip  = static_cast<std::uintptr_t>(registers[REG_RIP]);
+    if (rip - reinterpret_cast<std::uintptr_t>(backend->function) >= backend->codeSize) {
+        return false;
+    }
+
+    // The last instruction whose code starts at or before rip. Instructions that emit nothing (nops) share their
+    // address with the next one, which is then the one that faulted.
+    const auto& table   = backend->instructionAddresses;
+    const auto isBefore = [](const std::uintptr_t address, const void* code) {
+        return address < reinterpret_cast<std::uintptr_t>(code);
+    };
+    const auto next    = std::upper_bound(table.begin(), table.end(), rip, isBefore);
+    backend->state.pc  = static_cast<MachineWord>(next - table.begin() - 1) * 4;
+    registers[REG_RAX] = static_cast<greg_t>(ExecutionError::OUT_OF_BOUNDS);
+    registers[REG_RIP] = reinterpret_cast<greg_t>(backend->epilogueAddress);
+    return true;
+}
@@ -0,0 +1,2070 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "backends/VectorJITBackend.hpp"
+#include "spdlog/spdlog.h"
+
+// A JIT-based backend
+//
+// Every guest register is a vector with one 32-bit element per lane. They live in VectorState::x between basic blocks
+// and in vector registers inside of them, see VectorRegisterAllocator. A few vector registers are kept out of the
+// allocator's hands for temporaries, x0, the lane offsets and the instruction budget (and on AVX2, the masks), so
+// nothing has to be spilled to make room for a temporary.
+//
+// Lanes run a block together when they're at the same pc. Whenever they split up (or leave through jalr), the
+// scheduler at the end of the code picks the lowest pc any live lane is waiting at and dispatches there with every
+// lane that is at it. A lane is done once it returns to DONE_ADDRESS, or when it stops with an error, and the code
+// returns when no lane is left. With a LaneRefill, it returns as soon as any lane is done instead (everything is in
+// VectorState whenever the scheduler runs), and run() enters it again once the refill has started those lanes over.
+//
+// The same translation is emitted for 16 lanes of AVX-512 and 8 of AVX2. Target has the registers of each, and Isa
+// the handful of things that are spelled differently. What's left in here only differs for memory accesses (AVX2 has
+// no scatter) and the horizontal minimum in the scheduler.
+//
+// Loads and stores depend on the LaneMemoryLayout. Contiguous, every access gathers or scatters through the lane
+// offsets. Interleaved, an access first checks whether every running lane is at the same aligned-enough address, and
+// if so it's a plain vector load or store of that address' row, see emitUniformAddress(). Otherwise it gathers and
+// scatters like the contiguous layout does, a word at a time, with a second go at the next row for the lanes whose
+// access crosses into the next word.
+//
+// Every store also marks the chunk of the lane's memory it lands in as dirty, in a map right after laneLocalMemory
+// (see dirtyIndex()), so resetting a lane only copies back what it wrote instead of its whole memory.
+//
+// An ecall is a block of its own, and the only place the generated code calls out: systemCall() does it for each of
+// the lanes there, and they go back to the scheduler. Nothing kept in vector or mask registers survives the call, so
+// whatever isn't rebuilt by the scheduler is stored before it and restored after, see emitSystemCall().
+//
+// Lanes only differ in what they read from memory, so a lot of what they compute (the stack pointer, loop counters,
+// addresses of globals) is the same everywhere. findVaryingRegisters() guesses which registers that is and each block
+// checks the guess when it starts, see emitGuard(). Those values go in general purpose registers, handed out by a
+// second VectorRegisterAllocator, where arithmetic is done once, branches are a plain compare and jump, and addresses
+// only need one bounds check.
+
+namespace {
+    namespace x86 = asmjit::x86;
+
+    // Pinned for the whole run. All callee-saved, so they're never spilled, not even around the call out for an ecall.
+    constexpr auto STATE_REGISTER    = x86::rbx; // VectorState*
+    constexpr auto MEMORY_REGISTER   = x86::r12; // laneLocalMemory
+    constexpr auto DISPATCH_REGISTER = x86::r13; // Host address of every block by pc / 4
+
+    // Guest registers every running lane agrees on, handed out by the scalar allocator: rsi, rdi, r8-r11, r14 and r15.
+    // rbp is kept zeroed and stands in for x0.
+    constexpr std::array<std::uint8_t, 8> SCALAR_REGISTERS{6, 7, 8, 9, 10, 11, 14, 15};
+    constexpr std::uint8_t SCALAR_ZERO_REGISTER = 5;
+
+    // Lane memory is restored in chunks of this many bytes (as a shift), see dirtyIndex(). No bigger than a cache line,
+    // contiguous lane memory is only rounded up to one.
+    constexpr MachineWord DIRTY_CHUNK_SHIFT = 6;
+
+    // Scratch. 32-bit writes zero the upper half, so RAX can be used as an index right after EAX was computed.
+    constexpr auto EAX = x86::eax;
+    constexpr auto RAX = x86::rax;
+    constexpr auto ECX = x86::ecx;
+    constexpr auto RCX = x86::rcx;
+    constexpr auto EDX = x86::edx;
+    constexpr auto RDX = x86::rdx;
+
+    template <std::size_t LANES>
+    struct Target;
+
+    // zmm registers, lanes are masked with k registers
+    template <>
+    struct Target<16> {
+        using Vector = x86::Zmm;
+        using Mask   = x86::KReg;
+
+        static constexpr auto EXECUTION_CONTROL_REGISTER = x86::k2; // Lanes running the current block
+        static constexpr auto LIVE_LANES_REGISTER        = x86::k3; // Lanes that haven't finished yet
+        static constexpr auto TMP_MASK_REGISTER          = x86::k1;
+        static constexpr auto DIVERGENCE_MASK_REGISTER   = x86::k4;
+
+        // zmm0-zmm4 are reserved, the register allocator hands out the rest
+        static constexpr auto TMP_DATA_REGISTER          = x86::zmm0;
+        static constexpr auto TMP_ADDRESS_REGISTER       = x86::zmm1;
+        static constexpr auto ZERO_REGISTER              = x86::zmm2; // Stands in for x0
+        static constexpr auto LANE_OFFSET_REGISTER       = x86::zmm3; // laneBaseAddressOffsets
+        static constexpr auto BUDGET_REGISTER            = x86::zmm4; // Instructions each lane has left
+        static constexpr auto FIRST_ALLOCATABLE_REGISTER = 5;
+        static constexpr auto REGISTER_COUNT             = 32;
+
+        // Taken from the allocator for the interleaved layout only
+        static constexpr auto TMP_SHIFT_REGISTER = x86::zmm5;
+        static constexpr auto TMP_WORD_REGISTER  = x86::zmm6;
+
+        static Vector vector(const std::uint32_t id) { return x86::zmm(id); }
+        static x86::Mem vectorPtr(const std::int32_t offset) { return x86::zmmword_ptr(STATE_REGISTER, offset); }
+    };
+
+    // ymm registers. There are no mask registers, a mask is a vector with every bit of a lane set or clear. Only 16 ymm
+    // registers and the masks take up four of them, which leaves 7 for the allocator (5 with the interleaved layout).
+    template <>
+    struct Target<8> {
+        using Vector = x86::Ymm;
+        using Mask   = x86::Ymm;
+
+        static constexpr auto EXECUTION_CONTROL_REGISTER = x86::ymm5; // Lanes running the current block
+        static constexpr auto LIVE_LANES_REGISTER        = x86::ymm6; // Lanes that haven't finished yet
+        static constexpr auto TMP_MASK_REGISTER          = x86::ymm7;
+        static constexpr auto DIVERGENCE_MASK_REGISTER   = x86::ymm8;
+
+        static constexpr auto TMP_DATA_REGISTER          = x86::ymm0;
+        static constexpr auto TMP_ADDRESS_REGISTER       = x86::ymm1;
+        static constexpr auto ZERO_REGISTER              = x86::ymm2; // Stands in for x0
+        static constexpr auto LANE_OFFSET_REGISTER       = x86::ymm3; // laneBaseAddressOffsets
+        static constexpr auto BUDGET_REGISTER            = x86::ymm4; // Instructions each lane has left
+        static constexpr auto FIRST_ALLOCATABLE_REGISTER = 9;
+        static constexpr auto REGISTER_COUNT             = 16;
+
+        // Taken from the allocator for the interleaved layout only
+        static constexpr auto TMP_SHIFT_REGISTER = x86::ymm9;
+        static constexpr auto TMP_WORD_REGISTER  = x86::ymm10;
+
+        static Vector vector(const std::uint32_t id) { return x86::ymm(id); }
+        static x86::Mem vectorPtr(const std::int32_t offset) { return x86::ymmword_ptr(STATE_REGISTER, offset); }
+    };
+
+    enum class Condition { EQ, NE, LT, GE, LTU, GEU, GTU };
+
+    // The operations that look different on every instruction set. AVX-512 has a k register and a masked form of
+    // everything, AVX2 does the same with and/andn on mask vectors and vpmaskmovd.
+    template <std::size_t LANES>
+    class Isa {
+    public:
+        using Vector               = typename Target<LANES>::Vector;
+        using Mask                 = typename Target<LANES>::Mask;
+        static constexpr auto EVEX = LANES == 16;
+
+        explicit Isa(x86::Assembler& assembler) : assembler(assembler) {}
+
+        void load(const Vector& dst, const x86::Mem& src) const {
+            if constexpr (EVEX) {
+                assembler.vmovdqa32(dst, src);
+            } else {
+                assembler.vmovdqa(dst, src);
+            }
+        }
+
+        void store(const x86::Mem& dst, const Vector& src) const {
+            if constexpr (EVEX) {
+                assembler.vmovdqa32(dst, src);
+            } else {
+                assembler.vmovdqa(dst, src);
+            }
+        }
+
+        void loadUnaligned(const Vector& dst, const x86::Mem& src) const {
+            if constexpr (EVEX) {
+                assembler.vmovdqu32(dst, src);
+            } else {
+                assembler.vmovdqu(dst, src);
+            }
+        }
+
+        void storeUnaligned(const x86::Mem& dst, const Vector& src) const {
+            if constexpr (EVEX) {
+                assembler.vmovdqu32(dst, src);
+            } else {
+                assembler.vmovdqu(dst, src);
+            }
+        }
+
+        // Every bit of dst set
+        void allOnes(const Vector& dst) const {
+            if constexpr (EVEX) {
+                assembler.vpternlogd(dst, dst, dst, 0xff);
+            } else {
+                assembler.vpcmpeqd(dst, dst, dst);
+            }
+        }
+
+        // Only the lanes in mask are written, the others keep what they had
+        void maskedStore(const x86::Mem& dst, const Vector& src, const Mask& mask) const {
+            if constexpr (EVEX) {
+                assembler.k(mask).vmovdqu32(dst, src);
+            } else {
+                assembler.vpmaskmovd(dst, mask, src);
+            }
+        }
+
+        // Every lane of dst = value, goes through EAX
+        void broadcast(const Vector& dst, const MachineWord value) const {
+            if (value == 0) {
+                bitwiseXor(dst, dst, dst);
+                return;
+            }
+            assembler.mov(EAX, static_cast<std::int32_t>(value));
+            broadcastRegister(dst, EAX);
+        }
+
+        void broadcastRegister(const Vector& dst, const x86::Gp& src) const {
+            if constexpr (EVEX) {
+                assembler.vpbroadcastd(dst, src);
+            } else {
+                assembler.vmovd(dst.xmm(), src);
+                assembler.vpbroadcastd(dst, dst.xmm());
+            }
+        }
+
+        void bitwiseAnd(const Vector& dst, const Vector& a, const Vector& b) const {
+            if constexpr (EVEX) {
+                assembler.vpandd(dst, a, b);
+            } else {
+                assembler.vpand(dst, a, b);
+            }
+        }
+
+        void bitwiseOr(const Vector& dst, const Vector& a, const Vector& b) const {
+            if constexpr (EVEX) {
+                assembler.vpord(dst, a, b);
+            } else {
+                assembler.vpor(dst, a, b);
+            }
+        }
+
+        void bitwiseXor(const Vector& dst, const Vector& a, const Vector& b) const {
+            if constexpr (EVEX) {
+                assembler.vpxord(dst, a, b);
+            } else {
+                assembler.vpxor(dst, a, b);
+            }
+        }
+
+        // dst = ~a & b
+        void bitwiseAndNot(const Vector& dst, const Vector& a, const Vector& b) const {
+            if constexpr (EVEX) {
+                assembler.vpandnd(dst, a, b);
+            } else {
+                assembler.vpandn(dst, a, b);
+            }
+        }
+
+        // dst = ~a & b
+        void maskAndNot(const Mask& dst, const Mask& a, const Mask& b) const {
+            if constexpr (EVEX) {
+                assembler.kandnw(dst, a, b);
+            } else {
+                assembler.vpandn(dst, a, b);
+            }
+        }
+
+        void maskOr(const Mask& dst, const Mask& a, const Mask& b) const {
+            if constexpr (EVEX) {
+                assembler.korw(dst, a, b);
+            } else {
+                assembler.vpor(dst, a, b);
+            }
+        }
+
+        void maskXor(const Mask& dst, const Mask& a, const Mask& b) const {
+            if constexpr (EVEX) {
+                assembler.kxorw(dst, a, b);
+            } else {
+                assembler.vpxor(dst, a, b);
+            }
+        }
+
+        void maskCopy(const Mask& dst, const Mask& src) const {
+            if constexpr (EVEX) {
+                assembler.kmovw(dst, src);
+            } else {
+                assembler.vmovdqa(dst, src);
+            }
+        }
+
+        void maskAll(const Mask& dst) const {
+            if constexpr (EVEX) {
+                assembler.kxnorw(dst, dst, dst);
+            } else {
+                assembler.vpcmpeqd(dst, dst, dst);
+            }
+        }
+
+        // ZF is set when mask has no lanes in it
+        void testMask(const Mask& mask) const {
+            if constexpr (EVEX) {
+                assembler.kortestw(mask, mask);
+            } else {
+                assembler.vptest(mask, mask);
+            }
+        }
+
+        // EAX = index of the lowest lane in mask, which can't be empty
+        void firstLane(const Mask& mask) const {
+            if constexpr (EVEX) {
+                assembler.kmovw(EAX, mask);
+            } else {
+                assembler.vmovmskps(EAX, mask);
+            }
+            assembler.bsf(EAX, EAX);
+        }
+
+        // dst = the dword at TMP_ADDRESS_REGISTER (an offset into laneLocalMemory) for every lane in mask, the other
+        // lanes of dst are left alone. Goes through TMP_MASK_REGISTER, the gathers eat their mask.
+        void gather(const Vector& dst, const Mask& mask) const {
+            maskCopy(Target<LANES>::TMP_MASK_REGISTER, mask);
+            if constexpr (EVEX) {
+                assembler.k(Target<LANES>::TMP_MASK_REGISTER).vpgatherdd(dst, laneMemory());
+            } else {
+                assembler.vpgatherdd(dst, laneMemory(), Target<LANES>::TMP_MASK_REGISTER);
+            }
+        }
+
+        // The other way around, for the width low bytes of every lane of src in mask, which can't be empty. AVX-512
+        // only scatters whole dwords. AVX2 can't scatter at all, so the offsets and values go out to VectorState and
+        // every lane is stored on its own, which clobbers EAX, ECX and EDX.
+        void scatter(const Vector& src, const Mask& mask, const MachineWord width) const {
+            if constexpr (EVEX) {
+                maskCopy(Target<LANES>::TMP_MASK_REGISTER, mask);
+                assembler.k(Target<LANES>::TMP_MASK_REGISTER).vpscatterdd(laneMemory(), src);
+            } else {
+                const auto offsets = static_cast<std::int32_t>(offsetof(VectorState<LANES>, storeAddress));
+                const auto values  = static_cast<std::int32_t>(offsetof(VectorState<LANES>, storeValue));
+                store(Target<LANES>::vectorPtr(offsets), Target<LANES>::TMP_ADDRESS_REGISTER);
+                store(Target<LANES>::vectorPtr(values), src);
+                assembler.vmovmskps(EAX, mask);
+
+                const auto next = assembler.newLabel();
+                assembler.bind(next);
+                assembler.bsf(ECX, EAX);
+                assembler.mov(EDX, x86::dword_ptr(STATE_REGISTER, RCX, 2, offsets));
+                assembler.mov(ECX, x86::dword_ptr(STATE_REGISTER, RCX, 2, values));
+                if (width == 1) {
+                    assembler.mov(x86::byte_ptr(MEMORY_REGISTER, RDX), x86::cl);
+                } else if (width == 2) {
+                    assembler.mov(x86::word_ptr(MEMORY_REGISTER, RDX), x86::cx);
+                } else {
+                    assembler.mov(x86::dword_ptr(MEMORY_REGISTER, RDX), ECX);
+                }
+                // Clear the lowest set bit
+                assembler.lea(ECX, x86::ptr(RAX, -1));
+                assembler.and_(EAX, ECX);
+                assembler.jnz(next);
+            }
+        }
+
+        // Sets the dirty map word (at map in laneLocalMemory) of every lane in mask, which can't be empty, to all ones.
+        // chunks has their indices into the map. AVX-512 scatters scratch, AVX2 goes a lane at a time like scatter()
+        // does, which clobbers EAX, ECX and EDX instead.
+        void markDirty(const Vector& chunks, const Vector& scratch, const Mask& mask, const std::int32_t map) const {
+            if constexpr (EVEX) {
+                allOnes(scratch);
+                maskCopy(Target<LANES>::TMP_MASK_REGISTER, mask);
+                assembler.k(Target<LANES>::TMP_MASK_REGISTER)
+                        .vpscatterdd(x86::dword_ptr(MEMORY_REGISTER, chunks, 2, map), scratch);
+            } else {
+                const auto offsets = static_cast<std::int32_t>(offsetof(VectorState<LANES>, storeAddress));
+                store(Target<LANES>::vectorPtr(offsets), chunks);
+                assembler.vmovmskps(EAX, mask);
+
+                const auto next = assembler.newLabel();
+                assembler.bind(next);
+                assembler.bsf(ECX, EAX);
+                assembler.mov(EDX, x86::dword_ptr(STATE_REGISTER, RCX, 2, offsets));
+                assembler.mov(x86::dword_ptr(MEMORY_REGISTER, RDX, 2, map), -1);
+                assembler.lea(ECX, x86::ptr(RAX, -1));
+                assembler.and_(EAX, ECX);
+                assembler.jnz(next);
+            }
+        }
+
+        // dst = the lanes of within where a <condition> b. dst can't be a or b.
+        void compare(const Mask& dst, const Vector& a, const Vector& b, const Condition condition,
+                     const Mask& within) const {
+            if constexpr (EVEX) {
+                switch (condition) {
+                    case Condition::EQ: {
+                        assembler.k(within).vpcmpd(dst, a, b, x86::VPCmpImm::kEQ);
+                        break;
+                    }
+                    case Condition::NE: {
+                        assembler.k(within).vpcmpd(dst, a, b, x86::VPCmpImm::kNE);
+                        break;
+                    }
+                    case Condition::LT: {
+                        assembler.k(within).vpcmpd(dst, a, b, x86::VPCmpImm::kLT);
+                        break;
+                    }
+                    case Condition::GE: {
+                        assembler.k(within).vpcmpd(dst, a, b, x86::VPCmpImm::kGE);
+                        break;
+                    }
+                    case Condition::LTU: {
+                        assembler.k(within).vpcmpud(dst, a, b, x86::VPCmpImm::kLT);
+                        break;
+                    }
+                    case Condition::GEU: {
+                        assembler.k(within).vpcmpud(dst, a, b, x86::VPCmpImm::kGE);
+                        break;
+                    }
+                    case Condition::GTU: {
+                        assembler.k(within).vpcmpud(dst, a, b, x86::VPCmpImm::kGT);
+                        break;
+                    }
+                }
+            } else {
+                // Only signed greater-than and equality, the rest are built from those (and unsigned max) and flipped
+                // on the way into within
+                auto inverted = false;
+                switch (condition) {
+                    case Condition::EQ:
+                    case Condition::NE: {
+                        assembler.vpcmpeqd(dst, a, b);
+                        inverted = condition == Condition::NE;
+                        break;
+                    }
+                    case Condition::LT:
+                    case Condition::GE: {
+                        assembler.vpcmpgtd(dst, b, a);
+                        inverted = condition == Condition::GE;
+                        break;
+                    }
+                    case Condition::LTU:
+                    case Condition::GEU: {
+                        // a >= b exactly when max(a, b) == a
+                        assembler.vpmaxud(dst, a, b);
+                        assembler.vpcmpeqd(dst, dst, a);
+                        inverted = condition == Condition::LTU;
+                        break;
+                    }
+                    case Condition::GTU: {
+                        // a > b exactly when max(a, b) != b
+                        assembler.vpmaxud(dst, a, b);
+                        assembler.vpcmpeqd(dst, dst, b);
+                        inverted = true;
+                        break;
+                    }
+                }
+                if (inverted) {
+                    assembler.vpandn(dst, dst, within);
+                } else {
+                    assembler.vpand(dst, dst, within);
+                }
+            }
+        }
+
+        // RISC-V wants 0 or 1 where x86 has a mask
+        void setFromMask(const Vector& dst, const Mask& mask) const {
+            if constexpr (EVEX) {
+                assembler.vpmovm2d(dst, mask);
+                assembler.vpsrld(dst, dst, 31);
+            } else {
+                assembler.vpsrld(dst, mask, 31);
+            }
+        }
+
+    private:
+        static x86::Mem laneMemory() { return x86::dword_ptr(MEMORY_REGISTER, Target<LANES>::TMP_ADDRESS_REGISTER); }
+
+        x86::Assembler& assembler;
+    };
+
+    // Home slot of a guest register in VectorState::x
+    template <std::size_t LANES>
+    x86::Mem homeSlot(const std::uint8_t guest) {
+        const auto offset = offsetof(VectorState<LANES>, x) + guest * LANES * sizeof(MachineWord);
+        return Target<LANES>::vectorPtr(static_cast<std::int32_t>(offset));
+    }
+
+    // One lane's element of a guest register's home slot, the lane's index is in RAX
+    template <std::size_t LANES>
+    x86::Mem homeSlotElement(const std::uint8_t guest) {
+        const auto offset = offsetof(VectorState<LANES>, x) + guest * LANES * sizeof(MachineWord);
+        return x86::dword_ptr(STATE_REGISTER, RAX, 2, static_cast<std::int32_t>(offset));
+    }
+
+    template <std::size_t LANES>
+    x86::Mem pcVector() {
+        return Target<LANES>::vectorPtr(static_cast<std::int32_t>(offsetof(VectorState<LANES>, pc)));
+    }
+
+    template <std::size_t LANES>
+    x86::Mem laneErrors() {
+        return Target<LANES>::vectorPtr(static_cast<std::int32_t>(offsetof(VectorState<LANES>, error)));
+    }
+
+    template <std::size_t LANES>
+    x86::Mem budgetVector() {
+        return Target<LANES>::vectorPtr(static_cast<std::int32_t>(offsetof(VectorState<LANES>, budget)));
+    }
+
+    // asmjit wants immediates that fit the operand size, so hand it the signed view of the word
+    std::int32_t imm32(const MachineWord value) { return static_cast<std::int32_t>(value); }
+
+    // Bytes a load or store touches
+    MachineWord accessWidth(const MicroOpHandler handler) {
+        switch (handler) {
+            case MicroOpHandler::LB:
+            case MicroOpHandler::LBU:
+            case MicroOpHandler::SB: {
+                return 1;
+            }
+            case MicroOpHandler::LH:
+            case MicroOpHandler::LHU:
+            case MicroOpHandler::SH: {
+                return 2;
+            }
+            default: {
+                return 4;
+            }
+        }
+    }
+
+    // Arithmetic that also has a version on general purpose registers, for when the lanes agree on every source
+    bool hasScalarForm(const MicroOpHandler handler) {
+        switch (handler) {
+            case MicroOpHandler::LUI:
+            case MicroOpHandler::AUIPC:
+            case MicroOpHandler::ADDI:
+            case MicroOpHandler::SLTI:
+            case MicroOpHandler::SLTIU:
+            case MicroOpHandler::XORI:
+            case MicroOpHandler::ORI:
+            case MicroOpHandler::ANDI:
+            case MicroOpHandler::SLLI:
+            case MicroOpHandler::SRLI:
+            case MicroOpHandler::SRAI:
+            case MicroOpHandler::ADD:
+            case MicroOpHandler::SUB:
+            case MicroOpHandler::SLL:
+            case MicroOpHandler::SLT:
+            case MicroOpHandler::SLTU:
+            case MicroOpHandler::XOR:
+            case MicroOpHandler::SRL:
+            case MicroOpHandler::SRA:
+            case MicroOpHandler::OR:
+            case MicroOpHandler::AND: {
+                return true;
+            }
+            default: {
+                return false;
+            }
+        }
+    }
+
+    bool isLoad(const MicroOpHandler handler) {
+        return handler >= MicroOpHandler::LB && handler <= MicroOpHandler::LHU;
+    }
+
+    // Whether the lanes running op agree on all of its sources
+    bool agrees(const MicroOp& op, const GuestRegisterSet uniform) { return (registersRead(op) & ~uniform) == 0; }
+
+    // What the lanes agree on after op: arithmetic on values they agree on, and links, which are constants. Never
+    // anything loaded from memory.
+    GuestRegisterSet uniformAfter(const MicroOp& op, const GuestRegisterSet uniform) {
+        const auto written = registersWritten(op);
+        if (isLoad(op.handler) || (hasScalarForm(op.handler) && !agrees(op, uniform))) {
+            return uniform & ~written;
+        }
+        return uniform | written;
+    }
+
+    // Bits of a word the low width bytes take up
+    MachineWord widthMask(const MachineWord width) { return width == 4 ? 0xffffffff : (1u << width * 8) - 1; }
+
+    template <std::size_t LANES>
+    std::vector<std::uint8_t> allocatableRegisters(const LaneMemoryLayout layout) {
+        using T = Target<LANES>;
+        static_assert(T::TMP_SHIFT_REGISTER.id() == T::FIRST_ALLOCATABLE_REGISTER &&
+                      T::TMP_WORD_REGISTER.id() == T::FIRST_ALLOCATABLE_REGISTER + 1);
+
+        std::vector<std::uint8_t> registers;
+        const auto first = T::FIRST_ALLOCATABLE_REGISTER + (layout == LaneMemoryLayout::INTERLEAVED ? 2 : 0);
+        for (auto i = first; i < T::REGISTER_COUNT; i++) {
+            registers.push_back(i);
+        }
+        return registers;
+    }
+} // namespace
+
+template <std::size_t LANES>
+bool VectorJITBackend<LANES>::hostSupports() {
+    const auto& features = asmjit::CpuInfo::host().features().x86();
+    if constexpr (LANES == 16) {
+        // BW for the byte blend in sb/sh, DQ for turning masks into vectors
+        return features.hasAVX512_F() && features.hasAVX512_BW() && features.hasAVX512_DQ();
+    } else {
+        return features.hasAVX2();
+    }
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::translate() {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    scheduler   = assembler.newLabel();
+    misdispatch = assembler.newLabel();
+
+    const auto epilogue = assembler.newLabel();
+
+    // Prologue: (state, laneLocalMemory, dispatchTable) come in as rdi, rsi, rdx. Every lane without an error starts
+    // out live, at the pc in state.pc, so the scheduler can pick where to start (and retire the ones run() left at
+    // DONE_ADDRESS).
+    assembler.push(STATE_REGISTER);
+    assembler.push(MEMORY_REGISTER);
+    assembler.push(DISPATCH_REGISTER);
+    assembler.push(x86::rbp);
+    assembler.push(x86::r14);
+    assembler.push(x86::r15);
+    assembler.mov(STATE_REGISTER, x86::rdi);
+    assembler.mov(MEMORY_REGISTER, x86::rsi);
+    assembler.mov(DISPATCH_REGISTER, x86::rdx);
+    isa.bitwiseXor(T::ZERO_REGISTER, T::ZERO_REGISTER, T::ZERO_REGISTER);
+    assembler.xor_(x86::gpd(SCALAR_ZERO_REGISTER), x86::gpd(SCALAR_ZERO_REGISTER));
+    assembler.mov(RAX, translation->laneBaseAddressOffsets.data());
+    isa.load(T::LANE_OFFSET_REGISTER, x86::ptr(RAX));
+    isa.load(T::BUDGET_REGISTER, budgetVector<LANES>());
+    isa.load(T::TMP_DATA_REGISTER, laneErrors<LANES>());
+    isa.maskAll(T::LIVE_LANES_REGISTER);
+    isa.compare(T::LIVE_LANES_REGISTER, T::TMP_DATA_REGISTER, T::ZERO_REGISTER, Condition::EQ,
+                T::LIVE_LANES_REGISTER);
+    assembler.jmp(scheduler);
+
+    for (auto i = 0ull; i < numberOfInstructions; i++) {
+        if (isLeader[i]) {
+            allocator.beginBlock();
+            scalars.beginBlock();
+        }
+        emitInstruction(microOps[i], i);
+    }
+
+    // Sentinel, for falling off the end of the program or jumping at something that isn't in it. The scheduler turns
+    // the pc into an OUT_OF_PROGRAM error.
+    assembler.bind(labels[numberOfInstructions]);
+    isa.broadcast(T::TMP_DATA_REGISTER, numberOfInstructions * 4);
+    isa.maskedStore(pcVector<LANES>(), T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+    assembler.jmp(scheduler);
+
+    // Cold paths for blocks that end with their lanes going different ways (or while other lanes are waiting).
+    // TMP_MASK_REGISTER holds the lanes that took the branch.
+    for (const auto& [label, target, fallthrough, split] : divergenceStubs) {
+        assembler.bind(label);
+        isa.broadcast(T::TMP_DATA_REGISTER, target * 4);
+        if (split) {
+            isa.maskedStore(pcVector<LANES>(), T::TMP_DATA_REGISTER, T::TMP_MASK_REGISTER);
+            isa.maskAndNot(T::DIVERGENCE_MASK_REGISTER, T::TMP_MASK_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+            isa.broadcast(T::TMP_DATA_REGISTER, fallthrough * 4);
+            isa.maskedStore(pcVector<LANES>(), T::TMP_DATA_REGISTER, T::DIVERGENCE_MASK_REGISTER);
+        } else {
+            isa.maskedStore(pcVector<LANES>(), T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+        }
+        assembler.jmp(scheduler);
+    }
+
+    // Cold paths for lanes stopping in the middle of a block. If any of the lanes running it are left they carry on
+    // where they were, their registers are still where the block put them.
+    for (const auto& [label, resume, pc, error] : stopStubs) {
+        assembler.bind(label);
+        isa.broadcast(T::TMP_DATA_REGISTER, pc);
+        isa.maskedStore(pcVector<LANES>(), T::TMP_DATA_REGISTER, T::DIVERGENCE_MASK_REGISTER);
+        if (error == ExecutionError::NONE) {
+            // Only waiting, see emitGuard(). Somebody is always left.
+            isa.maskAndNot(T::EXECUTION_CONTROL_REGISTER, T::DIVERGENCE_MASK_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+            assembler.jmp(resume);
+            continue;
+        }
+        isa.broadcast(T::TMP_DATA_REGISTER, static_cast<MachineWord>(error));
+        isa.maskedStore(laneErrors<LANES>(), T::TMP_DATA_REGISTER, T::DIVERGENCE_MASK_REGISTER);
+        isa.maskAndNot(T::EXECUTION_CONTROL_REGISTER, T::DIVERGENCE_MASK_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+        isa.maskAndNot(T::LIVE_LANES_REGISTER, T::DIVERGENCE_MASK_REGISTER, T::LIVE_LANES_REGISTER);
+        isa.testMask(T::EXECUTION_CONTROL_REGISTER);
+        assembler.jnz(resume);
+        assembler.jmp(scheduler);
+    }
+
+    // The dispatch table sends pcs in the middle of a basic block here, the code there expects registers the block
+    // loaded earlier. Doesn't happen with compiled code, jalr only goes to return addresses and function entries.
+    assembler.bind(misdispatch);
+    isa.broadcast(T::TMP_DATA_REGISTER, static_cast<MachineWord>(ExecutionError::OUT_OF_PROGRAM));
+    isa.maskedStore(laneErrors<LANES>(), T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+    isa.maskAndNot(T::LIVE_LANES_REGISTER, T::EXECUTION_CONTROL_REGISTER, T::LIVE_LANES_REGISTER);
+
+    // Scheduler. Every live lane's pc is in state.pc. Retires the lanes that are done or left the program, then runs
+    // the block at the lowest pc with every lane that is at it. Lanes that went different ways meet up again at the
+    // first block they have in common (after an if/else, that's the block after it).
+    assembler.bind(scheduler);
+    isa.load(T::TMP_DATA_REGISTER, pcVector<LANES>());
+
+    // Returned to DONE_ADDRESS, the error stays NONE
+    isa.broadcast(T::TMP_ADDRESS_REGISTER, DONE_ADDRESS);
+    isa.compare(T::TMP_MASK_REGISTER, T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, Condition::EQ,
+                T::LIVE_LANES_REGISTER);
+    isa.maskAndNot(T::LIVE_LANES_REGISTER, T::TMP_MASK_REGISTER, T::LIVE_LANES_REGISTER);
+
+    // Outside of the program or not aligned
+    isa.broadcast(T::TMP_ADDRESS_REGISTER, numberOfInstructions * 4);
+    isa.compare(T::TMP_MASK_REGISTER, T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, Condition::GEU,
+                T::LIVE_LANES_REGISTER);
+    isa.broadcast(T::TMP_ADDRESS_REGISTER, 3);
+    isa.bitwiseAnd(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER);
+    isa.compare(T::DIVERGENCE_MASK_REGISTER, T::TMP_ADDRESS_REGISTER, T::ZERO_REGISTER, Condition::NE,
+                T::LIVE_LANES_REGISTER);
+    isa.maskOr(T::TMP_MASK_REGISTER, T::TMP_MASK_REGISTER, T::DIVERGENCE_MASK_REGISTER);
+    isa.broadcast(T::TMP_ADDRESS_REGISTER, static_cast<MachineWord>(ExecutionError::OUT_OF_PROGRAM));
+    isa.maskedStore(laneErrors<LANES>(), T::TMP_ADDRESS_REGISTER, T::TMP_MASK_REGISTER);
+    isa.maskAndNot(T::LIVE_LANES_REGISTER, T::TMP_MASK_REGISTER, T::LIVE_LANES_REGISTER);
+
+    isa.testMask(T::LIVE_LANES_REGISTER);
+    assembler.jz(epilogue);
+
+    // Lanes are done and run() has more inputs for them
+    const auto refillBelowOffset = static_cast<std::int32_t>(offsetof(VectorState<LANES>, refillBelow));
+    if constexpr (LANES == 16) {
+        assembler.kmovw(EAX, T::LIVE_LANES_REGISTER);
+    } else {
+        assembler.vmovmskps(EAX, T::LIVE_LANES_REGISTER);
+    }
+    assembler.popcnt(EAX, EAX);
+    assembler.cmp(EAX, x86::dword_ptr(STATE_REGISTER, refillBelowOffset));
+    assembler.jb(epilogue);
+
+    // Horizontal minimum over the live lanes (the rest are set to the largest pc there is), ends up in every element
+    if constexpr (LANES == 16) {
+        assembler.vpternlogd(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, 0xff);
+        assembler.k(T::LIVE_LANES_REGISTER).vmovdqu32(T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER);
+        assembler.vshufi32x4(T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, 0x4e);
+        assembler.vpminud(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER);
+        assembler.vshufi32x4(T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, 0xb1);
+        assembler.vpminud(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER);
+        assembler.vpshufd(T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, 0x4e);
+        assembler.vpminud(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER);
+        assembler.vpshufd(T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, 0xb1);
+        assembler.vpminud(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER);
+    } else {
+        // Folded down to one xmm register, then broadcast back out
+        const auto low  = T::TMP_ADDRESS_REGISTER.xmm();
+        const auto high = T::TMP_DATA_REGISTER.xmm();
+        assembler.vpcmpeqd(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER);
+        assembler.vpblendvb(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER,
+                            T::LIVE_LANES_REGISTER);
+        assembler.vextracti128(high, T::TMP_ADDRESS_REGISTER, 1);
+        assembler.vpminud(low, low, high);
+        assembler.vpshufd(high, low, 0x4e);
+        assembler.vpminud(low, low, high);
+        assembler.vpshufd(high, low, 0xb1);
+        assembler.vpminud(low, low, high);
+        assembler.vpbroadcastd(T::TMP_ADDRESS_REGISTER, low);
+        isa.load(T::TMP_DATA_REGISTER, pcVector<LANES>());
+    }
+
+    // Everyone at the minimum runs next. Entries are 8 bytes, one per 4 bytes of pc.
+    if constexpr (LANES == 16) {
+        assembler.k(T::LIVE_LANES_REGISTER)
+                .vpcmpd(T::EXECUTION_CONTROL_REGISTER, T::TMP_ADDRESS_REGISTER, pcVector<LANES>(), x86::VPCmpImm::kEQ);
+    } else {
+        isa.compare(T::EXECUTION_CONTROL_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER, Condition::EQ,
+                    T::LIVE_LANES_REGISTER);
+    }
+    assembler.vmovd(EAX, T::TMP_ADDRESS_REGISTER.xmm());
+    assembler.jmp(x86::qword_ptr(DISPATCH_REGISTER, RAX, 1));
+
+    // Epilogue
+    assembler.bind(epilogue);
+    isa.store(budgetVector<LANES>(), T::BUDGET_REGISTER);
+    assembler.pop(x86::r15);
+    assembler.pop(x86::r14);
+    assembler.pop(x86::rbp);
+    assembler.pop(DISPATCH_REGISTER);
+    assembler.pop(MEMORY_REGISTER);
+    assembler.pop(STATE_REGISTER);
+    assembler.vzeroupper();
+    assembler.ret();
+
+    if (const auto error = translation->runtime.add(&translation->function, &code); error != asmjit::kErrorOk) {
+        spdlog::error("Failed to add the translated program to the JIT runtime: {}",
+                      asmjit::DebugUtils::errorAsString(error));
+        exit(EXIT_FAILURE);
+    }
+
+    auto& dispatchTable   = translation->dispatchTable;
+    const auto base       = reinterpret_cast<std::uintptr_t>(translation->function);
+    const auto wrongTurns = reinterpret_cast<const void*>(base + code.labelOffsetFromBase(misdispatch));
+    dispatchTable.resize(numberOfInstructions);
+    for (auto i = 0ull; i < numberOfInstructions; i++) {
+        dispatchTable[i] =
+                isLeader[i] ? reinterpret_cast<const void*>(base + code.labelOffsetFromBase(labels[i])) : wrongTurns;
+    }
+
+    spdlog::info("Translated {} instructions into {} bytes of code for {} lanes, {} values were spilled in the middle "
+                 "of a block, {} instructions run on general purpose registers.",
+                 numberOfInstructions, code.codeSize(), LANES, allocator.spillCount() + scalars.spillCount(),
+                 scalarInstructions);
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::run() {
+    run(nullptr);
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::run(const LaneRefill& refill) {
+    lanes.backend = this;
+
+    // The lanes that were running when the code was entered, the ones that aren't anymore when it returns are done.
+    // Lanes that were done before run() don't count, or the code would come straight back out for them every time.
+    std::array<bool, LANES> running;
+    std::uint32_t runningCount = 0;
+    for (auto lane = 0ull; lane < LANES; lane++) {
+        running[lane] = lanes.error[lane] == static_cast<std::int32_t>(ExecutionError::NONE) &&
+                        lanes.pc[lane] != DONE_ADDRESS;
+        runningCount += running[lane];
+    }
+    lanes.refillBelow = refill ? runningCount : 0;
+
+    while (true) {
+        translation->function(&lanes, laneLocalMemory, translation->dispatchTable.data());
+
+        auto anyRunning = false;
+        for (auto lane = 0ull; lane < LANES; lane++) {
+            if (!running[lane]) {
+                continue;
+            }
+            if (lanes.error[lane] == static_cast<std::int32_t>(ExecutionError::NONE) &&
+                lanes.pc[lane] != DONE_ADDRESS) {
+                anyRunning = true;
+                continue;
+            }
+            recordResult(lane);
+            running[lane] = false;
+            if (!refill) {
+                continue;
+            }
+            // Once it's out of inputs, there's no point in coming back out for the rest. As long as it isn't, every lane
+            // that's done is running again, and runningCount is still right.
+            if (refill(lane, laneResults[lane])) {
+                running[lane] = true;
+                anyRunning    = true;
+            } else {
+                lanes.refillBelow = 0;
+            }
+        }
+        if (!anyRunning) {
+            break;
+        }
+    }
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::recordResult(const std::size_t lane) {
+    auto& result            = laneResults[lane];
+    result.returnValue      = static_cast<std::int32_t>(lanes.x[10][lane]);
+    result.error            = static_cast<ExecutionError>(lanes.error[lane]);
+    result.instructionCount = result.error == ExecutionError::INSTRUCTION_LIMIT
+                                      ? instructionLimit
+                                      : instructionLimit - static_cast<std::uint64_t>(lanes.budget[lane]);
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::reset() {
+    for (auto lane = 0ull; lane < LANES; lane++) {
+        resetLane(lane);
+    }
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::resetLane(const std::size_t lane) {
+    for (std::size_t chunk = 0; chunk < chunksPerLane(); chunk++) {
+        auto& dirty = dirtyChunks[dirtyIndex(lane, chunk)];
+        if (dirty != 0) {
+            restoreChunk(lane, chunk);
+            dirty = 0;
+        }
+    }
+    resetLaneState(lane);
+}
+
+template <std::size_t LANES>
+std::size_t VectorJITBackend<LANES>::chunksPerLane() const {
+    return (static_cast<std::size_t>(memoryEnd) + (1u << DIRTY_CHUNK_SHIFT) - 1) >> DIRTY_CHUNK_SHIFT;
+}
+
+template <std::size_t LANES>
+std::size_t VectorJITBackend<LANES>::dirtyIndex(const std::size_t lane, const std::size_t chunk) const {
+    if (layout == LaneMemoryLayout::CONTIGUOUS) {
+        return (translation->laneBaseAddressOffsets[lane] >> DIRTY_CHUNK_SHIFT) + chunk;
+    }
+    return chunk * LANES + lane;
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::restoreChunk(const std::size_t lane, const std::size_t chunk) {
+    // A store marks the chunk it starts in, which can run up to XLEN - 1 bytes into the next one
+    const auto begin = static_cast<MachineWord>(chunk << DIRTY_CHUNK_SHIFT);
+    copyFromImage(lane, begin, std::min<MachineWord>(begin + (1u << DIRTY_CHUNK_SHIFT) + XLEN - 1, memoryEnd));
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::copyFromImage(const std::size_t lane, const MachineWord begin, const MachineWord end) {
+    const auto* image = translation->image->data();
+    if (layout == LaneMemoryLayout::CONTIGUOUS) {
+        std::memcpy(&laneLocalMemory[hostOffset(lane, begin)], image + begin, end - begin);
+        return;
+    }
+    // A word per row. The image has zeros after its end, so the last one can be copied whole.
+    for (auto address = begin; address < end; address += XLEN) {
+        std::memcpy(&laneLocalMemory[hostOffset(lane, address)], image + address, XLEN);
+    }
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::copyInitialMemory() {
+    for (std::size_t lane = 0; lane < LANES; lane++) {
+        copyFromImage(lane, 0, memoryEnd);
+    }
+    std::fill_n(dirtyChunks, dirtyChunkCount, 0);
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::resetLaneState(const std::size_t lane) {
+    const auto limit   = static_cast<std::int32_t>(std::min<std::uint64_t>(instructionLimit, INT32_MAX));
+    lanes.pc[lane]     = state.pc;
+    lanes.error[lane]  = static_cast<std::int32_t>(ExecutionError::NONE);
+    lanes.budget[lane] = limit;
+    for (auto reg = 0; reg < 32; reg++) {
+        lanes.x[reg][lane] = state.x[reg];
+    }
+    laneResults[lane] = ExecutionResult{};
+    guestSystem.reset(lane);
+}
+
+template <std::size_t LANES>
+bool VectorJITBackend<LANES>::writeInput(const std::size_t lane, const MachineWord address, const std::uint8_t* data,
+                                         const std::size_t size) {
+    if (size == 0) {
+        return true;
+    }
+    if (address >= memoryEnd || size > memoryEnd - address) {
+        return false;
+    }
+    const auto last = (address + size - 1) >> DIRTY_CHUNK_SHIFT;
+    for (std::size_t chunk = address >> DIRTY_CHUNK_SHIFT; chunk <= last; chunk++) {
+        dirtyChunks[dirtyIndex(lane, chunk)] = ~0u;
+    }
+    if (layout == LaneMemoryLayout::CONTIGUOUS) {
+        std::memcpy(&laneLocalMemory[hostOffset(lane, address)], data, size);
+    } else {
+        for (std::size_t i = 0; i < size; i++) {
+            laneLocalMemory[hostOffset(lane, address + i)] = data[i];
+        }
+    }
+    return true;
+}
+
+template <std::size_t LANES>
+bool VectorJITBackend<LANES>::readMemory(const std::size_t lane, const MachineWord address, std::uint8_t* data,
+                                         const std::size_t size) const {
+    if (size == 0) {
+        return true;
+    }
+    if (address >= memoryEnd || size > memoryEnd - address) {
+        return false;
+    }
+    for (std::size_t i = 0; i < size; i++) {
+        data[i] = laneLocalMemory[hostOffset(lane, address + i)];
+    }
+    return true;
+}
+
+template <std::size_t LANES>
+std::size_t VectorJITBackend<LANES>::hostOffset(const std::size_t lane, const MachineWord address) const {
+    const auto base = translation->laneBaseAddressOffsets[lane];
+    if (layout == LaneMemoryLayout::CONTIGUOUS) {
+        return base + address;
+    }
+    return static_cast<std::size_t>(address & ~3u) * LANES + base + (address & 3);
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::emitInstruction(const MicroOp& op, const std::size_t index) {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    const MachineWord pc = index * 4;
+
+    // Pay for the whole block up front, lanes that can't afford it stop here. Lanes that have to wait their turn (see
+    // emitGuard()) don't pay until they get it.
+    if (isLeader[index]) {
+        assembler.bind(labels[index]);
+        emitGuard(index);
+
+        auto length = 1ull;
+        while (!isLeader[index + length]) {
+            length++;
+        }
+        const auto resume = assembler.newLabel();
+        isa.broadcast(T::TMP_DATA_REGISTER, length);
+        if constexpr (LANES == 16) {
+            assembler.k(T::EXECUTION_CONTROL_REGISTER)
+                    .vpsubd(T::BUDGET_REGISTER, T::BUDGET_REGISTER, T::TMP_DATA_REGISTER);
+        } else {
+            isa.bitwiseAnd(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+            assembler.vpsubd(T::BUDGET_REGISTER, T::BUDGET_REGISTER, T::TMP_DATA_REGISTER);
+        }
+        isa.compare(T::DIVERGENCE_MASK_REGISTER, T::BUDGET_REGISTER, T::ZERO_REGISTER, Condition::LT,
+                    T::EXECUTION_CONTROL_REGISTER);
+        isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+        assembler.jnz(stopStub(resume, pc, ExecutionError::INSTRUCTION_LIMIT));
+        assembler.bind(resume);
+    }
+    allocator.beginInstruction(index);
+    scalars.beginInstruction(index);
+
+    if (index >= MAX_NUMBER_OF_INSTRUCTIONS) {
+        spdlog::error("Maxed out the number of instructions supported. Consider changing MAX_NUMBER_OF_INSTRUCTIONS "
+                      "(currently {}).",
+                      MAX_NUMBER_OF_INSTRUCTIONS);
+    }
+
+    const auto use    = [&](const std::uint8_t guest) { return T::vector(allocator.use(guest)); };
+    const auto define = [&](const std::uint8_t guest) {
+        scalars.discard(guest);
+        return T::vector(allocator.define(guest));
+    };
+
+    // Constants, every lane agrees on them
+    const auto defineScalar = [&](const std::uint8_t guest) {
+        allocator.discard(guest);
+        return x86::gpd(scalars.define(guest));
+    };
+
+    // Every active lane continues at the same instruction. If nobody else is waiting that's a plain jump, otherwise the
+    // scheduler decides who runs next.
+    const auto continueAt = [&](const MachineWord targetIndex) {
+        const auto diverged = divergenceStub(targetIndex, 0, false);
+        isa.maskXor(T::DIVERGENCE_MASK_REGISTER, T::EXECUTION_CONTROL_REGISTER, T::LIVE_LANES_REGISTER);
+        isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+        assembler.jnz(diverged);
+        if (targetIndex != index + 1) {
+            assembler.jmp(labels[targetIndex]);
+        }
+    };
+
+    // Set once the instruction took care of leaving the block itself
+    auto leftBlock = false;
+
+    switch (op.handler) {
+        case MicroOpHandler::LUI:
+        case MicroOpHandler::AUIPC: {
+            // Both were folded into the immediate at decode time
+            emitScalar(op);
+            break;
+        }
+        case MicroOpHandler::JAL:
+        case MicroOpHandler::J: {
+            if (op.handler == MicroOpHandler::JAL) {
+                assembler.mov(defineScalar(op.rd), imm32(op.imm));
+            }
+            endBlock();
+            continueAt(op.target);
+            leftBlock = true;
+            break;
+        }
+        case MicroOpHandler::JALR:
+        case MicroOpHandler::JR: {
+            // The destination has to be computed before the link is written, rd and rs1 may be the same register
+            if (isUniform(op.rs1)) {
+                assembler.lea(EAX, x86::ptr(x86::gpq(scalars.use(op.rs1)), imm32(op.imm)));
+                assembler.and_(EAX, -2);
+                isa.broadcastRegister(T::TMP_DATA_REGISTER, EAX);
+            } else {
+                isa.broadcast(T::TMP_DATA_REGISTER, op.imm);
+                assembler.vpaddd(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, use(op.rs1));
+                isa.broadcast(T::TMP_ADDRESS_REGISTER, static_cast<MachineWord>(-2));
+                isa.bitwiseAnd(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER);
+            }
+            isa.maskedStore(pcVector<LANES>(), T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+            if (op.handler == MicroOpHandler::JALR) {
+                assembler.mov(defineScalar(op.rd), imm32(op.target));
+            }
+            // Every lane may be going somewhere else, let the scheduler sort it out
+            endBlock();
+            assembler.jmp(scheduler);
+            leftBlock = true;
+            break;
+        }
+        case MicroOpHandler::BEQ:
+        case MicroOpHandler::BNE:
+        case MicroOpHandler::BLT:
+        case MicroOpHandler::BGE:
+        case MicroOpHandler::BLTU:
+        case MicroOpHandler::BGEU: {
+            if (agrees(op, uniform)) {
+                // Every running lane goes the same way, so this is an ordinary compare and branch
+                const auto rs1 = x86::gpd(scalars.use(op.rs1));
+                const auto rs2 = x86::gpd(scalars.use(op.rs2));
+                endBlock();
+                assembler.cmp(rs1, rs2);
+                const auto notTaken = assembler.newLabel();
+                switch (op.handler) {
+                    case MicroOpHandler::BEQ: {
+                        assembler.jne(notTaken);
+                        break;
+                    }
+                    case MicroOpHandler::BNE: {
+                        assembler.je(notTaken);
+                        break;
+                    }
+                    case MicroOpHandler::BLT: {
+                        assembler.jge(notTaken);
+                        break;
+                    }
+                    case MicroOpHandler::BGE: {
+                        assembler.jl(notTaken);
+                        break;
+                    }
+                    case MicroOpHandler::BLTU: {
+                        assembler.jae(notTaken);
+                        break;
+                    }
+                    default: {
+                        assembler.jb(notTaken);
+                        break;
+                    }
+                }
+                continueAt(op.target);
+                assembler.bind(notTaken);
+                continueAt(index + 1);
+                leftBlock = true;
+                break;
+            }
+
+            const auto rs1 = use(op.rs1);
+            const auto rs2 = use(op.rs2);
+            auto condition = Condition::GEU;
+            switch (op.handler) {
+                case MicroOpHandler::BEQ: {
+                    condition = Condition::EQ;
+                    break;
+                }
+                case MicroOpHandler::BNE: {
+                    condition = Condition::NE;
+                    break;
+                }
+                case MicroOpHandler::BLT: {
+                    condition = Condition::LT;
+                    break;
+                }
+                case MicroOpHandler::BGE: {
+                    condition = Condition::GE;
+                    break;
+                }
+                case MicroOpHandler::BLTU: {
+                    condition = Condition::LTU;
+                    break;
+                }
+                default: {
+                    break;
+                }
+            }
+            isa.compare(T::TMP_MASK_REGISTER, rs1, rs2, condition, T::EXECUTION_CONTROL_REGISTER);
+            endBlock();
+
+            // Fast paths for when every live lane is here and they all agree. Anything else means someone has to
+            // wait, TMP_MASK_REGISTER tells the stub which lanes took the branch.
+            const auto split = divergenceStub(op.target, index + 1, true);
+            isa.maskXor(T::DIVERGENCE_MASK_REGISTER, T::EXECUTION_CONTROL_REGISTER, T::LIVE_LANES_REGISTER);
+            isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+            assembler.jnz(split);
+            isa.maskXor(T::DIVERGENCE_MASK_REGISTER, T::TMP_MASK_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+            isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+            assembler.jz(labels[op.target]);
+            isa.testMask(T::TMP_MASK_REGISTER);
+            assembler.jnz(split);
+            // Nobody took it, run into the next block
+            leftBlock = true;
+            break;
+        }
+        case MicroOpHandler::LB:
+        case MicroOpHandler::LH:
+        case MicroOpHandler::LW:
+        case MicroOpHandler::LBU:
+        case MicroOpHandler::LHU: {
+            emitLoad(op, pc);
+            break;
+        }
+        case MicroOpHandler::SB:
+        case MicroOpHandler::SH:
+        case MicroOpHandler::SW: {
+            emitStore(op, pc);
+            break;
+        }
+        case MicroOpHandler::ADDI:
+        case MicroOpHandler::XORI:
+        case MicroOpHandler::ORI:
+        case MicroOpHandler::ANDI: {
+            if (emitScalar(op)) {
+                break;
+            }
+            isa.broadcast(T::TMP_DATA_REGISTER, op.imm);
+            const auto src = use(op.rs1);
+            const auto dst = define(op.rd);
+            switch (op.handler) {
+                case MicroOpHandler::ADDI: {
+                    assembler.vpaddd(dst, src, T::TMP_DATA_REGISTER);
+                    break;
+                }
+                case MicroOpHandler::XORI: {
+                    isa.bitwiseXor(dst, src, T::TMP_DATA_REGISTER);
+                    break;
+                }
+                case MicroOpHandler::ORI: {
+                    isa.bitwiseOr(dst, src, T::TMP_DATA_REGISTER);
+                    break;
+                }
+                default: {
+                    isa.bitwiseAnd(dst, src, T::TMP_DATA_REGISTER);
+                    break;
+                }
+            }
+            break;
+        }
+        case MicroOpHandler::SLTI:
+        case MicroOpHandler::SLTIU: {
+            if (emitScalar(op)) {
+                break;
+            }
+            isa.broadcast(T::TMP_DATA_REGISTER, op.imm);
+            const auto condition = op.handler == MicroOpHandler::SLTI ? Condition::LT : Condition::LTU;
+            isa.compare(T::TMP_MASK_REGISTER, use(op.rs1), T::TMP_DATA_REGISTER, condition,
+                        T::EXECUTION_CONTROL_REGISTER);
+            isa.setFromMask(define(op.rd), T::TMP_MASK_REGISTER);
+            break;
+        }
+        case MicroOpHandler::SLLI:
+        case MicroOpHandler::SRLI:
+        case MicroOpHandler::SRAI: {
+            if (emitScalar(op)) {
+                break;
+            }
+            // The shift amount was already masked down to 5 bits when decoding
+            const auto src = use(op.rs1);
+            const auto dst = define(op.rd);
+            if (op.handler == MicroOpHandler::SLLI) {
+                assembler.vpslld(dst, src, imm32(op.imm));
+            } else if (op.handler == MicroOpHandler::SRLI) {
+                assembler.vpsrld(dst, src, imm32(op.imm));
+            } else {
+                assembler.vpsrad(dst, src, imm32(op.imm));
+            }
+            break;
+        }
+        case MicroOpHandler::ADD:
+        case MicroOpHandler::SUB:
+        case MicroOpHandler::XOR:
+        case MicroOpHandler::OR:
+        case MicroOpHandler::AND: {
+            if (emitScalar(op)) {
+                break;
+            }
+            const auto rs1 = use(op.rs1);
+            const auto rs2 = use(op.rs2);
+            const auto dst = define(op.rd);
+            switch (op.handler) {
+                case MicroOpHandler::ADD: {
+                    assembler.vpaddd(dst, rs1, rs2);
+                    break;
+                }
+                case MicroOpHandler::SUB: {
+                    assembler.vpsubd(dst, rs1, rs2);
+                    break;
+                }
+                case MicroOpHandler::XOR: {
+                    isa.bitwiseXor(dst, rs1, rs2);
+                    break;
+                }
+                case MicroOpHandler::OR: {
+                    isa.bitwiseOr(dst, rs1, rs2);
+                    break;
+                }
+                default: {
+                    isa.bitwiseAnd(dst, rs1, rs2);
+                    break;
+                }
+            }
+            break;
+        }
+        case MicroOpHandler::SLL:
+        case MicroOpHandler::SRL:
+        case MicroOpHandler::SRA: {
+            if (emitScalar(op)) {
+                break;
+            }
+            // Variable shifts don't mask the count like RISC-V does, they shift everything out instead
+            isa.broadcast(T::TMP_DATA_REGISTER, 0x1f);
+            isa.bitwiseAnd(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, use(op.rs2));
+            const auto rs1 = use(op.rs1);
+            const auto dst = define(op.rd);
+            if (op.handler == MicroOpHandler::SLL) {
+                assembler.vpsllvd(dst, rs1, T::TMP_DATA_REGISTER);
+            } else if (op.handler == MicroOpHandler::SRL) {
+                assembler.vpsrlvd(dst, rs1, T::TMP_DATA_REGISTER);
+            } else {
+                assembler.vpsravd(dst, rs1, T::TMP_DATA_REGISTER);
+            }
+            break;
+        }
+        case MicroOpHandler::SLT:
+        case MicroOpHandler::SLTU: {
+            if (emitScalar(op)) {
+                break;
+            }
+            const auto condition = op.handler == MicroOpHandler::SLT ? Condition::LT : Condition::LTU;
+            isa.compare(T::TMP_MASK_REGISTER, use(op.rs1), use(op.rs2), condition, T::EXECUTION_CONTROL_REGISTER);
+            isa.setFromMask(define(op.rd), T::TMP_MASK_REGISTER);
+            break;
+        }
+        case MicroOpHandler::NOP: {
+            break;
+        }
+        case MicroOpHandler::ECALL: {
+            emitSystemCall(pc);
+            leftBlock = true;
+            break;
+        }
+        default: {
+            // ILLEGAL, and superinstructions can't show up since we asked for an unfused decode. The active lanes stop
+            // here, the others carry on.
+            endBlock();
+            isa.broadcast(T::TMP_DATA_REGISTER, pc);
+            isa.maskedStore(pcVector<LANES>(), T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+            isa.broadcast(T::TMP_DATA_REGISTER, static_cast<MachineWord>(ExecutionError::ILLEGAL_INSTRUCTION));
+            isa.maskedStore(laneErrors<LANES>(), T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+            isa.maskAndNot(T::LIVE_LANES_REGISTER, T::EXECUTION_CONTROL_REGISTER, T::LIVE_LANES_REGISTER);
+            assembler.jmp(scheduler);
+            leftBlock = true;
+            break;
+        }
+    }
+
+    // Running into the next block. Lanes waiting there have to be picked up, so that's a stop at the scheduler if
+    // there are any.
+    uniform = uniformAfter(op, uniform);
+
+    if (isLeader[index + 1] && !leftBlock) {
+        endBlock();
+        continueAt(index + 1);
+    }
+}
+
+// Guest registers the block at leader reads before writing them and that findVaryingRegisters() thinks every lane
+// agrees on, as long as knowing that saves the block some work: a branch that doesn't diverge or an address that
+// doesn't need checking lane by lane, or arithmetic leading up to one. Vector arithmetic is as cheap as the scalar kind,
+// so that alone isn't worth checking for.
+template <std::size_t LANES>
+GuestRegisterSet VectorJITBackend<LANES>::uniformInputs(const std::size_t leader) const {
+    const auto bit = [](const std::uint8_t guest) { return static_cast<GuestRegisterSet>(1) << guest; };
+
+    auto end = leader + 1;
+    while (!isLeader[end]) {
+        end++;
+    }
+
+    GuestRegisterSet inputs{};
+    GuestRegisterSet written{};
+    for (auto i = leader; i < end; i++) {
+        inputs |= registersRead(microOps[i]) & ~written;
+        written |= registersWritten(microOps[i]);
+    }
+    inputs &= ~varying[leader];
+
+    // Dropping an input can make other ones pointless, so go until nothing changes
+    std::vector<GuestRegisterSet> agreed(end - leader);
+    for (;;) {
+        auto current = inputs;
+        for (auto i = leader; i < end; i++) {
+            agreed[i - leader] = current;
+            current            = uniformAfter(microOps[i], current);
+        }
+
+        // Backwards from the branches and addresses to what they were computed from
+        GuestRegisterSet useful{};
+        for (auto i = end; i-- > leader;) {
+            const auto& op = microOps[i];
+            const auto in  = agreed[i - leader];
+            const auto feedsUseful = (useful & registersWritten(op)) != 0;
+            useful &= ~registersWritten(op);
+            if (op.handler >= MicroOpHandler::BEQ && op.handler <= MicroOpHandler::BGEU) {
+                useful |= agrees(op, in) ? registersRead(op) : 0;
+            } else if (op.handler >= MicroOpHandler::JALR && op.handler <= MicroOpHandler::SW) {
+                // Everything else in there only has its base address
+                useful |= op.rs1 != 0 && (in & bit(op.rs1)) ? bit(op.rs1) : 0;
+            } else if (feedsUseful && hasScalarForm(op.handler) && agrees(op, in)) {
+                useful |= registersRead(op);
+            }
+        }
+
+        if ((inputs & useful) == inputs) {
+            return inputs;
+        }
+        inputs &= useful;
+    }
+}
+
+// Checks that every running lane really has the same value in the registers uniformInputs() picked, by comparing them
+// with the first one's. The ones that don't go back to the scheduler and run the block later, with lanes they do agree
+// with, so the first lane always gets to go on. They haven't paid for the block yet.
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::emitGuard(const std::size_t leader) {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    uniform = uniformInputs(leader);
+    if (uniform == 0) {
+        return;
+    }
+
+    auto first = true;
+    for (auto guest = 1; guest < 32; guest++) {
+        if (!(uniform >> guest & 1)) {
+            continue;
+        }
+        // A fresh instruction every time, so a block with more inputs than registers only spills
+        scalars.beginInstruction(leader);
+        isa.broadcastRegister(T::TMP_DATA_REGISTER, x86::gpd(scalars.use(guest)));
+        isa.load(T::TMP_ADDRESS_REGISTER, homeSlot<LANES>(guest));
+        if (first) {
+            isa.compare(T::DIVERGENCE_MASK_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER, Condition::NE,
+                        T::EXECUTION_CONTROL_REGISTER);
+        } else {
+            isa.compare(T::TMP_MASK_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER, Condition::NE,
+                        T::EXECUTION_CONTROL_REGISTER);
+            isa.maskOr(T::DIVERGENCE_MASK_REGISTER, T::DIVERGENCE_MASK_REGISTER, T::TMP_MASK_REGISTER);
+        }
+        first = false;
+    }
+
+    const auto resume = assembler.newLabel();
+    isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+    assembler.jnz(stopStub(resume, leader * 4, ExecutionError::NONE));
+    assembler.bind(resume);
+}
+
+// Arithmetic on values every running lane agrees on, done once on general purpose registers. Returns false if op
+// has to be done on vectors after all.
+template <std::size_t LANES>
+bool VectorJITBackend<LANES>::emitScalar(const MicroOp& op) {
+    if (!hasScalarForm(op.handler) || !agrees(op, uniform)) {
+        return false;
+    }
+
+    // Sources first, loading them may need EAX
+    const auto readsRs2 = op.handler >= MicroOpHandler::ADD;
+    const auto a        = op.handler <= MicroOpHandler::AUIPC ? 0 : scalars.use(op.rs1);
+    const auto b        = readsRs2 ? scalars.use(op.rs2) : 0;
+    allocator.discard(op.rd);
+    const auto d = scalars.define(op.rd);
+
+    const auto dst = x86::gpd(d);
+    const auto src = x86::gpd(a);
+    const auto imm = imm32(op.imm);
+    switch (op.handler) {
+        case MicroOpHandler::LUI:
+        case MicroOpHandler::AUIPC: {
+            assembler.mov(dst, imm);
+            break;
+        }
+        case MicroOpHandler::SLTI:
+        case MicroOpHandler::SLTIU: {
+            assembler.cmp(src, imm);
+            if (op.handler == MicroOpHandler::SLTI) {
+                assembler.setl(x86::al);
+            } else {
+                assembler.setb(x86::al);
+            }
+            assembler.movzx(dst, x86::al);
+            break;
+        }
+        case MicroOpHandler::SLT:
+        case MicroOpHandler::SLTU: {
+            assembler.cmp(src, x86::gpd(b));
+            if (op.handler == MicroOpHandler::SLT) {
+                assembler.setl(x86::al);
+            } else {
+                assembler.setb(x86::al);
+            }
+            assembler.movzx(dst, x86::al);
+            break;
+        }
+        case MicroOpHandler::SLL:
+        case MicroOpHandler::SRL:
+        case MicroOpHandler::SRA: {
+            // x86 masks the count to 5 bits too
+            assembler.mov(ECX, x86::gpd(b));
+            if (d != a) {
+                assembler.mov(dst, src);
+            }
+            if (op.handler == MicroOpHandler::SLL) {
+                assembler.shl(dst, x86::cl);
+            } else if (op.handler == MicroOpHandler::SRL) {
+                assembler.shr(dst, x86::cl);
+            } else {
+                assembler.sar(dst, x86::cl);
+            }
+            break;
+        }
+        default: {
+            if (d != a && !(readsRs2 && d == b)) {
+                assembler.mov(dst, src);
+            }
+            // Two-operand x86, rd == rs2 != rs1 has the operands the other way around
+            const auto swapped = readsRs2 && d == b && d != a;
+            const auto other   = swapped ? src : x86::gpd(b);
+            switch (op.handler) {
+                case MicroOpHandler::ADDI: {
+                    assembler.add(dst, imm);
+                    break;
+                }
+                case MicroOpHandler::XORI: {
+                    assembler.xor_(dst, imm);
+                    break;
+                }
+                case MicroOpHandler::ORI: {
+                    assembler.or_(dst, imm);
+                    break;
+                }
+                case MicroOpHandler::ANDI: {
+                    assembler.and_(dst, imm);
+                    break;
+                }
+                case MicroOpHandler::SLLI: {
+                    assembler.shl(dst, imm);
+                    break;
+                }
+                case MicroOpHandler::SRLI: {
+                    assembler.shr(dst, imm);
+                    break;
+                }
+                case MicroOpHandler::SRAI: {
+                    assembler.sar(dst, imm);
+                    break;
+                }
+                case MicroOpHandler::ADD: {
+                    assembler.add(dst, other);
+                    break;
+                }
+                case MicroOpHandler::SUB: {
+                    if (swapped) {
+                        assembler.neg(dst);
+                        assembler.add(dst, other);
+                    } else {
+                        assembler.sub(dst, other);
+                    }
+                    break;
+                }
+                case MicroOpHandler::XOR: {
+                    assembler.xor_(dst, other);
+                    break;
+                }
+                case MicroOpHandler::OR: {
+                    assembler.or_(dst, other);
+                    break;
+                }
+                default: {
+                    assembler.and_(dst, other);
+                    break;
+                }
+            }
+            break;
+        }
+    }
+    scalarInstructions++;
+    return true;
+}
+
+// Both allocators write back what they have before the block is left
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::endBlock() {
+    allocator.endBlock();
+    scalars.endBlock();
+}
+
+// TMP_ADDRESS_REGISTER = rs1 + offset, the guest address of a load or store. Lanes whose access doesn't fit in guest
+// memory stop before anything is read or written, the rest go on with the access.
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::emitAddress(const std::uint8_t base, const MachineWord offset, const MachineWord width,
+                                          const MachineWord pc) {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    const auto resume = assembler.newLabel();
+    if (isUniform(base)) {
+        // One address for everybody, which also goes in ECX for emitUniformAddress()
+        assembler.lea(ECX, x86::ptr(x86::gpq(scalars.use(base)), imm32(offset)));
+        isa.maskCopy(T::DIVERGENCE_MASK_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+        assembler.cmp(ECX, imm32(memoryEnd - width));
+        assembler.ja(stopStub(resume, pc, ExecutionError::OUT_OF_BOUNDS));
+        assembler.bind(resume);
+        isa.broadcastRegister(T::TMP_ADDRESS_REGISTER, ECX);
+        return;
+    }
+
+    isa.broadcast(T::TMP_DATA_REGISTER, offset);
+    assembler.vpaddd(T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER, T::vector(allocator.use(base)));
+    isa.broadcast(T::TMP_DATA_REGISTER, memoryEnd - width);
+    isa.compare(T::DIVERGENCE_MASK_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER, Condition::GTU,
+                T::EXECUTION_CONTROL_REGISTER);
+    isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+    assembler.jnz(stopStub(resume, pc, ExecutionError::OUT_OF_BOUNDS));
+    assembler.bind(resume);
+}
+
+// With the interleaved layout, an access is uniform when every running lane has the same guest address (in
+// TMP_ADDRESS_REGISTER) and it doesn't run over into the next word, which is a row further on. Then RCX ends up with
+// the offset of the word's row in laneLocalMemory and EDX with the access' bit offset in the word. Anything else goes
+// to divergent. uniformAddress skips the check for addresses emitAddress() already knows are the same everywhere (and
+// left in ECX).
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::emitUniformAddress(const MachineWord width, const asmjit::Label divergent,
+                                                 const bool uniformAddress) {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    // Compare everyone against the first running lane
+    if (!uniformAddress) {
+        isa.firstLane(T::EXECUTION_CONTROL_REGISTER);
+        isa.broadcastRegister(T::TMP_DATA_REGISTER, EAX);
+        assembler.vpermd(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER);
+        isa.compare(T::DIVERGENCE_MASK_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER, Condition::NE,
+                    T::EXECUTION_CONTROL_REGISTER);
+        isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+        assembler.jnz(divergent);
+        assembler.vmovd(ECX, T::TMP_DATA_REGISTER.xmm());
+    }
+
+    assembler.mov(EDX, ECX);
+    assembler.and_(EDX, 3);
+    if (width > 1) {
+        assembler.cmp(EDX, static_cast<std::int32_t>(4 - width));
+        assembler.ja(divergent);
+    }
+    assembler.shl(EDX, 3);
+    assembler.and_(ECX, -4);
+    assembler.shl(ECX, std::countr_zero(LANES));
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::emitLoad(const MicroOp& op, const MachineWord pc) {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    const auto width          = accessWidth(op.handler);
+    const auto uniformAddress = isUniform(op.rs1);
+    emitAddress(op.rs1, op.imm, width, pc);
+    scalars.discard(op.rd);
+    const auto dst = T::vector(allocator.define(op.rd));
+
+    if (layout == LaneMemoryLayout::CONTIGUOUS) {
+        // Always gathers a whole dword, the narrow loads then shift their part down (and extend it on the way). The
+        // bytes past the end of guest memory are padding, see the constructor.
+        assembler.vpaddd(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::LANE_OFFSET_REGISTER);
+        isa.gather(dst, T::EXECUTION_CONTROL_REGISTER);
+    } else {
+        // Reads the whole word the access starts in and shifts it down, so narrow loads are left with their part in
+        // the low bits like above
+        const auto divergent = assembler.newLabel();
+        const auto done      = assembler.newLabel();
+        emitUniformAddress(width, divergent, uniformAddress);
+        isa.loadUnaligned(dst, x86::ptr(MEMORY_REGISTER, RCX));
+        if (width < 4) {
+            assembler.vmovd(T::TMP_DATA_REGISTER.xmm(), EDX);
+            assembler.vpsrld(dst, dst, T::TMP_DATA_REGISTER.xmm());
+        }
+        assembler.jmp(done);
+
+        // Gather from the word's slot in its row: row offset | lane offset
+        assembler.bind(divergent);
+        isa.broadcast(T::TMP_SHIFT_REGISTER, 3);
+        isa.bitwiseAnd(T::TMP_SHIFT_REGISTER, T::TMP_SHIFT_REGISTER, T::TMP_ADDRESS_REGISTER);
+        assembler.vpslld(T::TMP_SHIFT_REGISTER, T::TMP_SHIFT_REGISTER, 3);
+        assembler.vpsrld(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, 2);
+        assembler.vpslld(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, 2 + std::countr_zero(LANES));
+        isa.bitwiseOr(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::LANE_OFFSET_REGISTER);
+        isa.gather(dst, T::EXECUTION_CONTROL_REGISTER);
+        assembler.vpsrlvd(dst, dst, T::TMP_SHIFT_REGISTER);
+
+        // Misaligned lanes get the rest from the next word
+        if (width > 1) {
+            isa.broadcast(T::TMP_DATA_REGISTER, 32 - width * 8);
+            isa.compare(T::DIVERGENCE_MASK_REGISTER, T::TMP_SHIFT_REGISTER, T::TMP_DATA_REGISTER, Condition::GTU,
+                        T::EXECUTION_CONTROL_REGISTER);
+            isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+            assembler.jz(done);
+            isa.broadcast(T::TMP_DATA_REGISTER, LANES * 4);
+            assembler.vpaddd(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER);
+            isa.bitwiseXor(T::TMP_WORD_REGISTER, T::TMP_WORD_REGISTER, T::TMP_WORD_REGISTER);
+            isa.gather(T::TMP_WORD_REGISTER, T::DIVERGENCE_MASK_REGISTER);
+            isa.broadcast(T::TMP_DATA_REGISTER, 32);
+            assembler.vpsubd(T::TMP_SHIFT_REGISTER, T::TMP_DATA_REGISTER, T::TMP_SHIFT_REGISTER);
+            assembler.vpsllvd(T::TMP_WORD_REGISTER, T::TMP_WORD_REGISTER, T::TMP_SHIFT_REGISTER);
+            isa.bitwiseOr(dst, dst, T::TMP_WORD_REGISTER);
+        }
+        assembler.bind(done);
+    }
+
+    switch (op.handler) {
+        case MicroOpHandler::LB: {
+            assembler.vpslld(dst, dst, 24);
+            assembler.vpsrad(dst, dst, 24);
+            break;
+        }
+        case MicroOpHandler::LH: {
+            assembler.vpslld(dst, dst, 16);
+            assembler.vpsrad(dst, dst, 16);
+            break;
+        }
+        case MicroOpHandler::LBU: {
+            assembler.vpslld(dst, dst, 24);
+            assembler.vpsrld(dst, dst, 24);
+            break;
+        }
+        case MicroOpHandler::LHU: {
+            assembler.vpslld(dst, dst, 16);
+            assembler.vpsrld(dst, dst, 16);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::emitStore(const MicroOp& op, const MachineWord pc) {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    const auto width          = accessWidth(op.handler);
+    const auto uniformAddress = isUniform(op.rs1);
+    const auto src            = T::vector(allocator.use(op.rs2));
+    emitAddress(op.rs1, op.imm, width, pc);
+
+    if (layout == LaneMemoryLayout::CONTIGUOUS) {
+        assembler.vpaddd(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::LANE_OFFSET_REGISTER);
+        if constexpr (LANES == 16) {
+            if (width < 4) {
+                // No byte scatter, so read-modify-write the dword around it. Every lane has its own memory, two lanes
+                // can't step on each other's bytes.
+                isa.gather(T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+
+                // Low byte (or word) of every dword
+                assembler.mov(RAX, width == 1 ? 0x1111111111111111 : 0x3333333333333333);
+                assembler.kmovq(T::TMP_MASK_REGISTER, RAX);
+                assembler.k(T::TMP_MASK_REGISTER).vmovdqu8(T::TMP_DATA_REGISTER, src);
+                isa.scatter(T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER, 4);
+                emitMarkDirty();
+                return;
+            }
+        }
+        isa.scatter(src, T::EXECUTION_CONTROL_REGISTER, width);
+        emitMarkDirty();
+        return;
+    }
+
+    // Narrow stores read-modify-write the word they're in: word & ~(mask << shift) | (src & mask) << shift
+    const auto divergent = assembler.newLabel();
+    const auto done      = assembler.newLabel();
+    emitUniformAddress(width, divergent, uniformAddress);
+
+    // The word is in the same chunk of every lane, and their words of the dirty map are next to each other. Marking the
+    // lanes that aren't running too only means they copy back a chunk more than they have to.
+    assembler.mov(EAX, ECX);
+    assembler.shr(EAX, DIRTY_CHUNK_SHIFT + std::countr_zero(LANES));
+    assembler.shl(EAX, std::countr_zero(LANES));
+    isa.allOnes(T::TMP_DATA_REGISTER);
+    isa.storeUnaligned(x86::ptr(MEMORY_REGISTER, RAX, 2, dirtyMap()), T::TMP_DATA_REGISTER);
+
+    if (width == 4) {
+        isa.maskedStore(x86::ptr(MEMORY_REGISTER, RCX), src, T::EXECUTION_CONTROL_REGISTER);
+    } else {
+        assembler.vmovd(T::TMP_DATA_REGISTER.xmm(), EDX);
+        isa.broadcast(T::TMP_WORD_REGISTER, widthMask(width));
+        assembler.vpslld(T::TMP_WORD_REGISTER, T::TMP_WORD_REGISTER, T::TMP_DATA_REGISTER.xmm());
+        assembler.vpslld(T::TMP_SHIFT_REGISTER, src, T::TMP_DATA_REGISTER.xmm());
+        isa.bitwiseAnd(T::TMP_SHIFT_REGISTER, T::TMP_SHIFT_REGISTER, T::TMP_WORD_REGISTER);
+        isa.loadUnaligned(T::TMP_DATA_REGISTER, x86::ptr(MEMORY_REGISTER, RCX));
+        isa.bitwiseAndNot(T::TMP_DATA_REGISTER, T::TMP_WORD_REGISTER, T::TMP_DATA_REGISTER);
+        isa.bitwiseOr(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, T::TMP_SHIFT_REGISTER);
+        isa.maskedStore(x86::ptr(MEMORY_REGISTER, RCX), T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+    }
+    assembler.jmp(done);
+
+    // Same thing a lane at a time, through the word's slot in its row. Misaligned lanes go on to do the rest of it in
+    // the next word, with the mask and value shifted the other way.
+    assembler.bind(divergent);
+    isa.broadcast(T::TMP_SHIFT_REGISTER, 3);
+    isa.bitwiseAnd(T::TMP_SHIFT_REGISTER, T::TMP_SHIFT_REGISTER, T::TMP_ADDRESS_REGISTER);
+    assembler.vpslld(T::TMP_SHIFT_REGISTER, T::TMP_SHIFT_REGISTER, 3);
+    assembler.vpsrld(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, 2);
+    assembler.vpslld(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, 2 + std::countr_zero(LANES));
+    isa.bitwiseOr(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::LANE_OFFSET_REGISTER);
+    emitMarkDirty();
+
+    const auto readModifyWrite = [&](const typename T::Mask& lanes, const bool high) {
+        const auto shift = [&](const typename T::Vector& value) {
+            if (high) {
+                assembler.vpsrlvd(value, value, T::TMP_SHIFT_REGISTER);
+            } else {
+                assembler.vpsllvd(value, value, T::TMP_SHIFT_REGISTER);
+            }
+        };
+        isa.gather(T::TMP_DATA_REGISTER, lanes);
+        isa.broadcast(T::TMP_WORD_REGISTER, widthMask(width));
+        shift(T::TMP_WORD_REGISTER);
+        isa.bitwiseAndNot(T::TMP_DATA_REGISTER, T::TMP_WORD_REGISTER, T::TMP_DATA_REGISTER);
+        isa.broadcast(T::TMP_WORD_REGISTER, widthMask(width));
+        isa.bitwiseAnd(T::TMP_WORD_REGISTER, T::TMP_WORD_REGISTER, src);
+        shift(T::TMP_WORD_REGISTER);
+        isa.bitwiseOr(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, T::TMP_WORD_REGISTER);
+        isa.scatter(T::TMP_DATA_REGISTER, lanes, 4);
+    };
+    readModifyWrite(T::EXECUTION_CONTROL_REGISTER, false);
+    if (width > 1) {
+        isa.broadcast(T::TMP_DATA_REGISTER, 32 - width * 8);
+        isa.compare(T::DIVERGENCE_MASK_REGISTER, T::TMP_SHIFT_REGISTER, T::TMP_DATA_REGISTER, Condition::GTU,
+                    T::EXECUTION_CONTROL_REGISTER);
+        isa.testMask(T::DIVERGENCE_MASK_REGISTER);
+        assembler.jz(done);
+        isa.broadcast(T::TMP_DATA_REGISTER, LANES * 4);
+        assembler.vpaddd(T::TMP_ADDRESS_REGISTER, T::TMP_ADDRESS_REGISTER, T::TMP_DATA_REGISTER);
+        isa.broadcast(T::TMP_DATA_REGISTER, 32);
+        assembler.vpsubd(T::TMP_SHIFT_REGISTER, T::TMP_DATA_REGISTER, T::TMP_SHIFT_REGISTER);
+        readModifyWrite(T::DIVERGENCE_MASK_REGISTER, true);
+    }
+    assembler.bind(done);
+}
+
+// Marks the chunks the lanes in EXECUTION_CONTROL_REGISTER store to as dirty, from where their words are in
+// laneLocalMemory (TMP_ADDRESS_REGISTER, after the lane offsets went in). Only the chunk an access starts in,
+// restoreChunk() copies the few bytes after it too. Contiguous, a chunk never straddles two lanes and its index is the
+// offset's. Interleaved, it's the chunk's row of lanes and the lane's slot in it, like dirtyIndex(). Clobbers
+// TMP_DATA_REGISTER and, contiguous, TMP_ADDRESS_REGISTER, interleaved, TMP_WORD_REGISTER.
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::emitMarkDirty() {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    if (layout == LaneMemoryLayout::CONTIGUOUS) {
+        assembler.vpsrld(T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, DIRTY_CHUNK_SHIFT);
+        isa.markDirty(T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, T::EXECUTION_CONTROL_REGISTER, dirtyMap());
+        return;
+    }
+    assembler.vpsrld(T::TMP_DATA_REGISTER, T::TMP_ADDRESS_REGISTER, DIRTY_CHUNK_SHIFT + std::countr_zero(LANES));
+    assembler.vpslld(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, std::countr_zero(LANES));
+    assembler.vpsrld(T::TMP_WORD_REGISTER, T::LANE_OFFSET_REGISTER, 2);
+    isa.bitwiseOr(T::TMP_DATA_REGISTER, T::TMP_DATA_REGISTER, T::TMP_WORD_REGISTER);
+    isa.markDirty(T::TMP_DATA_REGISTER, T::TMP_WORD_REGISTER, T::EXECUTION_CONTROL_REGISTER, dirtyMap());
+}
+
+template <std::size_t LANES>
+asmjit::Label VectorJITBackend<LANES>::divergenceStub(const MachineWord target, const MachineWord fallthrough,
+                                                      const bool split) {
+    const auto label = assembler.newLabel();
+    divergenceStubs.push_back(DivergenceStub{label, target, fallthrough, split});
+    return label;
+}
+
+template <std::size_t LANES>
+asmjit::Label VectorJITBackend<LANES>::stopStub(const asmjit::Label resume, const MachineWord pc,
+                                                const ExecutionError error) {
+    const auto label = assembler.newLabel();
+    stopStubs.push_back(StopStub{label, resume, pc, error});
+    return label;
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::emitSystemCall(const MachineWord pc) {
+    using T        = Target<LANES>;
+    const auto isa = Isa<LANES>(assembler);
+
+    // The block is only the ecall, so every guest register is in its home slot once endBlock() is done. Six pushes in
+    // the prologue leave the stack 8 bytes off the alignment the call needs.
+    endBlock();
+    isa.store(budgetVector<LANES>(), T::BUDGET_REGISTER);
+    const auto backendOffset = static_cast<std::int32_t>(offsetof(VectorState<LANES>, backend));
+    assembler.mov(x86::rdi, x86::qword_ptr(STATE_REGISTER, backendOffset));
+    if constexpr (LANES == 16) {
+        assembler.kmovw(x86::esi, T::EXECUTION_CONTROL_REGISTER);
+    } else {
+        assembler.vmovmskps(x86::esi, T::EXECUTION_CONTROL_REGISTER);
+    }
+    assembler.mov(EDX, imm32(pc));
+    assembler.mov(RAX, reinterpret_cast<const void*>(&VectorJITBackend::systemCall));
+    assembler.sub(x86::rsp, 8);
+    assembler.vzeroupper();
+    assembler.call(RAX);
+    assembler.add(x86::rsp, 8);
+
+    // Back to how the prologue left things. The live lanes are the ones without an error, the scheduler retires the
+    // ones that exited.
+    isa.bitwiseXor(T::ZERO_REGISTER, T::ZERO_REGISTER, T::ZERO_REGISTER);
+    assembler.mov(RAX, translation->laneBaseAddressOffsets.data());
+    isa.load(T::LANE_OFFSET_REGISTER, x86::ptr(RAX));
+    isa.load(T::BUDGET_REGISTER, budgetVector<LANES>());
+    isa.load(T::TMP_DATA_REGISTER, laneErrors<LANES>());
+    isa.maskAll(T::LIVE_LANES_REGISTER);
+    isa.compare(T::LIVE_LANES_REGISTER, T::TMP_DATA_REGISTER, T::ZERO_REGISTER, Condition::EQ,
+                T::LIVE_LANES_REGISTER);
+    assembler.jmp(scheduler);
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::systemCall(VectorJITBackend* backend, std::uint32_t mask, const MachineWord pc) {
+    // A lane's memory as the GuestSystem sees it, whatever the layout
+    struct LaneGuestMemory {
+        VectorJITBackend* backend;
+        std::size_t lane;
+
+        bool read(const MachineWord address, void* out, const std::size_t bytes) const {
+            return backend->readMemory(lane, address, static_cast<std::uint8_t*>(out), bytes);
+        }
+        bool write(const MachineWord address, const void* in, const std::size_t bytes) const {
+            return backend->writeInput(lane, address, static_cast<const std::uint8_t*>(in), bytes);
+        }
+    };
+
+    auto& lanes = backend->lanes;
+    auto& x     = lanes.x;
+    for (; mask != 0; mask &= mask - 1) {
+        const auto lane = static_cast<std::size_t>(std::countr_zero(mask));
+        const auto [value, exit] =
+                backend->guestSystem.call(lane, x[SYSCALL_NUMBER_REGISTER][lane], x[10][lane], x[11][lane],
+                                          x[12][lane], LaneGuestMemory{backend, lane},
+                                          backend->instructionLimit - static_cast<std::uint64_t>(lanes.budget[lane]));
+        x[SYSCALL_RESULT_REGISTER][lane] = value;
+        lanes.pc[lane]                   = exit ? DONE_ADDRESS : pc + 4;
+    }
+}
+
+template <std::size_t LANES>
+VectorJITBackend<LANES>::VectorJITBackend(std::shared_ptr<const PageImage> image, State state,
+                                          std::size_t programSize, std::uint64_t instructionLimit,
+                                          LaneMemoryLayout layout)
+    : AbstractMachineBackend(image->data(), state, programSize), layout(layout), allocator(registerAllocator()),
+      scalars(scalarRegisterAllocator()), translation(std::make_shared<Translation>()),
+      memoryEnd(MEMORY_SIZE + programSize), guestSystem(LANES, memoryEnd, memoryEnd),
+      instructionLimit(instructionLimit) {
+    code.init(translation->runtime.environment(), translation->runtime.cpuFeatures());
+    code.attach(&assembler);
+    assembler.addDiagnosticOptions(asmjit::DiagnosticOptions::kValidateAssembler);
+
+    // Each lane gets its own copy of guest memory. Contiguous, narrow loads and stores still gather a whole dword, so
+    // there are a few bytes of padding after each copy, and rounding up to a cache line keeps lanes from sharing one
+    // (or a dirty chunk).
+    // Interleaved, a lane's memory is a column of rows of LANES words (rounded up to a whole row), and its offset is
+    // where its word is in a row. Gathers and scatters take signed 32-bit indices, which is as far as it can all go.
+    std::size_t laneSize;
+    if (layout == LaneMemoryLayout::CONTIGUOUS) {
+        laneSize            = (static_cast<std::size_t>(memoryEnd) + XLEN - 1 + 63) & ~std::size_t{63};
+        laneLocalMemorySize = laneSize * LANES;
+    } else {
+        laneSize            = XLEN;
+        laneLocalMemorySize = (static_cast<std::size_t>(memoryEnd) + XLEN - 1) / XLEN * XLEN * LANES;
+    }
+    // The dirty map goes after all that, a word per chunk of every lane's memory, see dirtyIndex()
+    dirtyChunkCount = layout == LaneMemoryLayout::CONTIGUOUS ? laneLocalMemorySize >> DIRTY_CHUNK_SHIFT
+                                                             : chunksPerLane() * LANES;
+    if (laneLocalMemorySize > static_cast<std::size_t>(INT32_MAX)) {
+        spdlog::error("Can't run a program of {} bytes, {} lanes of it don't fit in 2 GB.", programSize, LANES);
+        exit(EXIT_FAILURE);
+    }
+    for (auto lane = 0ull; lane < LANES; lane++) {
+        translation->laneBaseAddressOffsets[lane] = lane * laneSize;
+    }
+    translation->image = std::move(image);
+    ownedLaneMemory = std::make_unique<std::uint8_t[]>(laneMemoryAllocationSize());
+    laneLocalMemory = ownedLaneMemory.get();
+    dirtyChunks     = reinterpret_cast<std::uint32_t*>(laneLocalMemory + laneLocalMemorySize);
+
+    microOps = decodeProgram(program, programSize, false);
+    isLeader = findBlockLeaders(microOps);
+    createBlockLabels();
+    allocator.analyze(microOps, isLeader);
+    scalars.analyze(microOps, isLeader);
+    varying = findVaryingRegisters(microOps);
+    translate();
+    copyInitialMemory();
+    reset();
+}
+
+template <std::size_t LANES>
+VectorJITBackend<LANES>::VectorJITBackend(const VectorJITBackend& other) : VectorJITBackend(other, nullptr) {}
+
+template <std::size_t LANES>
+VectorJITBackend<LANES>::VectorJITBackend(const VectorJITBackend& other, Arena& arena)
+    : VectorJITBackend(other, &arena) {}
+
+template <std::size_t LANES>
+VectorJITBackend<LANES>::VectorJITBackend(const VectorJITBackend& other, Arena* arena)
+    : AbstractMachineBackend(other), layout(other.layout), allocator(registerAllocator()),
+      scalars(scalarRegisterAllocator()), translation(other.translation), memoryEnd(other.memoryEnd),
+      laneLocalMemorySize(other.laneLocalMemorySize), dirtyChunkCount(other.dirtyChunkCount),
+      ownedLaneMemory(arena ? nullptr : std::make_unique<std::uint8_t[]>(laneMemoryAllocationSize())),
+      laneLocalMemory(arena ? static_cast<std::uint8_t*>(arena->allocate(laneMemoryAllocationSize()))
+                            : ownedLaneMemory.get()),
+      dirtyChunks(reinterpret_cast<std::uint32_t*>(laneLocalMemory + laneLocalMemorySize)),
+      guestSystem(other.guestSystem), instructionLimit(other.instructionLimit) {
+    copyInitialMemory();
+    reset();
+}
+
+template <std::size_t LANES>
+VectorRegisterAllocator VectorJITBackend<LANES>::registerAllocator() {
+    using T = Target<LANES>;
+    return VectorRegisterAllocator(
+            allocatableRegisters<LANES>(layout), T::ZERO_REGISTER.id(),
+            [this](const std::uint8_t physical, const std::uint8_t guest) {
+                // The home slot is out of date while the scalar allocator has a newer value
+                if (scalars.holds(guest)) {
+                    Isa<LANES>(assembler).broadcastRegister(T::vector(physical), x86::gpd(scalars.use(guest)));
+                } else {
+                    Isa<LANES>(assembler).load(T::vector(physical), homeSlot<LANES>(guest));
+                }
+            },
+            [this](const std::uint8_t physical, const std::uint8_t guest) {
+                // Lanes that aren't running this block keep what they had
+                Isa<LANES>(assembler).maskedStore(homeSlot<LANES>(guest), T::vector(physical),
+                                                  T::EXECUTION_CONTROL_REGISTER);
+            });
+}
+
+// Same, but for the guest registers every running lane agrees on. Any lane's element of the home slot will do, and
+// going back it gets broadcast, which goes through TMP_DATA_REGISTER. Loads clobber EAX.
+template <std::size_t LANES>
+VectorRegisterAllocator VectorJITBackend<LANES>::scalarRegisterAllocator() {
+    using T = Target<LANES>;
+    return VectorRegisterAllocator(
+            std::vector<std::uint8_t>(SCALAR_REGISTERS.begin(), SCALAR_REGISTERS.end()), SCALAR_ZERO_REGISTER,
+            [this](const std::uint8_t physical, const std::uint8_t guest) {
+                Isa<LANES>(assembler).firstLane(T::EXECUTION_CONTROL_REGISTER);
+                assembler.mov(x86::gpd(physical), homeSlotElement<LANES>(guest));
+            },
+            [this](const std::uint8_t physical, const std::uint8_t guest) {
+                const auto isa = Isa<LANES>(assembler);
+                isa.broadcastRegister(T::TMP_DATA_REGISTER, x86::gpd(physical));
+                isa.maskedStore(homeSlot<LANES>(guest), T::TMP_DATA_REGISTER, T::EXECUTION_CONTROL_REGISTER);
+            });
+}
+
+template <std::size_t LANES>
+void VectorJITBackend<LANES>::createBlockLabels() {
+    // Blocks can only be entered at the top, the registers in the middle of one live in vector registers. jalr can go
+    // anywhere though, so anything that looks like a code address (function pointers, mostly) starts a block too.
+    auto fused = microOps;
+    fuseSuperinstructions(fused);
+    for (const auto& op : fused) {
+        if (op.handler == MicroOpHandler::LI && op.imm % 4 == 0 && op.imm / 4 < numberOfInstructions) {
+            isLeader[op.imm / 4] = true;
+        } else if (op.handler == MicroOpHandler::CALL) {
+            isLeader[op.target] = true;
+        }
+    }
+
+    for (auto i = 0ull; i <= numberOfInstructions; i++) {
+        labels.push_back(isLeader[i] ? assembler.newLabel() : asmjit::Label{});
+    }
+}
+
+template class VectorJITBackend<8>;
+template class VectorJITBackend<16>;
@@ -0,0 +1,197 @@
+#include <limits>
+#include <utility>
+
+#include "backends/VectorRegisterAllocator.hpp"
+
+namespace {
+    constexpr GuestRegisterSet EVERYTHING = ~static_cast<GuestRegisterSet>(1);
+
+    GuestRegisterSet bit(const std::uint8_t guest) { return static_cast<GuestRegisterSet>(1) << guest; }
+} // namespace
+
+VectorRegisterAllocator::VectorRegisterAllocator(std::vector<std::uint8_t> allocatable, const std::uint8_t zero,
+                                                 Emitter load, Emitter store)
+    : allocatable(std::move(allocatable)), zero(zero), load(std::move(load)), store(std::move(store)) {
+    guestToPhysical.fill(NONE);
+    physicalToGuest.fill(NONE);
+}
+
+void VectorRegisterAllocator::analyze(const std::vector<MicroOp>& microOps, const std::vector<bool>& isLeader) {
+    this->microOps = &microOps;
+    this->isLeader = isLeader;
+
+    // Backwards dataflow over single micro-ops, the programs are small enough that blocks aren't worth it. Anything
+    // that leaves for somewhere we can't see (jalr, errors) keeps everything alive, the next block or whoever looks
+    // at the final state might want it.
+    const auto instructionCount = microOps.size() - 1;
+    std::vector<GuestRegisterSet> liveBefore(microOps.size(), 0);
+    liveBefore[instructionCount] = EVERYTHING;
+    liveAfter.assign(microOps.size(), EVERYTHING);
+
+    for (auto changed = true; changed;) {
+        changed = false;
+        for (auto i = instructionCount; i-- > 0;) {
+            const auto& op = microOps[i];
+
+            GuestRegisterSet out{};
+            switch (op.handler) {
+                case MicroOpHandler::BEQ:
+                case MicroOpHandler::BNE:
+                case MicroOpHandler::BLT:
+                case MicroOpHandler::BGE:
+                case MicroOpHandler::BLTU:
+                case MicroOpHandler::BGEU: {
+                    out = liveBefore[i + 1] | liveBefore[op.target];
+                    break;
+                }
+                case MicroOpHandler::JAL:
+                case MicroOpHandler::J: {
+                    out = liveBefore[op.target];
+                    break;
+                }
+                case MicroOpHandler::JALR:
+                case MicroOpHandler::JR:
+                case MicroOpHandler::ILLEGAL: {
+                    out = EVERYTHING;
+                    break;
+                }
+                default: {
+                    out = liveBefore[i + 1];
+                    break;
+                }
+            }
+
+            const auto in = registersRead(op) | (out & ~registersWritten(op));
+            if (in != liveBefore[i] || out != liveAfter[i]) {
+                liveBefore[i] = in;
+                liveAfter[i]  = out;
+                changed       = true;
+            }
+        }
+    }
+}
+
+void VectorRegisterAllocator::beginBlock() {
+    guestToPhysical.fill(NONE);
+    physicalToGuest.fill(NONE);
+    dirty  = 0;
+    pinned = 0;
+}
+
+void VectorRegisterAllocator::beginInstruction(const std::size_t index) {
+    current = index;
+    pinned  = 0;
+}
+
+std::uint8_t VectorRegisterAllocator::use(const std::uint8_t guest) {
+    if (guest == 0) {
+        return zero;
+    }
+
+    if (guestToPhysical[guest] == NONE) {
+        const auto physical = allocate();
+        load(physical, guest);
+        guestToPhysical[guest]    = physical;
+        physicalToGuest[physical] = guest;
+    }
+
+    pinned |= bit(guest);
+    return guestToPhysical[guest];
+}
+
+std::uint8_t VectorRegisterAllocator::define(const std::uint8_t guest) {
+    if (guestToPhysical[guest] == NONE) {
+        const auto physical       = allocate();
+        guestToPhysical[guest]    = physical;
+        physicalToGuest[physical] = guest;
+    }
+
+    dirty |= bit(guest);
+    pinned |= bit(guest);
+    return guestToPhysical[guest];
+}
+
+bool VectorRegisterAllocator::holds(const std::uint8_t guest) const {
+    return guest != 0 && guestToPhysical[guest] != NONE;
+}
+
+void VectorRegisterAllocator::discard(const std::uint8_t guest) {
+    if (guest == 0 || guestToPhysical[guest] == NONE) {
+        return;
+    }
+    physicalToGuest[guestToPhysical[guest]] = NONE;
+    guestToPhysical[guest]                  = NONE;
+    dirty &= ~bit(guest);
+}
+
+void VectorRegisterAllocator::endBlock() {
+    for (auto guest = 1; guest < 32; guest++) {
+        if ((dirty & bit(guest)) && isLiveAfterCurrent(guest)) {
+            store(guestToPhysical[guest], guest);
+        }
+    }
+    dirty = 0;
+}
+
+bool VectorRegisterAllocator::isLiveAfterCurrent(const std::uint8_t guest) const {
+    return liveAfter[current] & bit(guest);
+}
+
+std::uint8_t VectorRegisterAllocator::allocate() {
+    for (const auto physical : allocatable) {
+        if (physicalToGuest[physical] == NONE) {
+            return physical;
+        }
+    }
+
+    // Nothing free, pick a victim. Best is a value nobody reads again, otherwise the one read furthest in the future
+    // (Belady), and between equally far ones a clean value, since dropping it doesn't need a store.
+    const auto& ops = *microOps;
+
+    auto victim       = NONE;
+    auto victimNeeded = true;
+    auto victimCost   = std::numeric_limits<std::size_t>::max();
+    for (const auto physical : allocatable) {
+        const auto guest = physicalToGuest[physical];
+        if (pinned & bit(guest)) {
+            continue;
+        }
+
+        // Look for the next time this block touches the value
+        auto needed   = false;
+        auto distance = std::numeric_limits<std::size_t>::max() / 2;
+        auto j        = current;
+        for (; j < ops.size() && (j == current || !isLeader[j]); j++) {
+            if (registersRead(ops[j]) & bit(guest)) {
+                needed   = true;
+                distance = j - current;
+                break;
+            }
+            if (registersWritten(ops[j]) & bit(guest)) {
+                break; // Overwritten before it's read, the value is dead
+            }
+        }
+        if (j == ops.size() || (j != current && isLeader[j])) {
+            needed = liveAfter[j - 1] & bit(guest);
+        }
+
+        // Lower is better: dead values first, then far away ones, clean before dirty
+        const auto isDirty = (dirty & bit(guest)) != 0;
+        const auto cost    = !needed ? 0 : (std::numeric_limits<std::size_t>::max() / 2 - distance) * 2 + isDirty;
+        if (victim == NONE || cost < victimCost) {
+            victim       = physical;
+            victimNeeded = needed;
+            victimCost   = cost;
+        }
+    }
+
+    const auto guest = physicalToGuest[victim];
+    if ((dirty & bit(guest)) && victimNeeded) {
+        store(victim, guest);
+        spills++;
+    }
+    dirty &= ~bit(guest);
+    guestToPhysical[guest]  = NONE;
+    physicalToGuest[victim] = NONE;
+    return victim;
+}
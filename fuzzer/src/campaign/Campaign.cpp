@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "campaign/Campaign.hpp"
+
+namespace {
+    // Keeps the calling thread on the index-th CPU the process may run on, wrapping around if there are more threads
+    // than that. Leaves it be if the kernel won't say which those are.
+    void pinToCpu(const std::size_t index) {
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+            return;
+        }
+        auto skip = index % CPU_COUNT(&allowed);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed) && skip-- == 0) {
+                cpu_set_t only;
+                CPU_ZERO(&only);
+                CPU_SET(cpu, &only);
+                pthread_setaffinity_np(pthread_self(), sizeof(only), &only);
+                return;
+            }
+        }
+    }
+} // namespace
+
+CampaignStatistics& CampaignStatistics::operator+=(const CampaignStatistics& other) {
+    batches += other.batches;
+    executions += other.executions;
+    instructions += other.instructions;
+    errors += other.errors;
+    steals += other.steals;
+    seeds += other.seeds;
+    return *this;
+}
+
+Campaign::Campaign(const std::size_t threads, WorkerFactory makeWorker)
+    : threads(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      makeWorker(std::move(makeWorker)) {
+    for (std::size_t thread = 0; thread < this->threads; thread++) {
+        deques.push_back(std::make_unique<WorkStealingDeque<std::uint64_t>>(CHUNK_SIZE));
+    }
+}
+
+std::vector<CampaignStatistics> Campaign::run(const std::uint64_t batchCount) {
+    this->batchCount = batchCount;
+    nextBatch.store(0, std::memory_order_relaxed);
+
+    std::vector<CampaignStatistics> statistics(threads);
+    {
+        std::vector<std::jthread> pool;
+        pool.reserve(threads);
+        for (std::size_t thread = 0; thread < threads; thread++) {
+            pool.emplace_back([this, thread, &statistics] { work(thread, statistics[thread]); });
+        }
+    }
+    return statistics;
+}
+
+void Campaign::work(const std::size_t thread, CampaignStatistics& statistics) {
+    // Pinned first, the arena goes on whichever node that is. The worker is gone before the arena is.
+    pinToCpu(thread);
+    Arena arena;
+    const auto worker = makeWorker(thread, arena);
+    auto& own         = *deques[thread];
+
+    while (true) {
+        if (const auto batch = own.pop()) {
+            worker->runBatch(*batch, statistics);
+            continue;
+        }
+
+        // Out of work, get some more. Everything but the batch run right away goes in the deque, up for stealing.
+        const auto first = nextBatch.fetch_add(CHUNK_SIZE, std::memory_order_relaxed);
+        if (first < batchCount) {
+            const auto last = std::min(first + CHUNK_SIZE, batchCount);
+            for (auto batch = last - 1; batch > first; batch--) {
+                own.push(batch);
+            }
+            worker->runBatch(first, statistics);
+            continue;
+        }
+
+        // Nothing left to hand out, help whoever is still busy. Once every deque comes up empty, whatever is left is
+        // being run already (or about to be, by its owner), so this thread is done.
+        auto stole = false;
+        for (std::size_t i = 1; i < threads && !stole; i++) {
+            if (const auto batch = deques[(thread + i) % threads]->steal()) {
+                statistics.steals++;
+                worker->runBatch(*batch, statistics);
+                stole = true;
+            }
+        }
+        if (!stole) {
+            break;
+        }
+    }
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iterator>
 
 // Some references and tools
 // https://riscv.org/wp-content/uploads/2017/05/riscv-spec-v2.2.pdf
@@ -14,6 +17,15 @@ constexpr auto MEMORY_SIZE  = 0xff;
 constexpr auto XLEN         = sizeof(std::uint32_t);
 constexpr auto DONE_ADDRESS = 0xfffffff0u;
 
+// The address space the interpreters and the scalar JIT give a guest (see PagedMemory and GuardedMemory). Memory nobody
+// touches costs nothing there, so there's room for a real stack (the top GUEST_STACK_SIZE bytes) and a heap (from the
+// end of the program image up to the stack) too.
+constexpr MachineWord GUEST_ADDRESS_SPACE = 16 * 1024 * 1024;
+constexpr MachineWord GUEST_STACK_SIZE    = 1024 * 1024;
+
+// How many instructions a backend that counts them lets a guest run, same as MAX_OPS in ajaxemu
+constexpr std::uint64_t DEFAULT_INSTRUCTION_LIMIT = 10000;
+
 enum class Opcode {
     ARITH   = 0x33,
     AUIPC   = 0x17,
@@ -42,12 +54,72 @@ struct Instruction {
     inline MachineWord funct3() const { return (raw >> 12) & 0x7; }
     inline MachineWord funct7() const { return raw >> 25; }
     inline MachineWord rs1() const { return (raw >> 15) & 0x1F; }
-    inline MachineWord rs2() const { return (raw >> 15) & 0x1F; }
+    inline MachineWord rs2() const { return (raw >> 20) & 0x1F; }
     inline MachineWord imm() const { return static_cast<std::int32_t>(raw) >> 20; } // TODO: int or uint...
+
+    // Sign-extended immediates for the formats that scatter their bits around the encoding
+    inline MachineWord immS() const { return (static_cast<std::int32_t>(raw & 0xfe000000) >> 20) | rd(); }
+    inline MachineWord immB() const {
+        return (static_cast<std::int32_t>(raw & (1u << 31)) >> 19) | ((raw & 0x7e000000) >> 20) | (rd() & 0x1e) |
+               ((rd() & 0x1) << 11);
+    }
+    inline MachineWord immU() const { return raw & 0xfffff000; }
+    inline MachineWord immJ() const {
+        return (static_cast<std::int32_t>(raw & (1u << 31)) >> 11) | ((raw & 0x7fe00000) >> 20) |
+               ((raw & 0x00100000) >> 9) | (raw & 0x000ff000);
+    }
     inline MachineWord isSecondHighestBitSet() const { return static_cast<std::uint32_t>(raw) & (1u << 30); }
     inline MachineWord isHighestBitSet() const { return static_cast<std::uint32_t>(raw) & (1u << 31); }
 };
 
+// Error codes, these line up with the ones ajaxemu writes into Result::errorCode
+enum class ExecutionError : std::int32_t {
+    NONE                = 0,
+    PROGRAM_ACCESS      = -1, // A load straddled the end of the program image
+    OUT_OF_BOUNDS       = -2, // A load or store outside of guest memory
+    OUT_OF_PROGRAM      = -3, // Control went somewhere that isn't an instruction in the program
+    ILLEGAL_INSTRUCTION = -4,
+    INSTRUCTION_LIMIT   = -5, // Ran out of instruction budget, probably an infinite loop
+};
+
+struct ExecutionResult {
+    std::int32_t returnValue{};
+    ExecutionError error{ExecutionError::NONE};
+    std::uint64_t instructionCount{};
+};
+
+// For the backends that run lanes, called during run() for every lane as soon as it's done, with how it did. Returns
+// true after starting the lane over on another input (resetLane(), then writeInput() and so on), which it then runs in
+// the same run(). Returns false to leave it be, the lanes that are done wait for the rest then.
+using LaneRefill = std::function<bool(std::size_t lane, ExecutionResult result)>;
+
+// Edge coverage, the same map ajaxemu keeps: every jump, call, return and branch (taken or not) hashes where it came
+// from and where it went into one byte of the map and bumps that. Hit counts wrap, like AFL's do.
+constexpr std::uint32_t COVERAGE_MAP_SHIFT = 16;
+constexpr std::size_t COVERAGE_MAP_SIZE    = std::size_t{1} << COVERAGE_MAP_SHIFT;
+
+// Spot in the map for the instruction at pc, the same hash as ajaxemu's coverageLocation()
+constexpr std::uint32_t coverageLocation(const MachineWord pc) {
+    return ((pc >> 2) * 0x9e3779b1u) >> (32 - COVERAGE_MAP_SHIFT);
+}
+
+// AFL's hit count buckets, one bit for each of 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and 128+ hits, for comparing maps
+constexpr std::uint8_t coverageBucket(const std::uint8_t hits) {
+    constexpr std::uint8_t limits[] = {0, 1, 2, 3, 7, 15, 31, 127};
+    std::uint8_t bucket             = 0;
+    for (std::size_t i = 0; i < std::size(limits) && hits > limits[i]; i++) {
+        bucket = 1u << i;
+    }
+    return bucket;
+}
+
+// The operands of a conditional branch, as it compared them. pc is the branch's.
+struct ComparisonRecord {
+    MachineWord pc{};
+    MachineWord left{};
+    MachineWord right{};
+};
+
 struct State {
     // Program counter,
     MachineWord pc{0};
@@ -59,14 +131,14 @@ struct State {
 
 class AbstractMachineBackend {
 public:
-    explicit AbstractMachineBackend(std::uint8_t* memory, State state, std::size_t programSize)
-        : memory(memory), program(memory + MEMORY_SIZE), state(state), programSize(programSize),
+    explicit AbstractMachineBackend(const std::uint8_t* memory, State state, std::size_t programSize)
+        : memory(memory), program(memory), state(state), programSize(programSize),
           numberOfInstructions(programSize / 4){};
     virtual void run() = 0;
 
 protected:
-    std::uint8_t* memory;
-    std::uint8_t* program;
+    const std::uint8_t* memory;
+    const std::uint8_t* program;
     std::size_t programSize;
     std::size_t numberOfInstructions;
     State state;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Memory for everything one worker thread's instances own: their registers, guest memory and results. It comes in
+// chunks of whole 2 MiB pages (transparent huge pages, if the kernel hands them out), so gathers and page copies
+// don't spend their time missing the TLB, and from the NUMA node of the thread that made the arena rather than
+// wherever the first touch happens to run. Allocating is bumping a pointer, nothing is freed until the arena is.
+//
+// Every allocation starts on a cache line of its own, so two of them never share one, whoever ends up writing them.
+class Arena {
+public:
+    static constexpr std::size_t HUGE_PAGE_SIZE  = std::size_t{2} << 20;
+    static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    // Only runs the destructor of what create() made, the memory goes with the arena
+    struct Destroy {
+        template <typename T>
+        void operator()(T* object) const {
+            object->~T();
+        }
+    };
+    template <typename T>
+    using Pointer = std::unique_ptr<T, Destroy>;
+
+    // On the node the calling thread is running on right now, see Campaign for how its workers stay there
+    Arena();
+    ~Arena();
+    Arena(const Arena&)            = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // size bytes of zeroes, aligned to alignment (a power of two, up to a huge page). Exits (having logged why) if
+    // there's no memory left.
+    [[nodiscard]] void* allocate(std::size_t size, std::size_t alignment = CACHE_LINE_SIZE);
+
+    template <typename T, typename... Args>
+    [[nodiscard]] Pointer<T> create(Args&&... args) {
+        void* memory = allocate(sizeof(T), std::max(alignof(T), CACHE_LINE_SIZE));
+        return Pointer<T>(new (memory) T(std::forward<Args>(args)...));
+    }
+
+    // -1 if the kernel wouldn't say
+    [[nodiscard]] int node() const { return numaNode; }
+
+private:
+    struct Chunk {
+        std::uint8_t* base;
+        std::size_t size;
+    };
+
+    // Allocations smaller than this share a chunk
+    static constexpr std::size_t CHUNK_SIZE = HUGE_PAGE_SIZE;
+
+    void grow(std::size_t size);
+
+    int numaNode;
+    std::vector<Chunk> chunks;
+    std::size_t used{}; // Of the last chunk
+};
@@ -1,9 +1,66 @@
+#include <vector>
+
 #include "backends/AbstractMachineBackend.hpp"
+#include "backends/ExecutionPolicies.hpp"
+#include "backends/GuestSystem.hpp"
+#include "backends/MicroOp.hpp"
+#include "backends/PagedMemory.hpp"
 
 #pragma once
 
+// Policy is one of the ExecutionPolicy instantiations in ExecutionPolicies.hpp. Only ProductionPolicy, DebugPolicy and
+// CmpLogPolicy are instantiated (at the bottom of ClassicalBackend.cpp), add another one there if you need it.
+//
+// Guest memory is paged (see PagedMemory) over the image passed to the constructor, which is shared and never written
+// to. The stack and heap go in the rest of the GUEST_ADDRESS_SPACE.
+template <typename Policy>
 class ClassicalBackend : AbstractMachineBackend {
 public:
-    using AbstractMachineBackend::AbstractMachineBackend;
+    ClassicalBackend(std::shared_ptr<const PageImage> image, State state, std::size_t programSize,
+                     std::uint64_t instructionLimit = DEFAULT_INSTRUCTION_LIMIT);
     void run() override;
+
+    // Puts the guest back to the memory and State it was constructed with. The pages written since go back to the
+    // image's, nothing is copied.
+    void reset();
+
+    // How the last run() ended. instructionCount is only filled in if the policy counts instructions, and only exact
+    // with PER_BLOCK if the run didn't stop in the middle of a block.
+    [[nodiscard]] const ExecutionResult& lastResult() const { return result; }
+
+    // Edge hit counts of the last run(), COVERAGE_MAP_SIZE of them, see coverageLocation(). Empty unless the policy
+    // records coverage. Bucket them with coverageBucket() before comparing runs.
+    [[nodiscard]] const std::vector<std::uint8_t>& coverageMap() const { return coverage; }
+
+    // Every conditional branch of the last run() whose operands differed, in order, empty unless the policy records
+    // comparisons. The ones that compare equal don't tell the input-to-state stage anything. Stops at MAX_COMPARISONS.
+    [[nodiscard]] const std::vector<ComparisonRecord>& comparisons() const { return comparisonLog; }
+
+    // stdin, stdout and the heap of the guest. Every run() starts it over, so the output is what the last one wrote.
+    [[nodiscard]] GuestSystem& guest() { return guestSystem; }
+
+    // What the guest's memory looks like now. run() carries on from there, only reset() puts it back.
+    [[nodiscard]] PagedMemory& guestMemory() { return pagedMemory; }
+
+    static constexpr std::size_t MAX_COMPARISONS = 1024;
+
+private:
+    // The program, decoded once at construction. Indexed by pc / 4.
+    std::vector<MicroOp> microOps;
+
+    // For InstructionCounting::PER_BLOCK, indexed like microOps: how many instructions there are from each one up to
+    // and including the next control transfer. That's what run() charges whenever control lands somewhere.
+    std::vector<std::uint32_t> segmentCosts;
+
+    std::vector<std::uint8_t> coverage;
+    std::vector<ComparisonRecord> comparisonLog;
+    State initialState;
+    PagedMemory pagedMemory;
+    GuestSystem guestSystem;
+    std::uint64_t instructionLimit;
+    ExecutionResult result{};
 };
+
+extern template class ClassicalBackend<ProductionPolicy>;
+extern template class ClassicalBackend<DebugPolicy>;
+extern template class ClassicalBackend<CmpLogPolicy>;
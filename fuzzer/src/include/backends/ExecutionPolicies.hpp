@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Compile-time knobs for the interpreter. Everything here is checked with if constexpr, so whatever a policy turns off
+// costs nothing at all on the hot path, it's simply not in the generated code.
+
+enum class BoundsCheckMode {
+    NONE,    // Trust the guest. Out-of-bounds loads read zeros and stores go nowhere, the run carries on.
+    CHECKED, // A load or store outside the guest's address space stops with OUT_OF_BOUNDS.
+};
+
+enum class InstructionCounting {
+    // No count and no instruction limit, only for guests you trust: one that loops forever hangs the run, and the
+    // ecall clock always reads 0
+    NONE,
+    // Every instruction as it's dispatched
+    EXACT,
+    // Everything up to the next branch, jump or ecall at once, when control gets there (like the JITs). Exact unless a
+    // run stops in the middle of a block, and costs a load and an add per control transfer instead of per instruction.
+    PER_BLOCK,
+};
+
+template <bool TRACE_, bool RECORD_COVERAGE_, BoundsCheckMode BOUNDS_CHECK_, InstructionCounting COUNT_INSTRUCTIONS_,
+          bool RECORD_COMPARISONS_ = false>
+struct ExecutionPolicy {
+    // Print every instruction as it's executed, and dump guest memory when done
+    static constexpr auto TRACE = TRACE_;
+
+    // Count hits per edge in ajaxemu's hashed map, see ClassicalBackend::coverageMap()
+    static constexpr auto RECORD_COVERAGE = RECORD_COVERAGE_;
+
+    static constexpr auto BOUNDS_CHECK = BOUNDS_CHECK_;
+
+    // Count executed instructions, and stop once the backend's instruction limit is hit. The ecall clock reads this.
+    static constexpr auto COUNT_INSTRUCTIONS = COUNT_INSTRUCTIONS_;
+
+    // Log the operands of every conditional branch (CmpLog), for the input-to-state stage, see inputToState()
+    static constexpr auto RECORD_COMPARISONS = RECORD_COMPARISONS_;
+};
+
+// As fast as it gets, for throughput runs
+using ProductionPolicy = ExecutionPolicy<false, false, BoundsCheckMode::NONE, InstructionCounting::PER_BLOCK>;
+
+// What you want while figuring out why something went wrong
+using DebugPolicy = ExecutionPolicy<true, true, BoundsCheckMode::CHECKED, InstructionCounting::EXACT, true>;
+
+// For the extra run an input gets to see what it's compared against. Has to survive whatever the input does, so it
+// checks bounds and counts instructions too.
+using CmpLogPolicy = ExecutionPolicy<false, false, BoundsCheckMode::CHECKED, InstructionCounting::EXACT, true>;
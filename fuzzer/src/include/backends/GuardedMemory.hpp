@@ -0,0 +1,45 @@
+#pragma once
+
+#include <csignal>
+#include <cstdint>
+
+#include <ucontext.h>
+
+// One instance's guest memory, at the start of a reservation of the whole 32-bit address space (and a page more, for
+// accesses that start just below 4 GiB). The first size bytes can be read and written, and only take up memory once
+// they're touched. Everything else is PROT_NONE. Generated code can then use any zero-extended guest address as an
+// index without checking it first: an access outside guest memory faults, and the SIGSEGV handler hands the fault to
+// whoever owns the reservation it hit.
+//
+// The handler is installed the first time one is made and stays for the rest of the process. Faults anywhere else go
+// to whatever handler was there before.
+class GuardedMemory {
+public:
+    static constexpr std::uint64_t PAGE_SIZE   = 4096;
+    static constexpr std::uint64_t RESERVATION = (std::uint64_t{1} << 32) + PAGE_SIZE;
+
+    // Runs in the signal handler, on the thread that faulted. Returns true if it moved the context somewhere that
+    // recovers from the fault (its instruction pointer, usually), false to let the fault through.
+    using FaultHandler = bool (*)(void* owner, ucontext_t* context);
+
+    // Exits (having logged why) if the address space can't be reserved
+    GuardedMemory(std::uint64_t size, FaultHandler handler, void* owner);
+    ~GuardedMemory();
+    GuardedMemory(const GuardedMemory&)            = delete;
+    GuardedMemory& operator=(const GuardedMemory&) = delete;
+
+    [[nodiscard]] std::uint8_t* data() const { return base; }
+    [[nodiscard]] std::uint64_t size() const { return validSize; }
+
+    // Hands the pages from offset from (a multiple of PAGE_SIZE) to the end of guest memory back to the kernel. They
+    // read as zeros again, and take up memory once they're touched again.
+    void discard(std::uint64_t from);
+
+private:
+    static void onFault(int signal, siginfo_t* info, void* context);
+
+    std::uint8_t* base;
+    std::uint64_t validSize;
+    FaultHandler handler;
+    void* owner;
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+
+// The bit of an operating system the guests get. An ecall asks for a Linux RV32 system call (newlib's syscalls use the
+// same numbers): the number is in a7, the arguments in a0-a2, and the result goes back in a0, a negative errno if it
+// failed. That's enough for printf, malloc and reading the input from stdin. Nothing in here makes two runs of the same
+// input differ, there are no files and the clock counts instructions.
+enum class Syscall : MachineWord {
+    READ            = 63,
+    WRITE           = 64,
+    EXIT            = 93,
+    EXIT_GROUP      = 94,
+    CLOCK_GETTIME   = 113,
+    GETTIMEOFDAY    = 169,
+    BRK             = 214,
+    CLOCK_GETTIME64 = 403,
+};
+
+constexpr std::uint8_t SYSCALL_NUMBER_REGISTER = 17; // a7
+constexpr std::uint8_t SYSCALL_RESULT_REGISTER = 10; // a0, which is also the first argument
+
+struct SyscallResult {
+    MachineWord value;
+    bool exit; // The guest is done, value is its exit status
+};
+
+// What one instance has around it
+struct GuestIO {
+    // Everything written to stdout and stderr since the last flush(). Past OUTPUT_LIMIT bytes the rest is dropped (the
+    // guest is still told it was written).
+    static constexpr std::size_t OUTPUT_LIMIT = 64 * 1024;
+    std::vector<std::uint8_t> output;
+
+    // stdin. Not a copy, whoever sets it keeps it alive until the run is over.
+    std::span<const std::uint8_t> input;
+    std::size_t inputPosition{};
+
+    // Where brk has the end of the heap
+    MachineWord programBreak{};
+
+    // Writes output to file and empties it
+    void flush(std::FILE* file);
+};
+
+// Guest memory for GuestSystem::call() when an instance's memory is a single piece of host memory. A backend with a
+// different layout (PagedMemory, or one that has to know about writes) brings something else with the same read() and
+// write().
+struct FlatGuestMemory {
+    std::uint8_t* base;
+    std::size_t size;
+
+    // false if [address, address + bytes) isn't all in guest memory
+    bool read(const MachineWord address, void* out, const std::size_t bytes) const {
+        if (bytes == 0) {
+            return true;
+        }
+        if (address >= size || bytes > size - address) {
+            return false;
+        }
+        std::memcpy(out, base + address, bytes);
+        return true;
+    }
+
+    bool write(const MachineWord address, const void* in, const std::size_t bytes) const {
+        if (bytes == 0) {
+            return true;
+        }
+        if (address >= size || bytes > size - address) {
+            return false;
+        }
+        std::memcpy(base + address, in, bytes);
+        return true;
+    }
+};
+
+// The GuestIO of every instance a backend runs, and the part of guest memory brk hands out as heap
+class GuestSystem {
+public:
+    // The break starts at heapStart and can be moved up to heapLimit, so the heap is empty if they're the same
+    GuestSystem(std::size_t instances, MachineWord heapStart, MachineWord heapLimit);
+
+    GuestIO& operator[](const std::size_t instance) { return instances[instance]; }
+    const GuestIO& operator[](const std::size_t instance) const { return instances[instance]; }
+
+    // Every instance's output emptied, its input rewound and its break back at the start of the heap. What the inputs
+    // are is left alone.
+    void reset();
+
+    // Same, for just the one
+    void reset(std::size_t instance);
+
+    // Runs an ecall for one instance: number from a7, a0-a2 the arguments. instructions is how many the instance has
+    // run so far (or 0 if the backend doesn't count them), which is the time as far as the guest is concerned.
+    template <typename Memory>
+    SyscallResult call(const std::size_t instance, const MachineWord number, const MachineWord a0, const MachineWord a1,
+                       const MachineWord a2, Memory&& memory, const std::uint64_t instructions) {
+        auto& io            = instances[instance];
+        const auto failure  = [](const int error) { return SyscallResult{static_cast<MachineWord>(-error), false}; };
+        const auto success = [](const MachineWord value) { return SyscallResult{value, false}; };
+
+        switch (static_cast<Syscall>(number)) {
+            case Syscall::READ: {
+                if (a0 != 0) {
+                    return failure(EBADF);
+                }
+                const auto bytes = std::min<std::size_t>(a2, io.input.size() - io.inputPosition);
+                if (!memory.write(a1, io.input.data() + io.inputPosition, bytes)) {
+                    return failure(EFAULT);
+                }
+                io.inputPosition += bytes;
+                return success(static_cast<MachineWord>(bytes));
+            }
+            case Syscall::WRITE: {
+                if (a0 != 1 && a0 != 2) {
+                    return failure(EBADF);
+                }
+                const auto kept = std::min<std::size_t>(a2, GuestIO::OUTPUT_LIMIT - io.output.size());
+                const auto old  = io.output.size();
+                io.output.resize(old + kept);
+                if (!memory.read(a1, io.output.data() + old, kept)) {
+                    io.output.resize(old);
+                    return failure(EFAULT);
+                }
+                return success(a2);
+            }
+            case Syscall::EXIT:
+            case Syscall::EXIT_GROUP: {
+                return SyscallResult{a0, true};
+            }
+            case Syscall::CLOCK_GETTIME:
+            case Syscall::CLOCK_GETTIME64:
+            case Syscall::GETTIMEOFDAY: {
+                // An instruction takes a nanosecond. Either struct is two 64-bit words here, seconds and the rest:
+                // 64-bit time_t is all RV32 Linux has, and a 32-bit tv_nsec only takes the low half.
+                const auto gettimeofday = static_cast<Syscall>(number) == Syscall::GETTIMEOFDAY;
+                const auto out          = gettimeofday ? a0 : a1;
+                const std::uint64_t time[2] = {instructions / 1000000000,
+                                               instructions % 1000000000 / (gettimeofday ? 1000 : 1)};
+                if (out != 0 && !memory.write(out, time, sizeof(time))) {
+                    return failure(EFAULT);
+                }
+                return success(0);
+            }
+            case Syscall::BRK: {
+                // Anything outside the heap (brk(0) in particular) just asks where the break is
+                if (a0 >= heapStart && a0 <= heapLimit) {
+                    io.programBreak = a0;
+                }
+                return success(io.programBreak);
+            }
+        }
+        return failure(ENOSYS);
+    }
+
+private:
+    std::vector<GuestIO> instances;
+    MachineWord heapStart;
+    MachineWord heapLimit;
+};
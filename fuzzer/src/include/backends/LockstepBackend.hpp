@@ -0,0 +1,97 @@
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+#include "backends/GuestSystem.hpp"
+#include "backends/MicroOp.hpp"
+#include "backends/PagedMemory.hpp"
+
+#pragma once
+
+// Like VectorState, but plain integers and any number of lanes. Lane i of every instance is x[register][i], so one
+// instruction across all lanes is a loop over a contiguous array the compiler can turn into SSE/AVX2/AVX-512.
+template <std::size_t LANES>
+struct LockstepState {
+    // Program counter, per lane
+    alignas(64) MachineWord pc[LANES]{};
+
+    // Registers, they are called "x" in the technical document
+    // x[0] is just constant 0, and so we have 31 general purpose registers
+    alignas(64) MachineWord x[32][LANES]{};
+};
+
+// Runs LANES instances of the same program in lockstep. Every lane gets its own guest memory, paged copy-on-write over
+// the PageImage passed to the constructor (program included), and starts from the same State. Whatever
+// goes into memory before run() is what makes them differ.
+//
+// Instantiated for 8 (a 256-bit vector of 32-bit words, AVX2) and 16 (AVX-512) lanes at the bottom of
+// LockstepBackend.cpp.
+template <std::size_t LANES>
+class LockstepBackend : AbstractMachineBackend {
+public:
+    // The pages the lanes write get copied into arena if there is one (which has to outlive the backend)
+    LockstepBackend(std::shared_ptr<const PageImage> image, State state, std::size_t programSize,
+                    std::uint64_t instructionLimit = DEFAULT_INSTRUCTION_LIMIT, Arena* arena = nullptr);
+    void run() override;
+
+    // Same, but lanes that are done go to refill, which can start them over on the next input right away. The other
+    // lanes don't wait for them, whichever group of lanes is at the lowest pc goes next as always.
+    void run(const LaneRefill& refill);
+
+    // Puts every lane back to the initial memory and State (and its GuestIO to the start). The pages written since the
+    // last reset() go back to the image's, nothing is copied.
+    void reset();
+
+    // Same, for one lane. It's running again afterwards, in the middle of a run() too.
+    void resetLane(std::size_t lane);
+
+    // Copies size bytes of input into a lane's memory at address, so that reset() knows to undo it. Returns false if it
+    // doesn't fit.
+    bool writeInput(std::size_t lane, MachineWord address, const std::uint8_t* data, std::size_t size);
+
+    // Laid out like the memory passed to the constructor, with the rest of the GUEST_ADDRESS_SPACE after it. Anything
+    // written to it is undone by reset().
+    [[nodiscard]] PagedMemory& laneMemory(const std::size_t lane) { return laneMemories[lane]; }
+    [[nodiscard]] LockstepState<LANES>& laneState() { return lanes; }
+
+    // stdin, stdout and the heap of every lane, guest()[lane]
+    [[nodiscard]] GuestSystem& guest() { return guestSystem; }
+
+    // How each lane's last run ended
+    [[nodiscard]] const std::array<ExecutionResult, LANES>& results() const { return laneResults; }
+
+private:
+    // One per instruction set the lane loops vectorize for, the dynamic loader picks the best one the CPU has. Has to
+    // be on the declaration, the extern templates below keep it from taking on the definition.
+    __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+    void step(const MicroOp& op, MachineWord groupPc);
+    void stopLane(std::size_t lane, ExecutionError error);
+    static std::vector<PagedMemory> makeLaneMemories(const std::shared_ptr<const PageImage>& image, Arena* arena);
+
+    // The program, decoded once at construction. Indexed by pc / 4.
+    std::vector<MicroOp> microOps;
+
+    // One per lane, all over the same image
+    std::vector<PagedMemory> laneMemories;
+    LockstepState<LANES> lanes{};
+
+    // 32-bit rather than bool so they vectorize alongside the registers
+    alignas(64) std::uint32_t running[LANES]{};
+    alignas(64) std::uint32_t activeMask[LANES]{};
+
+    // Instructions each lane retired since it was last reset
+    alignas(64) std::uint64_t counts[LANES]{};
+
+    // The lanes stopLane() stopped in the current step, for run() to hand to the refill
+    std::array<std::uint8_t, LANES> stoppedLanes{};
+    std::size_t stoppedCount{};
+
+    GuestSystem guestSystem;
+
+    std::uint64_t instructionLimit;
+    std::array<ExecutionResult, LANES> laneResults{};
+};
+
+extern template class LockstepBackend<8>;
+extern template class LockstepBackend<16>;
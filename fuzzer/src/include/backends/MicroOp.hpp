@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+
+// A decode-once representation of the program for the interpreters.
+//
+// Every instruction is turned into a MicroOp up front, so the hot loop never has to pull register indices out of the
+// raw bits or glue the scattered B/J/S immediates back together. funct3/funct7 are folded into the handler, so one
+// dispatch picks the exact operation instead of going through an opcode switch and then a funct3 switch.
+
+enum class MicroOpHandler : std::uint8_t {
+    LUI,
+    AUIPC,
+    JAL,
+    J, // jal with rd == x0, nothing to link
+    JALR,
+    JR, // jalr with rd == x0, e.g. ret
+    BEQ,
+    BNE,
+    BLT,
+    BGE,
+    BLTU,
+    BGEU,
+    LB,
+    LH,
+    LW,
+    LBU,
+    LHU,
+    SB,
+    SH,
+    SW,
+    ADDI,
+    SLTI,
+    SLTIU,
+    XORI,
+    ORI,
+    ANDI,
+    SLLI,
+    SRLI,
+    SRAI,
+    ADD,
+    SUB,
+    SLL,
+    SLT,
+    SLTU,
+    XOR,
+    SRL,
+    SRA,
+    OR,
+    AND,
+    NOP,   // fence, ebreak, csr accesses, and anything whose only effect would be a write to x0
+    ECALL, // A system call, see GuestSystem
+
+    // Superinstructions, each covering the instruction it replaces plus the one after it (see fuseSuperinstructions)
+    LI,      // lui/auipc rd + addi rd, rd: imm is the final constant
+    CALL,    // auipc/lui rd + jalr rs2, imm(rd): imm is the rd value, target the callee, rs2 the link register
+    LBU_BEQ, // lbu rd, imm(rs1) + beq rd, rs2: target is the branch target
+    LBU_BNE, // lbu rd, imm(rs1) + bne rd, rs2: target is the branch target
+    ADDI_SW, // addi rd, rs1, imm + sw rs2, target(rd): prologues, addi sp, sp, -N; sw ra, N-4(sp)
+    LW_ADDI, // lw rd, imm(rs1) + addi rs1, rs1, target: epilogues, lw ra, N-4(sp); addi sp, sp, N
+    ILLEGAL,
+    OUT_OF_PROGRAM, // Sentinel at the end of the program, also the target of any jump that leaves it
+    HANDLER_COUNT,
+};
+
+struct MicroOp {
+    MicroOpHandler handler{MicroOpHandler::ILLEGAL};
+    std::uint8_t rd{};
+    std::uint8_t rs1{};
+    std::uint8_t rs2{};
+
+    // Sign-extended immediate. LUI and AUIPC have their final value folded in (the pc is known at decode time),
+    // JAL and J keep their link value (pc + 4) here.
+    MachineWord imm{};
+
+    // Branches, JAL and J: index of the micro-op to continue at.
+    // JALR and JR: the link value (pc + 4), since imm already holds the offset.
+    // Superinstructions: whatever the second half needs, see MicroOpHandler.
+    MachineWord target{};
+};
+
+// Superinstructions retire two guest instructions each
+constexpr bool isSuperinstruction(const MicroOpHandler handler) {
+    return handler >= MicroOpHandler::LI && handler <= MicroOpHandler::LW_ADDI;
+}
+
+// Where basic blocks start, indexed like the micro-ops: the entry of the program, anything branched or jumped to,
+// anything right after a control transfer, every ecall (which is a block of its own), and the sentinel (so every block
+// has an end). For the JITs, expects an unfused program.
+std::vector<bool> findBlockLeaders(const std::vector<MicroOp>& microOps);
+
+// One bit per guest register
+using GuestRegisterSet = std::uint32_t;
+
+// Which guest registers a micro-op reads and writes, for the JITs' register allocation. x0 is never included, reading
+// it always gives zero and writing it does nothing.
+GuestRegisterSet registersRead(const MicroOp& op);
+GuestRegisterSet registersWritten(const MicroOp& op);
+
+// Guest registers that might hold something else in every instance of the program, on entry to each micro-op, for the
+// vector JIT. Instances start from the same registers and only their memory tells them apart, so a register varies once
+// it's loaded from memory or computed from one that was. Everything else (the stack pointer, constants, addresses of
+// globals, loop counters that don't depend on the input) is a guess at uniform: instances that took different paths
+// there can still disagree, so the JIT checks before it relies on it. Expects an unfused program.
+std::vector<GuestRegisterSet> findVaryingRegisters(const std::vector<MicroOp>& microOps);
+
+static_assert(sizeof(MicroOp) == 12, "Keep micro-ops small, the whole program should sit in L1");
+
+// Decodes a program image. The result has one micro-op per 4-byte instruction word, so micro-op index == pc / 4,
+// followed by a single OUT_OF_PROGRAM sentinel. Unless fuse is false, common instruction pairs are fused into
+// superinstructions (that only pays off for interpreters, a JIT wants to see the plain instructions).
+std::vector<MicroOp> decodeProgram(const std::uint8_t* program, std::size_t programSize, bool fuse = true);
+
+// Replaces the first micro-op of common pairs (constant building, calls, byte compare loops, stack frame setup and
+// teardown) with a superinstruction that does both and then skips over the second. The second micro-op is left alone,
+// so anything that jumps straight to it still works and micro-op index == pc / 4 still holds.
+void fuseSuperinstructions(std::vector<MicroOp>& microOps);
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+#include "backends/Arena.hpp"
+
+// The memory image a set of PagedMemory instances start from, cut into pages. Built once and then only read, so any
+// number of instances (and threads) can share it. Everything past the image reads as zeros.
+class PageImage {
+public:
+    static constexpr std::size_t PAGE_SHIFT = 12;
+    static constexpr std::size_t PAGE_SIZE  = std::size_t{1} << PAGE_SHIFT;
+
+    // size bytes of memory from guest address 0, whatever fill writes to them (they're zeros until then), in an address
+    // space of addressSpace bytes (a multiple of PAGE_SIZE)
+    PageImage(std::size_t size, const std::function<void(std::uint8_t*)>& fill,
+              std::size_t addressSpace = GUEST_ADDRESS_SPACE);
+
+    [[nodiscard]] std::size_t pageCount() const { return addressSpace >> PAGE_SHIFT; }
+    [[nodiscard]] std::size_t size() const { return addressSpace; }
+
+    // Guest address of the first page past the image, where a heap can start
+    [[nodiscard]] MachineWord end() const { return static_cast<MachineWord>(imagePages << PAGE_SHIFT); }
+
+    // The image in one piece, from guest address 0. Zeros from its end up to the end of the page after the last one.
+    [[nodiscard]] const std::uint8_t* data() const { return pages.data(); }
+
+    // One page of the image, or the zero page if it's past the end
+    [[nodiscard]] const std::uint8_t* page(const std::size_t index) const {
+        return pages.data() + (index < imagePages ? index : imagePages) * PAGE_SIZE;
+    }
+
+private:
+    std::size_t addressSpace;
+    std::size_t imagePages;
+    std::vector<std::uint8_t> pages; // The image's pages, then the zero page
+};
+
+// One instance's guest memory, copy-on-write over a shared PageImage. Every page starts out as the image's, and gets a
+// private copy the first time it's written to, so an instance costs its page table plus the pages it has written, not
+// the whole address space. reset() drops the copies again (and keeps them around for the next run to reuse).
+//
+// Loads and stores go through a one-entry TLB each: the page the last one hit. Most of them land on the same page as
+// the one before (the stack, the string being parsed), then an access is a subtraction, a compare and a memcpy.
+// Anything else takes the slow path through the page table.
+class PagedMemory {
+public:
+    // The private copies come out of arena if there is one (which has to outlive this), off the heap otherwise
+    explicit PagedMemory(std::shared_ptr<const PageImage> image, Arena* arena = nullptr);
+
+    [[nodiscard]] std::size_t size() const { return image->size(); }
+    [[nodiscard]] const PageImage& pageImage() const { return *image; }
+
+    // false if it's not all inside the address space, value is then 0
+    template <typename T>
+    bool load(const MachineWord address, T& value) {
+        const auto offset = address - readTag;
+        if (offset <= PageImage::PAGE_SIZE - sizeof(T)) [[likely]] {
+            std::memcpy(&value, readPage + offset, sizeof(T));
+            return true;
+        }
+        return read(address, &value, sizeof(T));
+    }
+
+    // false if it's not all inside the address space, nothing is written then
+    template <typename T>
+    bool store(const MachineWord address, const T value) {
+        const auto offset = address - writeTag;
+        if (offset <= PageImage::PAGE_SIZE - sizeof(T)) [[likely]] {
+            std::memcpy(writePage + offset, &value, sizeof(T));
+            return true;
+        }
+        return write(address, &value, sizeof(T));
+    }
+
+    // The slow paths, for accesses of any size (GuestSystem uses these too). Both check the whole range before touching
+    // anything, read() zeroes out if it fails.
+    bool read(MachineWord address, void* out, std::size_t bytes);
+    bool write(MachineWord address, const void* in, std::size_t bytes);
+
+    // Back to the image, every page
+    void reset();
+
+    // Pages with a private copy right now
+    [[nodiscard]] std::size_t privatePageCount() const { return written.size(); }
+
+private:
+    // An address no tag matches: subtracting it from any 32-bit address leaves something way past a page
+    static constexpr std::uint64_t NO_PAGE = std::uint64_t{1} << 32;
+
+    [[nodiscard]] bool isPrivate(const std::size_t index) const { return table[index] != image->page(index); }
+
+    // The page at index, copied first if it's still the image's
+    std::uint8_t* writable(std::size_t index);
+
+    std::shared_ptr<const PageImage> image;
+
+    // Every page of the address space. The image's are only ever read through, see isPrivate().
+    std::vector<std::uint8_t*> table;
+
+    // The indices of the pages copied since the last reset(), and the copies reset() took back for reuse
+    std::vector<std::size_t> written;
+    Arena* arena;
+    std::vector<std::unique_ptr<std::uint8_t[]>> owned; // Unless they're the arena's
+    std::vector<std::uint8_t*> spare;
+
+    std::uint64_t readTag{NO_PAGE};
+    const std::uint8_t* readPage{};
+    std::uint64_t writeTag{NO_PAGE};
+    std::uint8_t* writePage{};
+};
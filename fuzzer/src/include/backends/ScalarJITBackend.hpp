@@ -0,0 +1,74 @@
+#pragma once
+
+#include <asmjit/asmjit.h>
+#include <asmjit/core.h>
+#include <asmjit/x86.h>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+#include "backends/GuardedMemory.hpp"
+#include "backends/GuestSystem.hpp"
+#include "backends/MicroOp.hpp"
+#include "backends/PagedMemory.hpp"
+
+// A JIT that runs one instance at a time. Each RV32I basic block becomes a run of native x86-64 code, blocks jump
+// straight to each other for branches and jal, and only jalr goes through a dispatcher (a table lookup on the pc).
+// Meant for subjects with deep, data-dependent control flow, where lanes of the AVX-512 backend would diverge anyway.
+//
+// Guest memory is a GuardedMemory of GUEST_ADDRESS_SPACE bytes, the image passed to the constructor copied to the
+// start of it. Loads and stores don't check their address, an access outside of it faults and onFault() turns that
+// into OUT_OF_BOUNDS.
+class ScalarJITBackend : AbstractMachineBackend {
+public:
+    ScalarJITBackend(std::shared_ptr<const PageImage> image, State state, std::size_t programSize,
+                     std::uint64_t instructionLimit = DEFAULT_INSTRUCTION_LIMIT);
+    ~ScalarJITBackend();
+    void run() override;
+
+    // Puts the guest back to the image and State it was constructed with. The image's pages are copied back, the rest
+    // of guest memory (the stack, the heap) goes back to the kernel.
+    void reset();
+
+    // How the last run() ended. instructionCount is counted a basic block at a time, so it's exact unless the run was
+    // stopped in the middle of one.
+    [[nodiscard]] const ExecutionResult& lastResult() const { return result; }
+    [[nodiscard]] const State& finalState() const { return state; }
+
+    // stdin, stdout and the heap of the guest. Every run() starts it over, so the output is what the last one wrote.
+    [[nodiscard]] GuestSystem& guest() { return guestSystem; }
+
+private:
+    // System V calling convention: the generated code keeps the state, memory and dispatch table pointers pinned in
+    // callee-saved registers, and returns an ExecutionError. budget is decremented by every block executed.
+    using JitFunction = std::int32_t (*)(State* state, std::uint8_t* memory, const void* const* dispatchTable,
+                                         std::int64_t* budget);
+
+    void translate(const std::vector<MicroOp>& microOps);
+
+    // Called by the generated code for the ecall at pc, budget being what's left of the instruction budget. Returns
+    // where to go on, the next instruction or DONE_ADDRESS if the guest exited.
+    static MachineWord systemCall(ScalarJITBackend* backend, MachineWord pc, std::int64_t budget);
+
+    // From the SIGSEGV handler, for a fault in guestMemory. If it's one of our loads or stores, records its pc and
+    // sends the generated code to the epilogue with OUT_OF_BOUNDS.
+    static bool onFault(void* owner, ucontext_t* context);
+
+    asmjit::JitRuntime runtime;
+    JitFunction function{};
+    std::size_t codeSize{};
+    const void* epilogueAddress{};
+
+    // Where the dispatcher goes for every pc / 4: the code of the instruction if it starts a block, otherwise a stub
+    // that pays for the rest of the block first (blocks pay up front, so jumping into the middle of one would skip it)
+    std::vector<const void*> dispatchTable;
+
+    // Host address of the code for every instruction, indexed by pc / 4, in order. For onFault().
+    std::vector<const void*> instructionAddresses;
+
+    std::shared_ptr<const PageImage> image;
+    State initialState;
+    GuardedMemory guestMemory;
+    GuestSystem guestSystem;
+    std::uint64_t instructionLimit;
+    ExecutionResult result{};
+};
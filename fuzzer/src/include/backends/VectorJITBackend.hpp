@@ -0,0 +1,266 @@
+#pragma once
+
+#include <array>
+#include <asmjit/asmjit.h>
+#include <asmjit/core.h>
+#include <asmjit/x86.h>
+#include <memory>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+#include "backends/Arena.hpp"
+#include "backends/GuestSystem.hpp"
+#include "backends/MicroOp.hpp"
+#include "backends/PagedMemory.hpp"
+#include "backends/VectorRegisterAllocator.hpp"
+
+static constexpr auto MAX_NUMBER_OF_INSTRUCTIONS = 32768;
+
+template <std::size_t LANES>
+class VectorJITBackend;
+
+// Like LockstepState, lane i of every instance is element i of a vector. This is what the generated code works on,
+// STATE_REGISTER points at it for the whole run.
+template <std::size_t LANES>
+struct VectorState {
+    // Program counter,
+    // Lanes that are waiting for their turn (or stopped) have theirs here, the ones running the current block don't
+    // bother updating it until they leave it
+    alignas(64) MachineWord pc[LANES]{};
+
+    // ExecutionError of every lane, written when a lane stops
+    alignas(64) std::int32_t error[LANES]{};
+
+    // Instructions every lane may still run. Charged a basic block at a time, a lane stops when it goes negative.
+    alignas(64) std::int32_t budget[LANES]{};
+
+    // Registers, they are called "x" in the technical document
+    // x[0] is just constant 0, and so we have 31 general purpose registers
+    // These are the home slots, the JIT only keeps registers in vector registers for the length of a basic block
+    alignas(64) MachineWord x[32][LANES]{};
+
+    // AVX2 has no scatter, stores go through here one lane at a time: the host offset into laneLocalMemory and the
+    // value of every lane
+    alignas(64) MachineWord storeAddress[LANES]{};
+    alignas(64) MachineWord storeValue[LANES]{};
+
+    // Whose lanes these are, for ecalls. The generated code is shared between copies, so it can't have it built in.
+    VectorJITBackend<LANES>* backend{};
+
+    // Once fewer lanes than this are left, the scheduler returns so run() can refill the ones that are done. 0 while
+    // there's nothing to refill them with.
+    std::uint32_t refillBelow{};
+};
+
+// How the lanes' copies of guest memory are laid out in laneLocalMemory
+enum class LaneMemoryLayout {
+    // Each lane's memory in one piece, a lane after the other. Every access is a gather or a scatter.
+    CONTIGUOUS,
+
+    // Word a / 4 of every lane next to each other, lane l's at (a / 4) * LANES + l. When every running lane accesses the
+    // same address (the stack, mostly, since sp tends to be the same everywhere) that's one row of LANES words and a
+    // plain vector load or store. Gathers and scatters are left for the rest. Costs the translation two vector
+    // registers for temporaries.
+    INTERLEAVED,
+};
+
+// Runs LANES instances of the same program at once, one per 32-bit element of a vector register: 16 lanes on AVX-512
+// (zmm registers, lanes masked with k registers) and 8 on AVX2 (ymm registers, lanes masked with blends and vector
+// masks). Like LockstepBackend, every lane gets its own copy of guest memory (program included) and starts from the
+// same State, so whatever goes into memory before run() is what makes them differ. The program is translated once,
+// when the backend is built, every run() after that is a call into the generated code.
+//
+// Instantiated for 8 and 16 lanes at the bottom of VectorJITBackend.cpp. Check hostSupports() before building one,
+// the generated code uses whatever the instruction set has.
+template <std::size_t LANES>
+class VectorJITBackend : AbstractMachineBackend {
+public:
+    static constexpr std::size_t LANE_COUNT = LANES;
+
+    // Whether this CPU can run the code the backend generates
+    static bool hostSupports();
+
+    VectorJITBackend(std::shared_ptr<const PageImage> image, State state, std::size_t programSize,
+                     std::uint64_t instructionLimit = DEFAULT_INSTRUCTION_LIMIT,
+                     LaneMemoryLayout layout = LaneMemoryLayout::CONTIGUOUS);
+
+    // Shares other's translated program, but gets lanes (and lane memory) of its own, fresh from a reset(). That's how
+    // every thread gets a backend without translating the program again.
+    VectorJITBackend(const VectorJITBackend& other);
+    VectorJITBackend& operator=(const VectorJITBackend&) = delete;
+
+    // Same, with the lane memory out of arena, which has to outlive the copy
+    VectorJITBackend(const VectorJITBackend& other, Arena& arena);
+
+    void run() override;
+
+    // Same, but lanes that are done go to refill, which can start them over on the next input. The generated code
+    // returns as soon as any lane is done (while refill keeps taking them) and is entered again with the refilled ones,
+    // which costs about as much as an ecall.
+    void run(const LaneRefill& refill);
+
+    // Puts every lane back to the initial memory and State, and its GuestIO to the start
+    void reset();
+
+    // Same, for one lane. It's running again afterwards, in the middle of a run() too.
+    void resetLane(std::size_t lane);
+
+    // Copies size bytes of input into a lane's memory at address. Returns false if it doesn't fit.
+    bool writeInput(std::size_t lane, MachineWord address, const std::uint8_t* data, std::size_t size);
+
+    // Copies size bytes of a lane's memory at address out into data. Returns false if that's not all in guest memory.
+    bool readMemory(std::size_t lane, MachineWord address, std::uint8_t* data, std::size_t size) const;
+
+    // How each lane's last run ended. instructionCount is counted a basic block at a time, like ScalarJITBackend.
+    [[nodiscard]] const std::array<ExecutionResult, LANES>& results() const { return laneResults; }
+
+    // stdin, stdout and the heap of every lane, guest()[lane]
+    [[nodiscard]] GuestSystem& guest() { return guestSystem; }
+
+private:
+    VectorJITBackend(const VectorJITBackend& other, Arena* arena);
+
+    // System V calling convention, see translate() for what the generated code does with them
+    using JitFunction = void (*)(VectorState<LANES>* state, std::uint8_t* laneLocalMemory,
+                                 const void* const* dispatchTable);
+
+    // Everything run() needs from the translation, shared between copies and read-only once translate() is done
+    struct Translation {
+        asmjit::JitRuntime runtime;
+        JitFunction function{};
+
+        // Host address of the code for every instruction, indexed by pc / 4, used by the scheduler. Only blocks can
+        // be entered, everything else goes to misdispatch.
+        std::vector<const void*> dispatchTable;
+
+        // Lane i's memory starts laneBaseAddressOffsets[i] bytes into laneLocalMemory (with the interleaved layout,
+        // into every row), the same for every copy. The generated code loads them from here.
+        alignas(64) std::array<std::uint32_t, LANES> laneBaseAddressOffsets{};
+
+        // What every lane's memory starts out as, and what reset() copies back
+        std::shared_ptr<const PageImage> image;
+
+        ~Translation() {
+            if (function) {
+                runtime.release(function);
+            }
+        }
+    };
+
+    // Cold path out of a block whose lanes don't all go to the same place, see translate()
+    struct DivergenceStub {
+        asmjit::Label label;
+        MachineWord target;
+        MachineWord fallthrough;
+        bool split;
+    };
+
+    // Cold path that stops the lanes in the divergence mask with an error, then carries on at resume with the lanes
+    // that are left. With ExecutionError::NONE the lanes don't stop, they wait at pc for the scheduler to pick them up
+    // again.
+    struct StopStub {
+        asmjit::Label label;
+        asmjit::Label resume;
+        MachineWord pc;
+        ExecutionError error;
+    };
+
+    // Fills in laneResults[lane] from the lane's state, once it's done
+    void recordResult(std::size_t lane);
+
+    // Everything resetLane() puts back but the lane's memory
+    void resetLaneState(std::size_t lane);
+
+    // Stores mark the chunks of lane memory they write to in the dirty map (see emitMarkDirty()), resetLane() only
+    // copies those back. dirtyIndex() is where a chunk of a lane's memory has its word in the map.
+    [[nodiscard]] std::size_t chunksPerLane() const;
+    [[nodiscard]] std::size_t dirtyIndex(std::size_t lane, std::size_t chunk) const;
+    void restoreChunk(std::size_t lane, std::size_t chunk);
+
+    // Copies guest addresses begin to end (begin a multiple of XLEN) of the image into a lane's memory
+    void copyFromImage(std::size_t lane, MachineWord begin, MachineWord end);
+
+    // Every lane's whole memory, with nothing dirty, for a backend whose lane memory is fresh
+    void copyInitialMemory();
+
+    // The lane memory and the dirty map after it
+    [[nodiscard]] std::size_t laneMemoryAllocationSize() const {
+        return laneLocalMemorySize + dirtyChunkCount * sizeof(std::uint32_t);
+    }
+
+    // Where the dirty map is in laneLocalMemory, for the generated code
+    [[nodiscard]] std::int32_t dirtyMap() const { return static_cast<std::int32_t>(laneLocalMemorySize); }
+
+    VectorRegisterAllocator registerAllocator();
+    VectorRegisterAllocator scalarRegisterAllocator();
+    void translate();
+    void createBlockLabels();
+
+    // The registers a block checks every lane agrees on when it starts, see emitGuard()
+    [[nodiscard]] GuestRegisterSet uniformInputs(std::size_t leader) const;
+    [[nodiscard]] bool isUniform(std::uint8_t guest) const { return guest == 0 || (uniform >> guest & 1); }
+    void emitGuard(std::size_t leader);
+    bool emitScalar(const MicroOp& op);
+    void endBlock();
+    void emitAddress(std::uint8_t base, MachineWord offset, MachineWord width, MachineWord pc);
+    void emitUniformAddress(MachineWord width, asmjit::Label divergent, bool uniformAddress);
+    void emitLoad(const MicroOp& op, MachineWord pc);
+    void emitStore(const MicroOp& op, MachineWord pc);
+    void emitMarkDirty();
+
+    // Where a byte of a lane's guest memory is in laneLocalMemory
+    [[nodiscard]] std::size_t hostOffset(std::size_t lane, MachineWord address) const;
+    asmjit::Label divergenceStub(MachineWord target, MachineWord fallthrough, bool split);
+    asmjit::Label stopStub(asmjit::Label resume, MachineWord pc, ExecutionError error);
+    void emitSystemCall(MachineWord pc);
+
+    // Called by the generated code for the lanes in mask, which are all at the ecall at pc. Sets their pc to where they
+    // go on, the next instruction or DONE_ADDRESS if they exited.
+    static void systemCall(VectorJITBackend* backend, std::uint32_t mask, MachineWord pc);
+
+    // One per basic block (and the sentinel), indexed by pc / 4
+    std::vector<asmjit::Label> labels;
+    std::vector<DivergenceStub> divergenceStubs;
+    std::vector<StopStub> stopStubs;
+    asmjit::Label scheduler;
+    asmjit::Label misdispatch;
+    asmjit::x86::Assembler assembler{};
+    VectorState<LANES> lanes{};
+    asmjit::Environment environment;
+    asmjit::CodeHolder code;
+    void emitInstruction(const MicroOp& op, std::size_t index);
+    std::vector<MicroOp> microOps;
+    std::vector<bool> isLeader;
+    LaneMemoryLayout layout;
+    VectorRegisterAllocator allocator;
+
+    // Guest registers every running lane agrees on go in general purpose registers instead. findVaryingRegisters()
+    // guesses which ones that might be, uniform is what the code being emitted can count on right now.
+    VectorRegisterAllocator scalars;
+    std::vector<GuestRegisterSet> varying;
+    GuestRegisterSet uniform{};
+    std::size_t scalarInstructions{};
+
+    std::shared_ptr<Translation> translation;
+
+    // Guest addresses are relative to memory, which is the program image and then the MEMORY_SIZE bytes
+    MachineWord memoryEnd;
+
+    // Every lane's memory, laid out according to layout, see the constructor. The dirty map comes right after it, in
+    // the same allocation, so the generated code gets at both through MEMORY_REGISTER.
+    std::size_t laneLocalMemorySize;
+    std::size_t dirtyChunkCount;
+    std::unique_ptr<std::uint8_t[]> ownedLaneMemory; // Unless it's an Arena's
+    std::uint8_t* laneLocalMemory;
+    std::uint32_t* dirtyChunks; // Nonzero for a chunk that's been written to since its lane was last reset
+
+    GuestSystem guestSystem;
+    std::uint64_t instructionLimit;
+    std::array<ExecutionResult, LANES> laneResults{};
+};
+
+extern template class VectorJITBackend<8>;
+extern template class VectorJITBackend<16>;
+
+using AVX2Backend   = VectorJITBackend<8>;
+using AVX512Backend = VectorJITBackend<16>;
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "backends/MicroOp.hpp"
+
+// Assigns guest registers to host vector registers for the vector JITs.
+//
+// Every guest register has a home slot in memory (VectorState::x for the vector JIT), which is where it lives
+// between basic blocks. Inside a block, guest registers are loaded into host registers on first use and stay there
+// until the block ends or the register is needed for something else. When nothing is free, the value whose next use
+// is furthest away is evicted (values that are dead by then are dropped for free). At the end of a block, dirty values
+// are written back, but only the ones some successor might read.
+//
+// The allocator doesn't know anything about the instruction set, it just tells the backend when to load and store
+// through the two callbacks. Physical registers are plain indices, zmm(i) or ymm(i). The vector JIT runs a second one
+// over general purpose registers for the values every lane agrees on, the two of them keep each other up to date
+// through holds() and discard().
+class VectorRegisterAllocator {
+public:
+    using Emitter = std::function<void(std::uint8_t physical, std::uint8_t guest)>;
+
+    // allocatable must not contain any of the backend's reserved scratch registers. zero is handed out for reads of
+    // x0, the backend has to keep it zeroed.
+    VectorRegisterAllocator(std::vector<std::uint8_t> allocatable, std::uint8_t zero, Emitter load, Emitter store);
+
+    // Liveness over the whole program. isLeader marks the first micro-op of every basic block (and the sentinel).
+    void analyze(const std::vector<MicroOp>& microOps, const std::vector<bool>& isLeader);
+
+    // Nothing is resident at the start of a block, everything is in its home slot
+    void beginBlock();
+
+    // Registers handed out for the current instruction can't be evicted until the next one starts
+    void beginInstruction(std::size_t index);
+
+    // A host register holding the guest register's value
+    std::uint8_t use(std::uint8_t guest);
+
+    // A host register the guest register's new value can be written to. The old value isn't loaded, so use() the
+    // sources first if they might be the same register.
+    std::uint8_t define(std::uint8_t guest);
+
+    // Whether the guest register's value is in a host register right now
+    [[nodiscard]] bool holds(std::uint8_t guest) const;
+
+    // Forgets the guest register's value without writing it back, for when its next value goes somewhere else
+    void discard(std::uint8_t guest);
+
+    // Writes back every dirty value that is live after the current instruction. Has to be called before anything
+    // leaves the block, registers stay as they are so the code after it can still read them.
+    void endBlock();
+
+    // How many values had to be evicted and written back in the middle of a block, for the translation log
+    [[nodiscard]] std::size_t spillCount() const { return spills; }
+
+private:
+    static constexpr std::uint8_t NONE = 0xff;
+
+    std::uint8_t allocate();
+    bool isLiveAfterCurrent(std::uint8_t guest) const;
+
+    std::vector<std::uint8_t> allocatable;
+    std::uint8_t zero;
+    Emitter load;
+    Emitter store;
+
+    const std::vector<MicroOp>* microOps{};
+    std::vector<bool> isLeader;
+
+    // Guest registers that may still be read after each micro-op
+    std::vector<GuestRegisterSet> liveAfter;
+
+    std::size_t current{};
+    std::array<std::uint8_t, 32> guestToPhysical{};
+    std::array<std::uint8_t, 32> physicalToGuest{};
+    GuestRegisterSet dirty{};
+    GuestRegisterSet pinned{};
+    std::size_t spills{};
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+#include "backends/Arena.hpp"
+#include "backends/ClassicalBackend.hpp"
+#include "campaign/WorkStealingDeque.hpp"
+#include "spdlog/spdlog.h"
+#include "strategies/MutationEngine.hpp"
+
+// What one worker thread got done during a campaign. Every thread bumps its own after each batch, a cache line each
+// keeps them from fighting over one.
+struct alignas(Arena::CACHE_LINE_SIZE) CampaignStatistics {
+    std::uint64_t batches{};
+    std::uint64_t executions{};
+    std::uint64_t instructions{};
+    std::uint64_t errors{}; // Executions that stopped with anything but ExecutionError::NONE
+    std::uint64_t steals{}; // Batches taken out of another worker's deque
+    std::uint64_t seeds{};  // Inputs the worker's MutationEngine was given, see BatchWorker
+
+    CampaignStatistics& operator+=(const CampaignStatistics& other);
+};
+
+// What a worker thread runs batches with: a backend of its own (or its own lanes of a shared translation) and whatever
+// it needs to come up with the inputs. Made on the thread that uses it, with that thread's Arena for anything its
+// instances own.
+class CampaignWorker {
+public:
+    virtual ~CampaignWorker() = default;
+
+    // batch is a number unique to the batch over the whole campaign
+    virtual void runBatch(std::uint64_t batch, CampaignStatistics& statistics) = 0;
+};
+
+// Runs one batch per run() of a backend that has lanes (LockstepBackend, VectorJITBackend). A batch is RUNS_PER_LANE
+// inputs per lane, as long as initialInput each, at inputAddress (and as stdin), from the worker's MutationEngine, made
+// for the whole batch at once. They only depend on the batch number and the seeds the worker has found so far.
+//
+// The lanes start on the first ones, and whenever a lane is done, the backend hands it back mid-run to start over on
+// the next input that's left. A batch is then only as slow as its slowest lane once at the end, not once per round of
+// inputs, and lanes that are done in a few instructions (an input rejected on its first byte) don't sit masked off
+// waiting for the one that runs into the instruction limit.
+//
+// The first seed is initialInput, before the first batch. After that, an input that ends in a way none before it did (a
+// return value or error the worker hasn't seen yet) becomes one. Every seed is run once more on the CmpLog
+// interpreter: what inputToState() makes of the comparisons it logged becomes seeds too, up to MAX_SEEDS, and the
+// values they compared against dictionary tokens, up to MAX_TOKENS.
+//
+// The backends and the inputs are in the thread's Arena, which outlives the worker.
+template <typename Backend>
+class BatchWorker : public CampaignWorker {
+public:
+    static constexpr std::size_t RUNS_PER_LANE = 8;
+
+    // Once the engine has this many, nothing else is looked at
+    static constexpr std::size_t MAX_SEEDS = 1024;
+
+    // Most input-to-state candidates taken from one CmpLog run
+    static constexpr std::size_t MAX_CANDIDATES = 16;
+
+    // Dictionary tokens, from every CmpLog run together
+    static constexpr std::size_t MAX_TOKENS = 256;
+
+    BatchWorker(Arena& arena, Arena::Pointer<Backend> backend, Arena::Pointer<ClassicalBackend<CmpLogPolicy>> cmplog,
+                const MachineWord inputAddress, const std::span<const std::uint8_t> initialInput)
+        : backend(std::move(backend)), cmplog(std::move(cmplog)), inputAddress(inputAddress),
+          engine(initialInput.size()), initialInput(initialInput),
+          inputCount(this->backend->results().size() * RUNS_PER_LANE),
+          inputs(static_cast<std::uint8_t*>(arena.allocate(inputCount * initialInput.size()))),
+          running(this->backend->results().size()) {}
+
+    void runBatch(const std::uint64_t batch, CampaignStatistics& statistics) override {
+        const auto lanes  = backend->results().size();
+        const auto before = engine.seedCount();
+        if (before == 0) {
+            learn(initialInput.data());
+        }
+
+        backend->reset();
+        engine.mutateBatch(batch, inputs, inputCount);
+        for (std::size_t lane = 0; lane < lanes; lane++) {
+            load(lane, lane);
+        }
+
+        auto next = lanes;
+        found.clear();
+        backend->run([&](const std::size_t lane, const ExecutionResult& result) {
+            statistics.executions++;
+            statistics.instructions += result.instructionCount;
+            statistics.errors += result.error != ExecutionError::NONE;
+            if (engine.seedCount() < MAX_SEEDS && seen.insert(outcome(result)).second) {
+                found.push_back(running[lane]);
+            }
+            if (next == inputCount) {
+                return false;
+            }
+            backend->resetLane(lane);
+            load(lane, next++);
+            return true;
+        });
+
+        for (const auto index : found) {
+            learn(inputs + index * engine.inputSize());
+        }
+        statistics.seeds += engine.seedCount() - before;
+        statistics.batches++;
+    }
+
+private:
+    // How a run ended, the error above the return value
+    static std::uint64_t outcome(const ExecutionResult& result) {
+        return static_cast<std::uint64_t>(result.error) << 32 | static_cast<std::uint32_t>(result.returnValue);
+    }
+
+    // Puts the batch's input number index into lane, which has to be reset already
+    void load(const std::size_t lane, const std::size_t index) {
+        const auto size  = engine.inputSize();
+        const auto input = inputs + index * size;
+        if (!backend->writeInput(lane, inputAddress, input, size)) {
+            spdlog::error("An input of {} bytes at {:#x} doesn't fit in guest memory.", size, inputAddress);
+            exit(EXIT_FAILURE);
+        }
+        backend->guest()[lane].input = std::span(input, size);
+        running[lane]                = index;
+    }
+
+    // Makes input a seed, and then the input-to-state candidates and the tokens of a CmpLog run of it
+    void learn(const std::uint8_t* input) {
+        const auto bytes = std::span(input, engine.inputSize());
+        if (engine.seedCount() >= MAX_SEEDS) {
+            return;
+        }
+        engine.addSeed(input);
+
+        cmplog->reset();
+        cmplog->guestMemory().write(inputAddress, bytes.data(), bytes.size());
+        cmplog->guest()[0].input = bytes;
+        cmplog->run();
+        seen.insert(outcome(cmplog->lastResult()));
+        if (engine.tokenCount() < MAX_TOKENS) {
+            for (const auto& token : comparisonTokens(bytes, cmplog->comparisons(), MAX_TOKENS - engine.tokenCount())) {
+                engine.addToken(token);
+            }
+        }
+        for (const auto& candidate : inputToState(bytes, cmplog->comparisons(), MAX_CANDIDATES)) {
+            if (engine.seedCount() >= MAX_SEEDS) {
+                return;
+            }
+            engine.addSeed(candidate.data());
+        }
+    }
+
+    Arena::Pointer<Backend> backend;
+    Arena::Pointer<ClassicalBackend<CmpLogPolicy>> cmplog;
+    MachineWord inputAddress;
+    MutationEngine engine;
+    std::span<const std::uint8_t> initialInput;
+
+    // The batch's inputs, one after the other
+    std::size_t inputCount;
+    std::uint8_t* inputs;
+
+    // Which of them every lane is on, and the ones that turned out to be new
+    std::vector<std::size_t> running;
+    std::vector<std::size_t> found;
+
+    // How every run so far ended, see outcome()
+    std::unordered_set<std::uint64_t> seen;
+};
+
+// Spreads a campaign over a pool of threads, one CampaignWorker each.
+//
+// Batches are handed out a few at a time from a shared counter, into the work-stealing deque of whichever thread asked.
+// Threads work through their own deque first, and once there's nothing left to hand out they steal from the others,
+// so a thread stuck on a slow batch (long-running inputs, lanes diverging all over the place) doesn't hold up the end
+// of the campaign while the rest sit idle.
+//
+// Every thread is pinned to a CPU of its own (as far as there are enough), so the memory in its Arena stays on its
+// NUMA node, and the pages it touches over and over stay in that CPU's TLB.
+class Campaign {
+public:
+    using WorkerFactory = std::function<std::unique_ptr<CampaignWorker>(std::size_t thread, Arena& arena)>;
+
+    // threads == 0 means one per hardware thread. makeWorker is called once per thread per run(), on that thread, with
+    // an Arena of that thread's that lives as long as the worker.
+    Campaign(std::size_t threads, WorkerFactory makeWorker);
+
+    // Runs batches 0 to batchCount - 1 and returns once they're all done, with what every thread did
+    std::vector<CampaignStatistics> run(std::uint64_t batchCount);
+
+    [[nodiscard]] std::size_t threadCount() const { return threads; }
+
+private:
+    // How many batches a thread takes off the shared counter at once
+    static constexpr std::uint64_t CHUNK_SIZE = 4;
+
+    void work(std::size_t thread, CampaignStatistics& statistics);
+
+    std::size_t threads;
+    WorkerFactory makeWorker;
+
+    std::uint64_t batchCount{};
+    alignas(64) std::atomic<std::uint64_t> nextBatch{};
+    std::vector<std::unique_ptr<WorkStealingDeque<std::uint64_t>>> deques;
+};
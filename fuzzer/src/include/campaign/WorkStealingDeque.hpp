@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+// A fixed-size Chase-Lev deque (with the memory orderings from Lê et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models"). The thread that owns it pushes and pops at the bottom, any other thread can steal from the
+// top. Nobody ever waits on a lock, the only contention is a compare-and-swap when the owner and a thief go for the
+// last item (or two thieves for the same one).
+//
+// T has to fit in a lock-free atomic, Campaign only ever puts batch numbers in here.
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable_v<T> && std::atomic<T>::is_always_lock_free);
+
+public:
+    // Rounded up to a power of two
+    explicit WorkStealingDeque(const std::size_t capacity)
+        : mask(std::bit_ceil(capacity) - 1), items(std::make_unique<std::atomic<T>[]>(mask + 1)) {}
+
+    // Owner only. Returns false if the deque is full.
+    bool push(const T item) {
+        const auto b = bottom.load(std::memory_order_relaxed);
+        const auto t = top.load(std::memory_order_acquire);
+        if (b - t > static_cast<std::int64_t>(mask)) {
+            return false;
+        }
+        items[b & mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Owner only, takes the item that was pushed last
+    std::optional<T> pop() {
+        const auto b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // Was empty already
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        const auto item = items[b & mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            // The last one, a thief might be after it too
+            const auto won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                         std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won ? std::optional<T>{item} : std::nullopt;
+        }
+        return item;
+    }
+
+    // Any thread, takes the item that was pushed first. Can come back empty-handed while there's still something left
+    // if another thread got to it first.
+    std::optional<T> steal() {
+        auto t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const auto b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return std::nullopt;
+        }
+
+        const auto item = items[t & mask].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        return item;
+    }
+
+private:
+    // On their own cache lines, thieves hammer top while the owner works the bottom
+    alignas(64) std::atomic<std::int64_t> top{0};
+    alignas(64) std::atomic<std::int64_t> bottom{0};
+
+    std::size_t mask;
+    std::unique_ptr<std::atomic<T>[]> items;
+};
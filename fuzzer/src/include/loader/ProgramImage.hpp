@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+
+// A subject program, mapped read-only straight from its file and shared by everything made from it. Either a RISC-V
+// ELF32 executable, whose PT_LOAD segments (text, rodata, data, bss) are laid out from the lowest address one of them
+// is loaded at, or a flat image out of subjects/makebinfile.sh, which is the program image as it is. The backends put
+// the image at guest address 0, so whatever the program addresses relative to pc works out, and absolute addresses do
+// too if it was linked to load at 0.
+class ProgramImage {
+public:
+    // nullptr (having logged why) if path can't be mapped, is an ELF for some other machine or one whose entry point
+    // isn't in what it loads, or doesn't fit in the guest's address space
+    static std::unique_ptr<ProgramImage> open(const std::string& path);
+
+    ~ProgramImage();
+    ProgramImage(const ProgramImage&)            = delete;
+    ProgramImage& operator=(const ProgramImage&) = delete;
+
+    // Bytes from guest address 0 to the end of the last thing loaded
+    [[nodiscard]] std::size_t size() const { return loadedSize; }
+
+    // Writes the size() bytes of the image (file contents where there are any, zeros everywhere else) to out
+    void copyTo(std::uint8_t* out) const;
+
+    // Where the ELF says to start. For flat images, whatever the .entry file next to it says (main.entry for main.bin),
+    // 0 without one.
+    [[nodiscard]] MachineWord entry() const { return entryPoint; }
+
+    // Guest address of a symbol in the ELF's symbol table, if it's got one by that name. One outside of the image is an
+    // error (logged), and isn't there either.
+    [[nodiscard]] std::optional<MachineWord> symbol(std::string_view name) const;
+
+private:
+    // Something an ELF loads. data is what comes from the file, the rest of the size bytes are zeros (.bss).
+    struct Segment {
+        MachineWord address; // In the program image
+        std::size_t size;
+        std::span<const std::uint8_t> data;
+    };
+
+    ProgramImage(const std::uint8_t* mapping, std::size_t mappingSize);
+
+    // false (having logged why) if the ELF can't be run
+    bool loadElf();
+    // Takes the entry point of a flat image from the .entry file next to path, if there's one
+    void loadEntryFile(const std::string& path);
+
+    const std::uint8_t* mapping;
+    std::size_t mappingSize;
+    MachineWord base{}; // ELF address of guest address 0
+    MachineWord entryPoint{};
+    std::size_t loadedSize{};
+    std::vector<Segment> segments; // Empty for flat images
+};
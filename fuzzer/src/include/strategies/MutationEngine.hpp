@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "backends/AbstractMachineBackend.hpp"
+
+// xoshiro256**, WIDTH generators side by side. The state is laid out like LockstepState (generator i is element i of
+// every array) so next() is a loop the compiler turns into a few vector instructions, WIDTH numbers at a time.
+class LaneRandom {
+public:
+    // Eight 64-bit generators fill an AVX-512 register, two AVX2 ones
+    static constexpr std::size_t WIDTH = 8;
+
+    // Every generator gets its own stream, from splitmix64 over seed
+    void seed(std::uint64_t seed);
+
+    // The next number of every generator
+    std::array<std::uint64_t, WIDTH> next();
+
+private:
+    alignas(64) std::array<std::uint64_t, WIDTH> s0{};
+    alignas(64) std::array<std::uint64_t, WIDTH> s1{};
+    alignas(64) std::array<std::uint64_t, WIDTH> s2{};
+    alignas(64) std::array<std::uint64_t, WIDTH> s3{};
+};
+
+// Comes up with batches of inputs for the campaign workers, AFL havoc style: every input is a seed with a stack of
+// mutations on top (bit and byte flips, small additions, interesting values, blocks deleted, inserted or overwritten,
+// splices with other seeds and dictionary tokens). Until it has any seeds, inputs are random bytes.
+//
+// Inputs are all inputSize bytes, the size of the slot they go in in guest memory. Insertions push the end of the input
+// out of the slot and deletions fill it up with zeros.
+//
+// Not thread-safe, every worker keeps one of its own. The random numbers are drawn WIDTH inputs at a time and only
+// depend on the seed, the batch number and what was added, so a batch comes out the same no matter which worker runs
+// it.
+class MutationEngine {
+public:
+    explicit MutationEngine(std::size_t inputSize, std::uint64_t seed = 0);
+
+    // Inputs from now on can be made from data, which is inputSize bytes
+    void addSeed(const std::uint8_t* data);
+
+    // Something the program looks for (a magic number, a keyword), the token mutations put it somewhere in the input.
+    // Tokens longer than the input are cut short, ones it has already are left out.
+    void addToken(std::span<const std::uint8_t> token);
+
+    // Writes count inputs, one after the other, to inputs (which has room for count * inputSize() bytes)
+    void mutateBatch(std::uint64_t batch, std::uint8_t* inputs, std::size_t count);
+
+    [[nodiscard]] std::size_t inputSize() const { return size; }
+    [[nodiscard]] std::size_t seedCount() const { return seeds.size() / size; }
+    [[nodiscard]] std::size_t tokenCount() const { return tokens.size(); }
+
+private:
+    // Most mutations a single input gets
+    static constexpr std::size_t MAX_STACK = 16;
+
+    void mutate(std::size_t kind, std::uint8_t* input, std::uint64_t what, std::uint64_t value) const;
+    [[nodiscard]] const std::uint8_t* seedData(std::size_t seed) const { return seeds.data() + seed * size; }
+
+    std::size_t size;
+    std::uint64_t rootSeed;
+    LaneRandom random;
+
+    // seedCount() seeds of inputSize bytes, one after the other
+    std::vector<std::uint8_t> seeds;
+    std::vector<std::vector<std::uint8_t>> tokens;
+};
+
+// Input-to-state replacement, AFL++'s CmpLog stage (after Redqueen). Magic values are mostly checked by comparing bytes
+// straight out of the input against constants, so wherever input holds one side of a comparison the program made
+// running it (see CmpLogPolicy) a copy with the other side there instead is a good bet to get one check further. Sides
+// are looked for as bytes or little-endian 16 or 32-bit words, whichever is the smallest both of them fit in. Gives at
+// most maxCandidates inputs, no two the same.
+std::vector<std::vector<std::uint8_t>> inputToState(std::span<const std::uint8_t> input,
+                                                    std::span<const ComparisonRecord> comparisons,
+                                                    std::size_t maxCandidates);
+
+// The other sides of the same comparisons, the values the program looked for, as dictionary tokens for
+// MutationEngine::addToken(). They're worth trying anywhere in the input, not just where inputToState() puts them.
+// Gives at most maxTokens, no two the same.
+std::vector<std::vector<std::uint8_t>> comparisonTokens(std::span<const std::uint8_t> input,
+                                                        std::span<const ComparisonRecord> comparisons,
+                                                        std::size_t maxTokens);
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "loader/ProgramImage.hpp"
+#include "spdlog/spdlog.h"
+
+std::unique_ptr<ProgramImage> ProgramImage::open(const std::string& path) {
+    const int file = ::open(path.c_str(), O_RDONLY);
+    struct stat status {};
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0) {
+        spdlog::error("Couldn't open program file \"{}\".", path);
+        if (file >= 0) {
+            close(file);
+        }
+        return nullptr;
+    }
+    const auto size = static_cast<std::size_t>(status.st_size);
+    void* mapping   = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) {
+        spdlog::error("Couldn't map program file \"{}\".", path);
+        return nullptr;
+    }
+
+    // The constructor is private, so no make_unique
+    auto image = std::unique_ptr<ProgramImage>(new ProgramImage(static_cast<const std::uint8_t*>(mapping), size));
+    if (size >= SELFMAG && std::memcmp(mapping, ELFMAG, SELFMAG) == 0) {
+        if (!image->loadElf()) {
+            return nullptr;
+        }
+    } else {
+        image->loadEntryFile(path);
+    }
+
+    // The backends put MEMORY_SIZE bytes after it, and the interpreters and the scalar JIT a stack at the top
+    if (image->loadedSize > GUEST_ADDRESS_SPACE - GUEST_STACK_SIZE - MEMORY_SIZE) {
+        spdlog::error("\"{}\" loads {} bytes, more than fit in the guest's {} byte address space.", path,
+                      image->loadedSize, GUEST_ADDRESS_SPACE);
+        return nullptr;
+    }
+    return image;
+}
+
+ProgramImage::ProgramImage(const std::uint8_t* mapping, const std::size_t mappingSize)
+    : mapping(mapping), mappingSize(mappingSize), loadedSize(mappingSize) {}
+
+ProgramImage::~ProgramImage() { munmap(const_cast<std::uint8_t*>(mapping), mappingSize); }
+
+bool ProgramImage::loadElf() {
+    const auto* header = reinterpret_cast<const Elf32_Ehdr*>(mapping);
+    if (mappingSize < sizeof(Elf32_Ehdr) || header->e_ident[EI_CLASS] != ELFCLASS32 ||
+        header->e_ident[EI_DATA] != ELFDATA2LSB || header->e_machine != EM_RISCV ||
+        header->e_phentsize != sizeof(Elf32_Phdr) ||
+        header->e_phoff + std::uint64_t{header->e_phnum} * sizeof(Elf32_Phdr) > mappingSize) {
+        spdlog::error("Only little-endian 32-bit RISC-V ELF files can be run.");
+        return false;
+    }
+
+    const auto* programHeaders = reinterpret_cast<const Elf32_Phdr*>(mapping + header->e_phoff);
+    const std::span loads(programHeaders, header->e_phnum);
+    std::uint64_t lowest  = UINT32_MAX;
+    std::uint64_t highest = 0;
+    for (const auto& load : loads) {
+        if (load.p_type != PT_LOAD) {
+            continue;
+        }
+        if (load.p_offset + std::uint64_t{load.p_filesz} > mappingSize || load.p_filesz > load.p_memsz) {
+            spdlog::error("A segment of the ELF file is cut short.");
+            return false;
+        }
+        lowest  = std::min<std::uint64_t>(lowest, load.p_vaddr);
+        highest = std::max<std::uint64_t>(highest, load.p_vaddr + std::uint64_t{load.p_memsz});
+    }
+    if (highest == 0) {
+        spdlog::error("The ELF file doesn't load anything.");
+        return false;
+    }
+
+    base       = static_cast<MachineWord>(lowest);
+    entryPoint = header->e_entry - base;
+    loadedSize = (highest - lowest + XLEN - 1) / XLEN * XLEN;
+    if (entryPoint >= loadedSize || entryPoint % XLEN != 0) {
+        spdlog::error("The ELF file's entry point {:#x} isn't an instruction of anything it loads.", header->e_entry);
+        return false;
+    }
+    for (const auto& load : loads) {
+        if (load.p_type == PT_LOAD) {
+            segments.push_back(
+                    Segment{load.p_vaddr - base, load.p_memsz, std::span(mapping + load.p_offset, load.p_filesz)});
+        }
+    }
+    return true;
+}
+
+void ProgramImage::loadEntryFile(const std::string& path) {
+    // makebinfile.sh writes main's offset in hex next to main.bin, as main.entry
+    std::ifstream file(std::filesystem::path(path).replace_extension(".entry"));
+    MachineWord offset = 0;
+    if (!file || !(file >> std::hex >> offset)) {
+        return;
+    }
+    if (offset >= mappingSize || offset % XLEN != 0) {
+        spdlog::warn("Ignoring the entry point {:#x} next to \"{}\", it's not an instruction of it.", offset, path);
+        return;
+    }
+    entryPoint = offset;
+}
+
+void ProgramImage::copyTo(std::uint8_t* out) const {
+    if (segments.empty()) {
+        std::memcpy(out, mapping, mappingSize);
+        return;
+    }
+    std::memset(out, 0, loadedSize);
+    for (const auto& segment : segments) {
+        std::memcpy(out + segment.address, segment.data.data(), segment.data.size());
+    }
+}
+
+std::optional<MachineWord> ProgramImage::symbol(const std::string_view name) const {
+    if (segments.empty()) {
+        return std::nullopt;
+    }
+    const auto* header = reinterpret_cast<const Elf32_Ehdr*>(mapping);
+    if (header->e_shentsize != sizeof(Elf32_Shdr) ||
+        header->e_shoff + std::uint64_t{header->e_shnum} * sizeof(Elf32_Shdr) > mappingSize) {
+        return std::nullopt;
+    }
+
+    const std::span sections(reinterpret_cast<const Elf32_Shdr*>(mapping + header->e_shoff), header->e_shnum);
+    for (const auto& table : sections) {
+        if (table.sh_type != SHT_SYMTAB || table.sh_link >= sections.size() ||
+            table.sh_offset + std::uint64_t{table.sh_size} > mappingSize) {
+            continue;
+        }
+        const auto& strings = sections[table.sh_link];
+        if (strings.sh_offset + std::uint64_t{strings.sh_size} > mappingSize) {
+            continue;
+        }
+        const std::string_view names(reinterpret_cast<const char*>(mapping + strings.sh_offset), strings.sh_size);
+        const std::span symbols(reinterpret_cast<const Elf32_Sym*>(mapping + table.sh_offset),
+                                table.sh_size / sizeof(Elf32_Sym));
+        for (const auto& symbol : symbols) {
+            if (symbol.st_shndx == SHN_UNDEF || symbol.st_name >= names.size()) {
+                continue;
+            }
+            const auto candidate = names.substr(symbol.st_name);
+            if (candidate.substr(0, candidate.find('\0')) != name) {
+                continue;
+            }
+            if (symbol.st_value - base >= loadedSize) {
+                spdlog::error("Symbol \"{}\" is at {:#x}, outside of anything the ELF file loads.", name,
+                              symbol.st_value);
+                return std::nullopt;
+            }
+            return symbol.st_value - base;
+        }
+    }
+    return std::nullopt;
+}
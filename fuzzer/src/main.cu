@@ -1,55 +1,229 @@
+#include <array>
+#include <chrono>
 #include <iostream>
 
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
-#include "backends/AVX512Backend.hpp"
 #include "backends/AbstractMachineBackend.hpp"
 #include "backends/ClassicalBackend.hpp"
+#include "backends/LockstepBackend.hpp"
+#include "backends/PagedMemory.hpp"
+#include "backends/ScalarJITBackend.hpp"
+#include "backends/VectorJITBackend.hpp"
+#include "campaign/Campaign.hpp"
+#include "loader/ProgramImage.hpp"
+
+// Campaigns put inputs of this many bytes at the start of the MEMORY_SIZE bytes after the program image, out of the
+// stack's way
+constexpr std::size_t CAMPAIGN_INPUT_SIZE = 16;
+
+// What's there when the program image is loaded, and so the input of the run before a campaign. Every worker's first
+// seed.
+constexpr std::array<std::uint8_t, CAMPAIGN_INPUT_SIZE> CAMPAIGN_INITIAL_INPUT{};
+
+// Runs batch (which does executions runs of the program) the given number of times and prints how fast that went
+template <typename Batch>
+void benchmark(const std::size_t batches, const std::size_t executions, Batch batch) {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < batches; i++) {
+        batch();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%zu executions in %.3f s, %.0f execs/sec\n", batches * executions, elapsed.count(),
+           static_cast<double>(batches * executions) / elapsed.count());
+}
+
+// Same, but spread over every thread of the campaign
+void benchmark(Campaign& campaign, const std::size_t batches) {
+    const auto start      = std::chrono::steady_clock::now();
+    const auto statistics = campaign.run(batches);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    CampaignStatistics total;
+    for (const auto& thread : statistics) {
+        total += thread;
+    }
+    printf("%lu executions in %.3f s on %zu threads, %.0f execs/sec (%lu errors, %lu batches stolen, %lu seeds)\n",
+           total.executions, elapsed.count(), campaign.threadCount(),
+           static_cast<double>(total.executions) / elapsed.count(), total.errors, total.steals, total.seeds);
+}
+
+// Runs a backend with lanes once and prints what every lane wrote and how it did, then times it by itself or as a
+// campaign over the given number of threads. copy makes the backend for each of those threads, in its Arena, and
+// cmplog the interpreter their inputs get another run on when they turn up something new.
+template <typename Backend, typename CmpLog, typename Copy>
+void runLanes(Backend& backend, const std::size_t batches, const bool campaign, const std::size_t threads,
+              const MachineWord inputAddress, CmpLog cmplog, Copy copy) {
+    backend.run();
+    for (std::size_t lane = 0; lane < backend.results().size(); lane++) {
+        const auto& result = backend.results()[lane];
+        backend.guest()[lane].flush(stdout);
+        printf("returned %d, error %d after %lu instructions\n", result.returnValue, static_cast<int>(result.error),
+               result.instructionCount);
+    }
+    if (campaign) {
+        auto pool = Campaign(threads, [&](std::size_t, Arena& arena) {
+            return std::make_unique<BatchWorker<Backend>>(arena, copy(arena), cmplog(arena), inputAddress,
+                                                          CAMPAIGN_INITIAL_INPUT);
+        });
+        benchmark(pool, batches);
+    } else if (batches != 0) {
+        benchmark(batches, backend.results().size(), [&] {
+            backend.reset();
+            backend.run();
+        });
+    }
+}
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        printf("Pass one argument, the filename.\n");
+    if (argc < 2 || argc > 5) {
+        printf("Usage: %s <program[:entry symbol]> "
+               "[vector|avx512|avx2[-interleaved]|interpreter|interpreter-debug|lockstep|jit] [batches to time] "
+               "[threads, 0 for all]\n",
+               argv[0]);
         return 1;
     }
 
-    FILE* programFile = fopen(argv[1], "rb");
-    if (!programFile) {
-        printf("Couldn't open program file \"%s\".\n", argv[1]);
-        return 1;
+    // vector picks the widest vector JIT this CPU can run (lockstep, which has no say in the layout, if there's none)
+    std::string_view backendName = argc >= 3 ? argv[2] : "vector";
+    const std::size_t batches    = argc >= 4 ? strtoull(argv[3], nullptr, 10) : 0;
+
+    // The vector JITs can lay lane memory out interleaved instead, e.g. avx512-interleaved
+    auto layout = LaneMemoryLayout::CONTIGUOUS;
+    if (backendName.ends_with("-interleaved")) {
+        backendName.remove_suffix(std::string_view("-interleaved").size());
+        if (backendName != "vector" && backendName != "avx512" && backendName != "avx2") {
+            printf("Only the vector backends can interleave lane memory.\n");
+            return 1;
+        }
+        layout = LaneMemoryLayout::INTERLEAVED;
     }
-    fseek(programFile, 0L, SEEK_END); // Technically it wants a long... but
-    // The program file cannot possibly be more than can fit in a 32 because it's 32 bit lol
-    const auto programSize = ftell(programFile);
-    rewind(programFile);
 
-    uint8_t* memory  = nullptr;
-    uint8_t* program = nullptr;
+    // Only the backends that run batches of lanes (lockstep and the vector JITs) can run as a campaign
+    const auto campaign       = argc == 5;
+    const std::size_t threads = campaign ? strtoull(argv[4], nullptr, 10) : 0;
+    if (backendName != "vector" && backendName != "avx512" && backendName != "avx2" && backendName != "interpreter" &&
+        backendName != "interpreter-debug" && backendName != "lockstep" && backendName != "jit") {
+        printf("Unknown backend \"%s\".\n", argv[2]);
+        return 1;
+    }
+    if (backendName == "vector") {
+        backendName = AVX512Backend::hostSupports() ? "avx512" : AVX2Backend::hostSupports() ? "avx2" : "lockstep";
+    } else if ((backendName == "avx512" && !AVX512Backend::hostSupports()) ||
+               (backendName == "avx2" && !AVX2Backend::hostSupports())) {
+        printf("This CPU can't run the %s backend.\n", argv[2]);
+        return 1;
+    }
 
-    memory = static_cast<uint8_t*>(malloc(MEMORY_SIZE + programSize));
-    if (!memory) {
-        printf("Failed to allocate memory for the emulator.\n");
+    // ELF files start at main (or the symbol after the colon, e.g. main.ln:compare) if they have one and wherever their
+    // header says otherwise, flat images wherever their .entry file says
+    std::string path(argv[1]);
+    std::string entryName = "main";
+    const auto colon      = path.rfind(':');
+    if (colon != std::string::npos) {
+        entryName = path.substr(colon + 1);
+        path.resize(colon);
+    }
+    const auto image = ProgramImage::open(path);
+    if (!image) {
         return 1;
     }
-    program = memory + MEMORY_SIZE;
-    fread(program, sizeof(uint8_t), programSize, programFile);
+    const auto entry = image->symbol(entryName);
+    if (!entry && colon != std::string::npos) {
+        printf("No symbol \"%s\" in \"%s\".\n", entryName.c_str(), path.c_str());
+        return 1;
+    }
+    // The program file cannot possibly be more than can fit in a 32 because it's 32 bit lol
+    const auto programSize = image->size();
+
+    // The image goes at guest address 0, so whatever it addresses relative to pc or absolutely (if it was linked to
+    // load at 0) is where it expects it to be. The MEMORY_SIZE bytes after it are the vector JITs' stack. Every backend
+    // (and every campaign thread's) starts from this one copy.
+    const auto memory = std::make_shared<const PageImage>(MEMORY_SIZE + programSize,
+                                                          [&](std::uint8_t* out) { image->copyTo(out); });
 
     auto state = State();
+    state.pc   = entry.value_or(image->entry());
     // We initalize a fake return address so that we can tell when we're done lol
     state.x[1] = DONE_ADDRESS;
-    // We set the stack pointer to 0 cuz, uh, sure
-    state.x[2] = MEMORY_SIZE - 4;
+    // The stack goes at the end of the memory after the program image. The interpreters and the scalar JIT have a whole
+    // address space, so their stack goes at the top of it.
+    state.x[2] = programSize + MEMORY_SIZE - 4;
+    if (backendName == "interpreter" || backendName == "interpreter-debug" || backendName == "lockstep" ||
+        backendName == "jit") {
+        state.x[2] = GUEST_ADDRESS_SPACE - 16;
+    }
 
-    // auto backend = ClassicalBackend(memory, state, programSize);
-    // auto backend = ClassicalBackend(memory, state, programSize);
-    // backend.run();
+    // What campaign workers run the inputs that turn up something new on again, to log what they're compared against
+    auto cmplogState = state;
+    cmplogState.x[2] = GUEST_ADDRESS_SPACE - 16;
+    const auto cmplog = [&](Arena& arena) {
+        return arena.create<ClassicalBackend<CmpLogPolicy>>(memory, cmplogState, programSize);
+    };
 
-    auto backend = AVX512Backend(memory, state, programSize);
-    backend.run();
+    if (backendName == "interpreter") {
+        // memory is only the image the guest's pages start out as, nothing writes to it
+        auto backend = ClassicalBackend<ProductionPolicy>(memory, state, programSize);
+        backend.run();
+        backend.guest()[0].flush(stdout);
+        const auto& result = backend.lastResult();
+        printf("returned %d, error %d after %lu instructions\n", result.returnValue, static_cast<int>(result.error),
+               result.instructionCount);
+
+        if (batches != 0) {
+            benchmark(batches, 1, [&] {
+                backend.reset();
+                backend.run();
+            });
+        }
+    } else if (backendName == "interpreter-debug") {
+        // Traces every instruction and dumps memory at the end
+        auto backend = ClassicalBackend<DebugPolicy>(memory, state, programSize);
+        backend.run();
+        backend.guest()[0].flush(stdout);
+        const auto& result = backend.lastResult();
+        printf("returned %d, error %d after %lu instructions\n", result.returnValue, static_cast<int>(result.error),
+               result.instructionCount);
+    } else if (backendName == "lockstep") {
+        // For the machines without AVX2, eight lanes is what the compiler can vectorize best
+        auto backend = LockstepBackend<8>(memory, state, programSize);
+        runLanes(backend, batches, campaign, threads, programSize, cmplog, [&](Arena& arena) {
+            // Every thread gets a backend of its own
+            return arena.create<LockstepBackend<8>>(memory, state, programSize, DEFAULT_INSTRUCTION_LIMIT, &arena);
+        });
+    } else if (backendName == "jit") {
+        auto backend = ScalarJITBackend(memory, state, programSize);
+        backend.run();
+        backend.guest()[0].flush(stdout);
+        const auto& result = backend.lastResult();
+        printf("returned %d, error %d after %lu instructions\n", result.returnValue, static_cast<int>(result.error),
+               result.instructionCount);
 
-    free(memory);
+        if (batches != 0) {
+            benchmark(batches, 1, [&] {
+                backend.reset();
+                backend.run();
+            });
+        }
+    } else if (backendName == "avx2") {
+        // Eight instances per run(), a whole batch of inputs would go in through writeInput() after each reset().
+        // Every campaign thread runs the code translated here, with lanes of its own.
+        auto backend = AVX2Backend(memory, state, programSize, DEFAULT_INSTRUCTION_LIMIT, layout);
+        runLanes(backend, batches, campaign, threads, programSize, cmplog,
+                 [&](Arena& arena) { return arena.create<AVX2Backend>(backend, arena); });
+    } else {
+        // Same with sixteen
+        auto backend = AVX512Backend(memory, state, programSize, DEFAULT_INSTRUCTION_LIMIT, layout);
+        runLanes(backend, batches, campaign, threads, programSize, cmplog,
+                 [&](Arena& arena) { return arena.create<AVX512Backend>(backend, arena); });
+    }
 
     return 0;
 }
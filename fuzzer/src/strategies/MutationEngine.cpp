@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "strategies/MutationEngine.hpp"
+
+namespace {
+    enum class Mutation : std::uint8_t {
+        FLIP_BIT,
+        FLIP_BYTE,
+        RANDOM_BYTE, // xor with anything but 0, so it's never a no-op
+        ADD_8,
+        ADD_16,
+        ADD_32,
+        INTERESTING_8,
+        INTERESTING_16,
+        INTERESTING_32,
+        DELETE_BLOCK,
+        INSERT_BLOCK,
+        OVERWRITE_BLOCK,
+        SPLICE,
+        // Only picked if there's a dictionary, keep these last
+        TOKEN_OVERWRITE,
+        TOKEN_INSERT,
+        COUNT,
+    };
+
+    // AFL's, the values just past or right at the edges programs tend to check for
+    constexpr std::int32_t INTERESTING_8[]  = {-128, -1, 0, 1, 16, 32, 64, 100, 127};
+    constexpr std::int32_t INTERESTING_16[] = {-32768, -129, 128, 255, 256, 512, 1000, 1024, 4096, 32767};
+    constexpr std::int32_t INTERESTING_32[] = {INT32_MIN, -100663046, -32769,    32768,
+                                               65535,     65536,      100663045, INT32_MAX};
+
+    // Biggest amount ADD_* adds or subtracts, AFL's too
+    constexpr std::uint32_t ARITHMETIC_MAX = 35;
+
+    // Pulls a number below n out of the low 16 bits of a random word and shifts them out, so a word is good for four
+    // fields. A multiply rather than a modulo, which is a division and slower than the rest of a mutation put together
+    // (and n above 65536 just leaves gaps).
+    std::size_t take(std::uint64_t& bits, const std::size_t n) {
+        const auto field = ((bits & 0xffff) * n) >> 16;
+        bits >>= 16;
+        return field;
+    }
+
+    // Blocks are mostly short, now and then a longer one. room is at least 1.
+    std::size_t blockLength(std::uint64_t& bits, const std::size_t room) {
+        const std::size_t limit = take(bits, 4) != 0 ? 16 : 128;
+        return 1 + take(bits, std::min(room, limit));
+    }
+
+    // width (1, 2 or 4) bytes at p as a number, either byte order since the program might want either
+    std::uint32_t load(const std::uint8_t* p, const std::size_t width, const bool bigEndian) {
+        std::uint32_t value = 0;
+        std::memcpy(&value, p, width);
+        return bigEndian ? std::byteswap(value) >> (32 - 8 * width) : value;
+    }
+
+    void store(std::uint8_t* p, const std::size_t width, const bool bigEndian, std::uint32_t value) {
+        value = bigEndian ? std::byteswap(value << (32 - 8 * width)) : value;
+        std::memcpy(p, &value, width);
+    }
+
+    // Smallest of 1, 2 and 4 bytes a register value fits in, sign-extended ones (from lb, lh) included
+    std::size_t valueWidth(const MachineWord value) {
+        const auto fits = [value](const int bits) {
+            const auto extended = static_cast<std::int32_t>(value << (32 - bits)) >> (32 - bits);
+            return value < (1u << bits) || static_cast<MachineWord>(extended) == value;
+        };
+        return fits(8) ? 1 : fits(16) ? 2 : 4;
+    }
+
+    // Calls found(at, width, other) for every place in input one side of a comparison is at, other being the other
+    // side, until it returns false
+    template <typename Found>
+    void findComparisons(const std::span<const std::uint8_t> input, const std::span<const ComparisonRecord> comparisons,
+                         Found found) {
+        for (const auto& comparison : comparisons) {
+            const auto width = std::max(valueWidth(comparison.left), valueWidth(comparison.right));
+            if (width > input.size()) {
+                continue;
+            }
+
+            // Either side might be the one from the input. The guest is little-endian like us, so the low bytes of a
+            // register are the ones that came from memory.
+            for (const auto& [from, to] : {std::pair{comparison.left, comparison.right},
+                                           std::pair{comparison.right, comparison.left}}) {
+                for (std::size_t at = 0; at + width <= input.size(); at++) {
+                    if (std::memcmp(input.data() + at, &from, width) == 0 && !found(at, width, to)) {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+} // namespace
+
+void LaneRandom::seed(std::uint64_t seed) {
+    // splitmix64, which is what the xoshiro authors suggest for filling the state
+    const auto next = [&seed] {
+        seed += 0x9e3779b97f4a7c15;
+        auto z = seed;
+        z      = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z      = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    };
+    for (std::size_t i = 0; i < WIDTH; i++) {
+        s0[i] = next();
+        s1[i] = next();
+        s2[i] = next();
+        s3[i] = next();
+    }
+}
+
+std::array<std::uint64_t, LaneRandom::WIDTH> LaneRandom::next() {
+    // Returned rather than written through a reference, which the compiler would have to assume overlaps the state
+    // (and not vectorize)
+    std::array<std::uint64_t, WIDTH> out;
+    for (std::size_t i = 0; i < WIDTH; i++) {
+        const auto result = std::rotl(s1[i] * 5, 7) * 9;
+        const auto t      = s1[i] << 17;
+        s2[i] ^= s0[i];
+        s3[i] ^= s1[i];
+        s1[i] ^= s2[i];
+        s0[i] ^= s3[i];
+        s2[i] ^= t;
+        s3[i]  = std::rotl(s3[i], 45);
+        out[i] = result;
+    }
+    return out;
+}
+
+MutationEngine::MutationEngine(const std::size_t inputSize, const std::uint64_t seed)
+    : size(inputSize), rootSeed(seed) {}
+
+void MutationEngine::addSeed(const std::uint8_t* data) { seeds.insert(seeds.end(), data, data + size); }
+
+void MutationEngine::addToken(const std::span<const std::uint8_t> token) {
+    if (token.empty() || size == 0) {
+        return;
+    }
+    std::vector<std::uint8_t> cut(token.begin(), token.begin() + std::min(token.size(), size));
+    if (std::find(tokens.begin(), tokens.end(), cut) == tokens.end()) {
+        tokens.push_back(std::move(cut));
+    }
+}
+
+void MutationEngine::mutateBatch(const std::uint64_t batch, std::uint8_t* inputs, const std::size_t count) {
+    if (size == 0) {
+        return;
+    }
+
+    random.seed(rootSeed + batch * 0xd1b54a32d192ed03);
+    std::array<std::uint64_t, LaneRandom::WIDTH> what{};
+    std::array<std::uint64_t, LaneRandom::WIDTH> value{};
+    const auto kinds = static_cast<std::size_t>(tokens.empty() ? Mutation::TOKEN_OVERWRITE : Mutation::COUNT);
+
+    for (std::size_t first = 0; first < count; first += LaneRandom::WIDTH) {
+        const auto group = std::min(LaneRandom::WIDTH, count - first);
+        auto* base       = inputs + first * size;
+
+        // Nothing to mutate yet, every input gets fresh random bytes, eight at a time
+        if (seeds.empty()) {
+            for (std::size_t offset = 0; offset < size; offset += 8) {
+                value = random.next();
+                const auto bytes = std::min<std::size_t>(8, size - offset);
+                for (std::size_t lane = 0; lane < group; lane++) {
+                    std::memcpy(base + lane * size + offset, &value[lane], bytes);
+                }
+            }
+            continue;
+        }
+
+        // The inputs made together get the same stack of 1, 2, 4, 8 or 16 mutations, every input with a seed, places
+        // and values of its own. Picking the kind of every mutation separately made the switch in mutate() a
+        // mispredicted branch each time, which was most of what a mutation cost.
+        auto plan        = random.next();
+        const auto stack = std::size_t{1} << take(plan[0], 5);
+        static_assert(4 * (LaneRandom::WIDTH - 1) >= MAX_STACK, "Not enough of the plan left for the kinds");
+
+        what = random.next();
+        for (std::size_t lane = 0; lane < group; lane++) {
+            std::memcpy(base + lane * size, seedData(take(what[lane], seedCount())), size);
+        }
+        for (std::size_t round = 0; round < stack; round++) {
+            const auto kind = take(plan[1 + round / 4], kinds);
+            what            = random.next();
+            value           = random.next();
+            for (std::size_t lane = 0; lane < group; lane++) {
+                mutate(kind, base + lane * size, what[lane], value[lane]);
+            }
+        }
+    }
+}
+
+// what says where the mutation goes, value what it writes
+void MutationEngine::mutate(const std::size_t kind, std::uint8_t* input, std::uint64_t what,
+                            std::uint64_t value) const {
+    const auto mutation = static_cast<Mutation>(kind);
+    const auto position = take(what, size);
+
+    switch (mutation) {
+        case Mutation::FLIP_BIT: {
+            input[position] ^= 1u << take(value, 8);
+            break;
+        }
+        case Mutation::FLIP_BYTE: {
+            input[position] ^= 0xff;
+            break;
+        }
+        case Mutation::RANDOM_BYTE: {
+            input[position] ^= 1 + take(value, 255);
+            break;
+        }
+        case Mutation::ADD_8:
+        case Mutation::ADD_16:
+        case Mutation::ADD_32: {
+            const auto width  = std::min<std::size_t>(std::size_t{1} << (static_cast<int>(mutation) - 3), size);
+            const auto at     = std::min(position, size - width);
+            const auto big    = take(value, 2) != 0;
+            const auto amount = static_cast<std::uint32_t>(1 + take(value, ARITHMETIC_MAX));
+            const auto old    = load(input + at, width, big);
+            store(input + at, width, big, take(value, 2) != 0 ? old + amount : old - amount);
+            break;
+        }
+        case Mutation::INTERESTING_8: {
+            input[position] = static_cast<std::uint8_t>(INTERESTING_8[take(value, std::size(INTERESTING_8))]);
+            break;
+        }
+        case Mutation::INTERESTING_16:
+        case Mutation::INTERESTING_32: {
+            // 16-bit ones can be any of the 8-bit values too, 32-bit ones any of either
+            const auto wide   = mutation == Mutation::INTERESTING_32;
+            const auto width  = std::min<std::size_t>(wide ? 4 : 2, size);
+            const auto at     = std::min(position, size - width);
+            const auto big    = take(value, 2) != 0;
+            auto index        = take(value, std::size(INTERESTING_8) + std::size(INTERESTING_16) +
+                                                (wide ? std::size(INTERESTING_32) : 0));
+            std::int32_t pick = 0;
+            if (index < std::size(INTERESTING_8)) {
+                pick = INTERESTING_8[index];
+            } else if ((index -= std::size(INTERESTING_8)) < std::size(INTERESTING_16)) {
+                pick = INTERESTING_16[index];
+            } else {
+                pick = INTERESTING_32[index - std::size(INTERESTING_16)];
+            }
+            store(input + at, width, big, static_cast<std::uint32_t>(pick));
+            break;
+        }
+        case Mutation::DELETE_BLOCK: {
+            const auto length = blockLength(what, size - position);
+            std::memmove(input + position, input + position + length, size - position - length);
+            std::memset(input + size - length, 0, length);
+            break;
+        }
+        case Mutation::INSERT_BLOCK:
+        case Mutation::OVERWRITE_BLOCK: {
+            // Either a copy of another part of the input or a run of one byte
+            const auto length = blockLength(what, size - position);
+            if (mutation == Mutation::INSERT_BLOCK) {
+                std::memmove(input + position + length, input + position, size - position - length);
+            }
+            if (take(value, 4) != 0) {
+                const auto from = take(value, size - length + 1);
+                std::memmove(input + position, input + from, length);
+            } else {
+                std::memset(input + position, static_cast<std::uint8_t>(value), length);
+            }
+            break;
+        }
+        case Mutation::SPLICE: {
+            // The rest of the input from another seed
+            const auto* other = seedData(take(value, seedCount()));
+            std::memcpy(input + position, other + position, size - position);
+            break;
+        }
+        case Mutation::TOKEN_OVERWRITE:
+        case Mutation::TOKEN_INSERT: {
+            const auto& token = tokens[take(value, tokens.size())];
+            const auto at     = std::min(position, size - token.size());
+            if (mutation == Mutation::TOKEN_INSERT) {
+                std::memmove(input + at + token.size(), input + at, size - at - token.size());
+            }
+            std::memcpy(input + at, token.data(), token.size());
+            break;
+        }
+        case Mutation::COUNT: {
+            break;
+        }
+    }
+}
+
+std::vector<std::vector<std::uint8_t>> inputToState(const std::span<const std::uint8_t> input,
+                                                    const std::span<const ComparisonRecord> comparisons,
+                                                    const std::size_t maxCandidates) {
+    std::vector<std::vector<std::uint8_t>> candidates;
+    std::vector<std::uint8_t> candidate;
+    findComparisons(input, comparisons, [&](const std::size_t at, const std::size_t width, const MachineWord to) {
+        candidate.assign(input.begin(), input.end());
+        std::memcpy(candidate.data() + at, &to, width);
+        if (std::find(candidates.begin(), candidates.end(), candidate) == candidates.end()) {
+            candidates.push_back(candidate);
+        }
+        return candidates.size() < maxCandidates;
+    });
+    return candidates;
+}
+
+std::vector<std::vector<std::uint8_t>> comparisonTokens(const std::span<const std::uint8_t> input,
+                                                        const std::span<const ComparisonRecord> comparisons,
+                                                        const std::size_t maxTokens) {
+    std::vector<std::vector<std::uint8_t>> tokens;
+    std::vector<std::uint8_t> token;
+    findComparisons(input, comparisons, [&](std::size_t, const std::size_t width, const MachineWord to) {
+        const auto* bytes = reinterpret_cast<const std::uint8_t*>(&to);
+        token.assign(bytes, bytes + width);
+        if (std::find(tokens.begin(), tokens.end(), token) == tokens.end()) {
+            tokens.push_back(token);
+        }
+        return tokens.size() < maxTokens;
+    });
+    return tokens;
+}